@@ -0,0 +1,83 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "Articulation.h"
+
+#include <cmath>
+#include <utility>
+
+namespace Vis
+{
+
+/// The matrix of a moving joint at position q: the motion, then the origin.
+static void JointMatrix(JointType type, const osg::Vec3d &a,
+                        const osg::Matrix &origin, double q, osg::Matrix &m)
+{
+    m = origin;
+    if (type == JointType_Prismatic) {
+        m.setTrans(origin.getTrans()
+                   + osg::Matrix::transform3x3(a * q, origin));
+        return;
+    }
+
+    // rotation about a by q, for row vectors as osg::Matrix::rotate(...)
+    const double c = std::cos(q), s = std::sin(q), t = 1.0 - c;
+    const double r[3][3] = {
+        {t * a.x() * a.x() + c, t * a.x() * a.y() + s * a.z(),
+         t * a.x() * a.z() - s * a.y()},
+        {t * a.x() * a.y() - s * a.z(), t * a.y() * a.y() + c,
+         t * a.y() * a.z() + s * a.x()},
+        {t * a.x() * a.z() + s * a.y(), t * a.y() * a.z() - s * a.x(),
+         t * a.z() * a.z() + c}};
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            m(i, j) = r[i][0] * origin(0, j) + r[i][1] * origin(1, j)
+                      + r[i][2] * origin(2, j);
+        }
+    }
+}
+
+Articulation::Articulation(
+    std::vector<osg::ref_ptr<osg::MatrixTransform>> links,
+    const std::vector<Joint> &joints)
+    : m_links(std::move(links))
+{
+    m_joints.reserve(joints.size());
+    for (size_t i = 0; i < joints.size(); ++i) {
+        const Joint &joint = joints[i];
+        CompiledJoint compiled;
+        compiled.type = joint.type;
+        compiled.axis.set(joint.axis[0], joint.axis[1], joint.axis[2]);
+        compiled.axis.normalize();
+        compiled.origin.setRotate(
+            osg::Quat(joint.quat[0], joint.quat[1], joint.quat[2],
+                      joint.quat[3]));
+        compiled.origin.setTrans(joint.trans[0], joint.trans[1],
+                                 joint.trans[2]);
+        if (joint.type == JointType_Fixed) {
+            m_links[i]->setMatrix(compiled.origin);
+        }
+        else {
+            ++m_num_dofs;
+        }
+        m_joints.push_back(compiled);
+    }
+}
+
+void Articulation::SetJointPositions(const float *positions)
+{
+    osg::Matrix m;
+    size_t dof = 0;
+    for (size_t i = 0; i < m_joints.size(); ++i) {
+        const CompiledJoint &joint = m_joints[i];
+        if (joint.type == JointType_Fixed) continue;
+        JointMatrix(joint.type, joint.axis, joint.origin, positions[dof++], m);
+        m_links[i]->setMatrix(m);
+    }
+}
+
+const osg::Matrix &Articulation::BaseMatrix() const
+{
+    return m_links.front()->getMatrix();
+}
+
+} // namespace Vis
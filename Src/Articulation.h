@@ -0,0 +1,77 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/MatrixTransform>
+
+#include <array>
+#include <stddef.h>
+#include <vector>
+
+namespace Vis
+{
+
+enum JointType
+{
+    JointType_Fixed = 0, // no motion, takes no position
+    JointType_Revolute,  // rotates about its axis, position in radians
+    JointType_Prismatic, // slides along its axis
+};
+
+/**
+ * The joint placing a link in the frame of its parent link. At position q the
+ * link is moved about or along axis, given in the frame of the link, by q,
+ * then placed at the fixed offset (trans, quat) from its parent.
+ */
+struct Joint
+{
+    JointType type{JointType_Revolute};
+    std::array<float, 3> axis{0.f, 0.f, 1.f};
+    std::array<float, 3> trans{0.f, 0.f, 0.f};
+    std::array<float, 4> quat{0.f, 0.f, 0.f, 1.f};
+};
+
+/**
+ * A chain of links, each one the child of the previous one in the scene
+ * graph, with the joint of each link compiled once: the transforms of the
+ * links are kept in a flat array and the offsets as matrices, so setting the
+ * joint positions is a single pass writing the matrix of each moving link.
+ */
+class Articulation
+{
+public:
+    Articulation() = default;
+
+    /// links and joints have the same size, fixed links are placed here.
+    Articulation(std::vector<osg::ref_ptr<osg::MatrixTransform>> links,
+                 const std::vector<Joint> &joints);
+
+    /// Number of positions taken by SetJointPositions(...), one for each
+    /// joint that is not fixed.
+    size_t NumDofs() const { return m_num_dofs; }
+
+    /// Move the links, positions holds NumDofs() values in the chain order.
+    void SetJointPositions(const float *positions);
+
+    /// The matrix of the first link, as last set.
+    const osg::Matrix &BaseMatrix() const;
+
+    /// The links, from the base to the tip.
+    const std::vector<osg::ref_ptr<osg::MatrixTransform>> &Links() const
+    {
+        return m_links;
+    }
+
+private:
+    struct CompiledJoint
+    {
+        JointType type;
+        osg::Vec3d axis; // unit length
+        osg::Matrix origin;
+    };
+
+    std::vector<osg::ref_ptr<osg::MatrixTransform>> m_links;
+    std::vector<CompiledJoint> m_joints;
+    size_t m_num_dofs{0};
+};
+
+} // namespace Vis
@@ -1,4 +1,6 @@
 #include "Logger.h"
+#include "Normals.h"
+#include "StlReader.h"
 
 #include <QApplication>
 #include <QViewerWidget.h>
@@ -11,8 +13,632 @@
 #include <QAction>
 #include <QFileDialog>
 
+#include <osg/Matrixf>
+#include <osgDB/ReadFile>
+#include <osgUtil/SmoothingVisitor>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 using namespace Vis;
 
+// Benchmarks of the viewer, run from the Benchmarks menu. Each one creates
+// its own objects, deletes them when done and returns a one line report.
+
+/// Resident memory of the process, 0 where it is not known.
+static size_t ResidentBytes()
+{
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (statm >> pages >> resident) {
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+#endif
+    return 0;
+}
+
+static double MiBSince(size_t before)
+{
+    return (static_cast<double>(ResidentBytes()) - before) / (1 << 20);
+}
+
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+/// A flat grid of n x n cells, two triangles each, one unit wide.
+static void GridMesh(int n, std::vector<float> &vertices,
+                     std::vector<unsigned int> &indices)
+{
+    vertices.clear();
+    indices.clear();
+    vertices.reserve(3 * (n + 1) * (n + 1));
+    indices.reserve(6 * n * n);
+    for (int y = 0; y <= n; ++y) {
+        for (int x = 0; x <= n; ++x) {
+            vertices.insert(vertices.end(),
+                            {float(x) / n, float(y) / n, 0.f});
+        }
+    }
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            const unsigned int i = y * (n + 1) + x;
+            indices.insert(indices.end(),
+                           {i, i + 1, i + n + 2, i, i + n + 2, i + n + 1});
+        }
+    }
+}
+
+/// Drop the pages of a file from the page cache, so that reading it next
+/// comes from the disk. Return false where it is not supported.
+static bool EvictFromPageCache(const std::string &path)
+{
+#ifdef __linux__
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    const bool evicted = fdatasync(fd) == 0
+                         && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return evicted;
+#else
+    return false;
+#endif
+}
+
+/// Time to build a cell with View calls, as a session would at startup,
+/// against loading it back from a scene file. It runs on a view of its own
+/// since LoadScene replaces all the objects of a view.
+static std::string BenchSceneFile(View &)
+{
+    View scratch;
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    GridMesh(500, vertices, indices); // 500k triangles
+    std::vector<float> xyzs(3 * 2000000);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0.f, 10.f);
+    for (float &x : xyzs) {
+        x = uniform(rng);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 8; ++i) {
+        const Handle h = scratch.Mesh(vertices, indices, {0.6f, 0.6f, 0.6f});
+        scratch.SetTransform(h, {1.1f * i, 0.f, 0.f}, {0, 0, 0, 1});
+    }
+    scratch.Point(xyzs, 1.f, {0.f, 0.f, 1.f});
+    scratch.Plane(10, 10);
+    scratch.Axes();
+    for (int i = 0; i < 100; ++i) {
+        scratch.Box({0.1f * i, -1.f, 0.f}, {0.05f, 0.05f, 0.05f});
+    }
+    const double build_ms = MillisecondsSince(start);
+
+    const std::string path = (std::filesystem::temp_directory_path()
+                              / "OsgQtViewer-benchmark.scene")
+                                 .string();
+    if (!scratch.SaveScene(path)) {
+        return "can not save the scene";
+    }
+    const double file_mib =
+        static_cast<double>(std::filesystem::file_size(path)) / (1 << 20);
+    const bool cold = EvictFromPageCache(path);
+    start = std::chrono::steady_clock::now();
+    const bool loaded = scratch.LoadScene(path);
+    const double load_ms = MillisecondsSince(start);
+    std::filesystem::remove(path);
+    if (!loaded) {
+        return "can not load the scene";
+    }
+    return fmt::format("built in {:.1f} ms, {:.1f} MiB scene file loaded in "
+                       "{:.1f} ms ({})",
+                       build_ms, file_mib, load_ms,
+                       cold ? "cold" : "from the page cache");
+}
+
+/// Write a binary STL file of a grid of n x n cells, two facets each.
+static bool WriteGridStl(const std::string &path, int n)
+{
+    std::ofstream out(path, std::ios::binary);
+    const char header[80] = {};
+    const uint32_t num_facets = 2u * n * n;
+    out.write(header, sizeof(header));
+    out.write(reinterpret_cast<const char *>(&num_facets), 4);
+    std::vector<char> row(50 * 2 * n, 0);
+    for (int y = 0; y < n && out; ++y) {
+        for (int x = 0; x < n; ++x) {
+            const float x0 = float(x) / n, x1 = float(x + 1) / n;
+            const float y0 = float(y) / n, y1 = float(y + 1) / n;
+            // normal, 3 vertices and 2 attribute bytes
+            const float facets[2][12] = {
+                {0, 0, 1, x0, y0, 0, x1, y0, 0, x1, y1, 0},
+                {0, 0, 1, x0, y0, 0, x1, y1, 0, x0, y1, 0}};
+            std::memcpy(&row[100 * x], facets[0], sizeof(facets[0]));
+            std::memcpy(&row[100 * x + 50], facets[1], sizeof(facets[1]));
+        }
+        out.write(row.data(), row.size());
+    }
+    return static_cast<bool>(out);
+}
+
+/// Time and memory of reading binary STL files of 10M and 50M triangles
+/// with the viewer's reader, as View::Load does, and with the osgDB plugin.
+static std::string BenchStlReader(View &)
+{
+    const std::string path = (std::filesystem::temp_directory_path()
+                              / "OsgQtViewer-benchmark.stl")
+                                 .string();
+    std::string report;
+    // 500 MB and 2.5 GB files
+    for (const int cells : {2237, 5000}) {
+        if (!report.empty()) report += ", ";
+        if (!WriteGridStl(path, cells)) {
+            std::filesystem::remove(path);
+            return report + "can not write the STL file";
+        }
+        report += fmt::format("{} triangles:", 2 * cells * cells);
+        for (const bool plugin : {false, true}) {
+            const size_t before = ResidentBytes();
+            const auto start = std::chrono::steady_clock::now();
+            osg::ref_ptr<osg::Node> node;
+            if (plugin) {
+                node = osgDB::readRefNodeFile(path);
+            }
+            else {
+                node = ReadStlFile(path);
+            }
+            const double ms = MillisecondsSince(start);
+            report += fmt::format(" {} {:.1f} ms, {:.1f} MiB{}",
+                                  plugin ? "osgDB plugin" : "viewer reader",
+                                  ms, MiBSince(before),
+                                  node ? "" : " (failed)");
+        }
+    }
+    std::filesystem::remove(path);
+    return report;
+}
+
+/// A geometry of the triangles of GridMesh(n), without normals.
+static osg::ref_ptr<osg::Geometry> GridGeometry(int n)
+{
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    GridMesh(n, vertices, indices);
+    osg::ref_ptr<osg::Vec3Array> array =
+        new osg::Vec3Array(vertices.size() / 3);
+    std::memcpy(array->getDataPointer(), vertices.data(),
+                vertices.size() * sizeof(float));
+    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+    geom->setVertexArray(array);
+    geom->addPrimitiveSet(new osg::DrawElementsUInt(
+        GL_TRIANGLES, indices.begin(), indices.end()));
+    return geom;
+}
+
+/// Time of computing the vertex normals of a mesh with ComputeNormals, as
+/// View::Mesh does, and with osgUtil::SmoothingVisitor.
+static std::string BenchNormals(View &)
+{
+    std::string report;
+    for (const int cells : {708, 2237}) { // 1M and 10M triangles
+        report += fmt::format("{}{} triangles:", report.empty() ? "" : ", ",
+                              2 * cells * cells);
+        for (const bool smoothing : {false, true}) {
+            osg::ref_ptr<osg::Geometry> geom = GridGeometry(cells);
+            const auto start = std::chrono::steady_clock::now();
+            bool done = true;
+            if (smoothing) {
+                osgUtil::SmoothingVisitor::smooth(*geom);
+            }
+            else {
+                done = ComputeNormals(*geom);
+            }
+            report += fmt::format(" {} {:.1f} ms{}",
+                                  smoothing ? "SmoothingVisitor" : "viewer",
+                                  MillisecondsSince(start),
+                                  done ? "" : " (failed)");
+        }
+    }
+    return report;
+}
+
+/// Memory and time of cloning a large part with CloneMode_Deep and
+/// CloneMode_Shared.
+static std::string BenchCloneMemory(View &v)
+{
+    const int cells = 300; // 180k triangles
+    const int num_clones = 50;
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    GridMesh(cells, vertices, indices);
+    const Handle part = v.Mesh(vertices, indices, {0.6f, 0.6f, 0.6f});
+
+    std::string report = fmt::format("{} clones of {} triangles:", num_clones,
+                                     indices.size() / 3);
+    // shared first, the memory freed after the deep clones is kept by the
+    // process and would hide what the shared ones take
+    for (const CloneMode mode : {CloneMode_Shared, CloneMode_Deep}) {
+        v.SetCloneMode(mode);
+        const size_t before = ResidentBytes();
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<Handle> clones;
+        for (int i = 0; i < num_clones; ++i) {
+            clones.push_back(v.Clone(
+                part, {1.5f * (i % 10), 1.5f * (i / 10), 0.f}, {0, 0, 0, 1}));
+        }
+        const double ms = MillisecondsSince(start);
+        report += fmt::format(" {} {:.1f} MiB in {:.1f} ms",
+                              mode == CloneMode_Shared ? "shared" : "deep",
+                              MiBSince(before), ms);
+        v.Delete(clones);
+    }
+    v.SetCloneMode(CloneMode_Deep);
+    v.Delete(part);
+    return report;
+}
+
+/// Time of setting the poses of many objects each frame: one SetTransform
+/// call per object, osg::Matrixf built by the caller with makeRotate as the
+/// vector overload of SetTransforms used to, and the flat SetTransforms.
+static std::string BenchPoseUpload(View &v)
+{
+    const size_t n = 20000;
+    const int frames = 50;
+    std::vector<Handle> hs;
+    hs.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        hs.push_back(v.Box({0.1f * (i % 100), 0.1f * (i / 100), 0.f},
+                           {0.02f, 0.02f, 0.02f}));
+    }
+    std::vector<float> positions(3 * n), quats(4 * n);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+    for (size_t i = 0; i < n; ++i) {
+        positions[3 * i] = 0.1f * (i % 100);
+        positions[3 * i + 1] = 0.1f * (i / 100);
+        positions[3 * i + 2] = 0.f;
+        osg::Quat q(uniform(rng), uniform(rng), uniform(rng), 1.f);
+        q /= q.length();
+        for (int k = 0; k < 4; ++k) {
+            quats[4 * i + k] = static_cast<float>(q[k]);
+        }
+    }
+
+    std::string report = fmt::format("{} objects, per frame:", n);
+    for (const int path : {0, 1, 2}) {
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<osg::Matrixf> matrices;
+        for (int f = 0; f < frames; ++f) {
+            if (path == 0) {
+                for (size_t i = 0; i < n; ++i) {
+                    const float *p = &positions[3 * i], *q = &quats[4 * i];
+                    v.SetTransform(hs[i], {p[0], p[1], p[2]},
+                                   {q[0], q[1], q[2], q[3]});
+                }
+            }
+            else if (path == 1) {
+                matrices.resize(n);
+                for (size_t i = 0; i < n; ++i) {
+                    const float *p = &positions[3 * i], *q = &quats[4 * i];
+                    matrices[i].makeRotate(osg::Quat(q[0], q[1], q[2], q[3]));
+                    matrices[i].setTrans(p[0], p[1], p[2]);
+                }
+                v.SetTransforms(hs.data(), matrices[0].ptr(), n);
+            }
+            else {
+                v.SetTransforms(hs.data(), positions.data(), quats.data(), n);
+            }
+        }
+        report += fmt::format(" {} {:.2f} ms",
+                              path == 0   ? "SetTransform"
+                              : path == 1 ? "osg::Matrixf"
+                                          : "flat SetTransforms",
+                              MillisecondsSince(start) / frames);
+    }
+    v.Delete(hs);
+    return report;
+}
+
+/// Cull time of many small objects, seen all at once and seen from close to
+/// a corner, where the scene octree should reject most of them, then after
+/// moving all of them. draw draws a frame.
+static std::string BenchCullTime(View &v, const std::function<void()> &draw)
+{
+    const size_t columns = 200, rows = 100, n = columns * rows;
+    const int frames = 30; // more than the frames the cull time averages
+    std::array<float, 3> eye, center, up;
+    v.GetCameraPose(eye, center, up);
+    std::vector<Handle> hs;
+    hs.reserve(n);
+    v.BeginBatch(n);
+    for (size_t i = 0; i < n; ++i) {
+        hs.push_back(v.Box({float(i % columns), float(i / columns), 0.f},
+                           {0.3f, 0.3f, 0.3f}));
+    }
+    v.EndBatch();
+    v.GetCullTime(); // starts measuring
+
+    auto cull_time = [&](const std::array<float, 3> &from,
+                         const std::array<float, 3> &to) {
+        v.SetCameraPose(from, to, {0.f, 1.f, 0.f});
+        for (int f = 0; f < frames; ++f) {
+            draw();
+        }
+        return v.GetCullTime();
+    };
+    const double all_ms = cull_time({100.f, 50.f, 300.f}, {100.f, 50.f, 0.f});
+    const double corner_ms = cull_time({5.f, 5.f, 10.f}, {5.f, 5.f, 0.f});
+
+    std::vector<float> positions(3 * n), quats(4 * n, 0.f);
+    for (size_t i = 0; i < n; ++i) {
+        positions[3 * i] = float(i % columns) + 0.5f;
+        positions[3 * i + 1] = float(i / columns) + 0.5f;
+        positions[3 * i + 2] = 0.f;
+        quats[4 * i + 3] = 1.f;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    v.SetTransforms(hs.data(), positions.data(), quats.data(), n);
+    const double move_ms = MillisecondsSince(start);
+    const double moved_ms = cull_time({5.f, 5.f, 10.f}, {5.f, 5.f, 0.f});
+
+    v.Delete(hs);
+    v.SetCameraPose(eye, center, up);
+    return fmt::format("{} boxes, cull all in view {:.3f} ms, from a corner "
+                       "{:.3f} ms, after moving all in {:.1f} ms {:.3f} ms",
+                       n, all_ms, corner_ms, move_ms, moved_ms);
+}
+
+/// Time and memory of plotting a point cloud the caller already has in
+/// memory, copied by View::Point(xyzs) and adopted through a PointBuffer.
+static std::string BenchPointAdopt(View &v)
+{
+    std::string report;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0.f, 10.f);
+    for (const size_t n : {size_t(1000000), size_t(10000000),
+                           size_t(50000000)}) {
+        std::vector<float> xyzs(3 * n);
+        for (float &x : xyzs) {
+            x = uniform(rng);
+        }
+        report += fmt::format("{}{} points:", report.empty() ? "" : ", ", n);
+        for (const bool adopt : {false, true}) {
+            const size_t before = ResidentBytes();
+            const auto start = std::chrono::steady_clock::now();
+            Handle h;
+            if (adopt) {
+                PointBuffer buffer;
+                buffer.xyzs = xyzs.data();
+                buffer.count = n;
+                h = v.Point(buffer);
+            }
+            else {
+                h = v.Point(xyzs);
+            }
+            report += fmt::format(" {} {:.1f} ms, {:.1f} MiB",
+                                  adopt ? "adopt" : "copy",
+                                  MillisecondsSince(start), MiBSince(before));
+            // xyzs must outlive the adopted cloud
+            v.Delete(h);
+        }
+    }
+    return report;
+}
+
+/// Frame time of a scene of meshes and points with each render policy, on a
+/// window of its own since the policy of a view is set when it is created.
+/// The first frame, which compiles the display lists or fills the buffer
+/// objects, is reported apart from the next ones, drawn turning around.
+static std::string BenchRenderPolicy(View &)
+{
+    const int frames = 60;
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    GridMesh(500, vertices, indices); // 500k triangles
+    std::vector<float> xyzs(3 * 2000000);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+    for (float &x : xyzs) {
+        x = uniform(rng);
+    }
+
+    std::string report;
+    for (const RenderPolicy policy :
+         {RenderPolicy_DisplayList, RenderPolicy_VertexBufferObject}) {
+        QViewerWidget widget(nullptr, Qt::WindowFlags(), policy);
+        widget.resize(800, 600);
+        widget.show();
+        QApplication::processEvents();
+        std::shared_ptr<View> v = widget.GetView();
+        for (int i = 0; i < 8; ++i) {
+            const Handle h = v->Mesh(vertices, indices, {0.6f, 0.6f, 0.6f});
+            v->SetTransform(h, {1.1f * (i % 4), 1.1f * (i / 4), 0.f},
+                            {0, 0, 0, 1});
+        }
+        v->Point(xyzs, 1.f, {0.f, 0.f, 1.f});
+
+        auto start = std::chrono::steady_clock::now();
+        widget.repaint();
+        const double first_ms = MillisecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f) {
+            const float angle = 6.2832f * f / frames;
+            v->SetCameraPose({2.2f + 6.f * std::cos(angle),
+                              1.f + 6.f * std::sin(angle), 4.f},
+                             {2.2f, 1.f, 0.f}, {0.f, 0.f, 1.f});
+            widget.repaint();
+        }
+        report += fmt::format(
+            "{}{} first frame {:.1f} ms, then {:.2f} ms per frame",
+            report.empty() ? "" : ", ",
+            policy == RenderPolicy_DisplayList ? "display lists"
+                                               : "vertex buffer objects",
+            first_ms, MillisecondsSince(start) / frames);
+    }
+    return report;
+}
+
+/// Throughput of creating many small objects one call at a time, alone and
+/// inside BeginBatch/EndBatch.
+static std::string BenchCreation(View &v)
+{
+    std::string report;
+    for (const size_t n : {size_t(10000), size_t(100000), size_t(1000000)}) {
+        report += fmt::format("{}{} boxes:", report.empty() ? "" : ", ", n);
+        for (const bool batch : {false, true}) {
+            std::vector<Handle> hs;
+            hs.reserve(n);
+            const auto start = std::chrono::steady_clock::now();
+            if (batch) v.BeginBatch(n);
+            for (size_t i = 0; i < n; ++i) {
+                hs.push_back(v.Box({0.1f * (i % 1000), 0.1f * (i / 1000), 0.f},
+                                   {0.02f, 0.02f, 0.02f}));
+            }
+            if (batch) v.EndBatch();
+            const double ms = MillisecondsSince(start);
+            report += fmt::format(" {} {:.0f} ms ({:.0f} k/s)",
+                                  batch ? "batched" : "alone", ms, n / ms);
+            v.Delete(hs);
+        }
+    }
+    return report;
+}
+
+/// Time of inserting, looking up and erasing 1M handles in the SlotMap of
+/// the views and in the std::unordered_map it replaced. No view is needed.
+static std::string BenchSlotMap(View &)
+{
+    const size_t n = 1000000;
+    const uint64_t type = 1;
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(1));
+
+    std::string report = fmt::format("{} handles:", n);
+    auto time = [&report](const char *name, const std::function<void()> &f) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        report += fmt::format(" {} {:.1f} ms", name, MillisecondsSince(start));
+    };
+    uint64_t sum = 0;
+
+    SlotMap<uint64_t, Handle> slots;
+    std::vector<Handle> hs(n);
+    time("SlotMap insert", [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            hs[i] = slots.Insert(type, i);
+        }
+    });
+    time("lookup", [&]() {
+        for (const size_t i : order) {
+            sum += *slots.Find(hs[i]);
+        }
+    });
+    time("erase", [&]() {
+        for (const size_t i : order) {
+            slots.Erase(hs[i]);
+        }
+    });
+
+    std::unordered_map<Handle, uint64_t, HandleHasher> map;
+    report += ",";
+    time("unordered_map insert", [&]() {
+        for (size_t i = 0; i < n; ++i) {
+            map.emplace(Handle(type, i + 1), i);
+        }
+    });
+    time("lookup", [&]() {
+        for (const size_t i : order) {
+            sum += map.find(Handle(type, i + 1))->second;
+        }
+    });
+    time("erase", [&]() {
+        for (const size_t i : order) {
+            map.erase(Handle(type, i + 1));
+        }
+    });
+    // keeps the lookups from being optimized away
+    return report + (sum == 0 ? " (no lookup)" : "");
+}
+
+/// Time of the frames of a synthetic mouse path over a 10M point cloud and
+/// a 5M triangle mesh, with each hover pick mode and without picking. The
+/// mouse moves go through the event queue of widget as the real ones do.
+static std::string BenchHoverPick(View &v, QViewerWidget &widget)
+{
+    const int steps = 200;
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    GridMesh(1581, vertices, indices); // 5M triangles
+    const Handle mesh = v.Mesh(vertices, indices, {0.6f, 0.6f, 0.6f});
+    std::vector<float> xyzs(3 * 10000000);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(0.f, 1.f);
+    for (size_t i = 0; i < xyzs.size(); i += 3) {
+        xyzs[i] = 1.2f + uniform(rng);
+        xyzs[i + 1] = uniform(rng);
+        xyzs[i + 2] = 0.1f * uniform(rng);
+    }
+    const Handle cloud = v.Point(xyzs, 1.f, {0.f, 0.f, 1.f});
+    std::array<float, 3> eye, center, up;
+    v.GetCameraPose(eye, center, up);
+    v.SetCameraPose({1.1f, 0.5f, 3.f}, {1.1f, 0.5f, 0.f}, {0.f, 1.f, 0.f});
+
+    osgGA::EventQueue *events = widget.getGraphicsWindow()->getEventQueue();
+    const float w = static_cast<float>(widget.width());
+    const float h = static_cast<float>(widget.height());
+    std::string report = fmt::format("{} mouse moves, per frame:", steps);
+    for (const IntersectorMode mode :
+         {IntersectorMode_Disable, IntersectorMode_Point,
+          IntersectorMode_LineSegment, IntersectorMode_Polytope}) {
+        v.SetIntersectMode(mode, true);
+        // the first pick builds the indices of the objects
+        events->mouseMotion(w / 2, h / 2);
+        widget.repaint();
+        double total_ms = 0.0, max_ms = 0.0;
+        for (int i = 0; i < steps; ++i) {
+            const float t = 6.2832f * i / steps;
+            events->mouseMotion(w * (0.5f + 0.4f * std::sin(3 * t)),
+                                h * (0.5f + 0.4f * std::sin(2 * t)));
+            const auto start = std::chrono::steady_clock::now();
+            widget.repaint();
+            const double ms = MillisecondsSince(start);
+            total_ms += ms;
+            max_ms = std::max(max_ms, ms);
+        }
+        const char *names[] = {"no picking", "Polytope", "LineSegment",
+                               "Point", "Line"};
+        report += fmt::format(" {} {:.2f} ms (max {:.2f})", names[mode],
+                              total_ms / steps, max_ms);
+    }
+    v.SetIntersectMode(IntersectorMode_Disable);
+    v.SetCameraPose(eye, center, up);
+    v.Delete(std::vector<Handle>{mesh, cloud});
+    return report;
+}
+
 int main(int argc, char **argv)
 {
     QApplication app(argc, argv);
@@ -57,12 +683,73 @@ int main(int argc, char **argv)
         }
     });
 
+    // Load every STL file of a directory and report the time it took, e.g.
+    // to measure the startup of a robot cell: OsgQtViewer <directory>
+    auto load_directory = [&](const std::string &dir) {
+        std::vector<std::string> fnames;
+        for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+            if (entry.path().extension() == ".stl") {
+                fnames.push_back(entry.path().string());
+            }
+        }
+        const auto start = std::chrono::steady_clock::now();
+        const std::vector<Vis::Handle> hs = v->Load(fnames);
+        const std::chrono::duration<double, std::milli> ms =
+            std::chrono::steady_clock::now() - start;
+        const size_t loaded =
+            std::count_if(hs.begin(), hs.end(),
+                          [](const Vis::Handle &h) { return h.uid != 0; });
+        win.statusBar()->showMessage(
+            fmt::format("Loaded {} of {} files from {} in {:.1f} ms", loaded,
+                        fnames.size(), dir, ms.count())
+                .c_str());
+    };
+    menu->addAction("Open &Directory", [&]() {
+        auto dir = QFileDialog::getExistingDirectory(
+            &win, "Select a directory of STL files", "./");
+        if (!dir.isEmpty()) {
+            load_directory(dir.toStdString());
+        }
+    });
+
     QMenu* view_menu = new QMenu("Views");
     view_menu->addAction(sidebar->toggleViewAction());
 
     menu->addMenu(view_menu);
 
+    QMenu *bench_menu = new QMenu("Benchmarks");
+    auto add_benchmark = [&](const char *name,
+                             std::function<std::string(View &)> bench) {
+        bench_menu->addAction(name, [&win, v, name, bench]() {
+            const std::string report = bench(*v);
+            LOG_INFO("{0}: {1}", name, report);
+            win.statusBar()->showMessage(
+                fmt::format("{}: {}", name, report).c_str());
+        });
+    };
+    add_benchmark("Clone memory", BenchCloneMemory);
+    add_benchmark("Scene file startup", BenchSceneFile);
+    add_benchmark("STL reader", BenchStlReader);
+    add_benchmark("Normals", BenchNormals);
+    add_benchmark("Pose upload", BenchPoseUpload);
+    add_benchmark("Cull time", [viewer_widget](View &view) {
+        return BenchCullTime(view, [viewer_widget]() {
+            viewer_widget->repaint();
+        });
+    });
+    add_benchmark("Point copy vs adopt", BenchPointAdopt);
+    add_benchmark("Render policies", BenchRenderPolicy);
+    add_benchmark("Object creation", BenchCreation);
+    add_benchmark("SlotMap", BenchSlotMap);
+    add_benchmark("Hover picking", [viewer_widget](View &view) {
+        return BenchHoverPick(view, *viewer_widget);
+    });
+    menu->addMenu(bench_menu);
+
     win.statusBar()->showMessage("ready");
+    if (argc > 1) {
+        load_directory(argv[1]);
+    }
 
     win.show();
     app.exec();
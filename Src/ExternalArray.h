@@ -0,0 +1,94 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Array>
+
+#include <memory>
+
+namespace Vis
+{
+
+/**
+ * An osg::Array which reads its elements from memory owned by somebody else.
+ *
+ * The array never copies, resizes or frees the memory. The owner is kept
+ * alive through a shared_ptr, whose deleter is the place to give the memory
+ * back, so it runs exactly once when the last array (and clone) referencing
+ * the buffer is destroyed.
+ */
+template <typename T, osg::Array::Type ARRAYTYPE, int DataSize, int DataType>
+class ExternalArray : public osg::Array
+{
+public:
+    ExternalArray()
+        : osg::Array(ARRAYTYPE, DataSize, DataType), m_data(nullptr),
+          m_count(0)
+    {
+    }
+
+    ExternalArray(const T *data, unsigned int count,
+                  std::shared_ptr<const void> owner)
+        : osg::Array(ARRAYTYPE, DataSize, DataType), m_data(data),
+          m_count(count), m_owner(std::move(owner))
+    {
+    }
+
+    ExternalArray(const ExternalArray &other,
+                  const osg::CopyOp &copyop = osg::CopyOp::SHALLOW_COPY)
+        : osg::Array(other, copyop), m_data(other.m_data),
+          m_count(other.m_count), m_owner(other.m_owner)
+    {
+    }
+
+    META_Object(Vis, ExternalArray);
+
+    virtual void accept(osg::ArrayVisitor &av) { av.apply(*this); }
+    virtual void accept(osg::ConstArrayVisitor &av) const { av.apply(*this); }
+    virtual void accept(unsigned int index, osg::ValueVisitor &vv)
+    {
+        vv.apply(const_cast<T &>(m_data[index]));
+    }
+    virtual void accept(unsigned int index, osg::ConstValueVisitor &vv) const
+    {
+        vv.apply(m_data[index]);
+    }
+
+    virtual int compare(unsigned int lhs, unsigned int rhs) const
+    {
+        if (m_data[lhs] < m_data[rhs]) return -1;
+        if (m_data[rhs] < m_data[lhs]) return 1;
+        return 0;
+    }
+
+    virtual unsigned int getElementSize() const { return sizeof(T); }
+    virtual const GLvoid *getDataPointer() const { return m_data; }
+    virtual const GLvoid *getDataPointer(unsigned int index) const
+    {
+        return m_data + index;
+    }
+    virtual unsigned int getTotalDataSize() const
+    {
+        return m_count * static_cast<unsigned int>(sizeof(T));
+    }
+    virtual unsigned int getNumElements() const { return m_count; }
+
+    // The memory is not ours, so it can neither grow nor shrink.
+    virtual void reserveArray(unsigned int) {}
+    virtual void resizeArray(unsigned int) {}
+
+    const T &operator[](unsigned int index) const { return m_data[index]; }
+
+protected:
+    virtual ~ExternalArray() {}
+
+    const T *m_data;
+    unsigned int m_count;
+    std::shared_ptr<const void> m_owner;
+};
+
+typedef ExternalArray<osg::Vec3, osg::Array::Vec3ArrayType, 3, GL_FLOAT>
+    ExternalVec3Array;
+typedef ExternalArray<osg::Vec4, osg::Array::Vec4ArrayType, 4, GL_FLOAT>
+    ExternalVec4Array;
+
+} // namespace Vis
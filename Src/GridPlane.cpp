@@ -0,0 +1,87 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "GridPlane.h"
+
+#include <osg/Program>
+#include <osg/Shader>
+
+namespace Vis
+{
+
+static const char *sg_grid_vert = R"(
+#version 120
+varying vec4 color;
+varying vec2 cell; // position in cells from the center of the plane
+
+void main()
+{
+    vec3 n = normalize(gl_NormalMatrix * gl_Normal);
+    // head light, same as the default OSG light, on both faces
+    float diffuse = abs(n.z);
+    color = vec4(gl_Color.rgb * (0.2 + 0.8 * diffuse), gl_Color.a);
+    cell = gl_MultiTexCoord0.xy;
+    gl_Position = ftransform();
+}
+)";
+
+static const char *sg_grid_frag = R"(
+#version 120
+varying vec4 color;
+varying vec2 cell;
+
+void main()
+{
+    // distance to the nearest line in pixels
+    vec2 d = abs(fract(cell - 0.5) - 0.5) / fwidth(cell);
+    float line = 1.0 - min(min(d.x, d.y), 1.0);
+    gl_FragColor = vec4(mix(color.rgb, color.rgb * 0.6, line), color.a);
+}
+)";
+
+static osg::Program *GetGridProgram()
+{
+    static osg::ref_ptr<osg::Program> program;
+    if (!program) {
+        program = new osg::Program;
+        program->addShader(new osg::Shader(osg::Shader::VERTEX, sg_grid_vert));
+        program->addShader(
+            new osg::Shader(osg::Shader::FRAGMENT, sg_grid_frag));
+    }
+    return program.get();
+}
+
+osg::ref_ptr<osg::Geometry> CreateGridPlane(float xlength, float ylength,
+                                            int half_x_num_cells,
+                                            int half_y_num_cells)
+{
+    const float hx = xlength / 2, hy = ylength / 2;
+    const float cx = static_cast<float>(half_x_num_cells);
+    const float cy = static_cast<float>(half_y_num_cells);
+
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+    vertices->push_back(osg::Vec3(-hx, -hy, 0));
+    vertices->push_back(osg::Vec3(hx, -hy, 0));
+    vertices->push_back(osg::Vec3(hx, hy, 0));
+    vertices->push_back(osg::Vec3(-hx, hy, 0));
+    osg::ref_ptr<osg::Vec2Array> cells = new osg::Vec2Array;
+    cells->push_back(osg::Vec2(-cx, -cy));
+    cells->push_back(osg::Vec2(cx, -cy));
+    cells->push_back(osg::Vec2(cx, cy));
+    cells->push_back(osg::Vec2(-cx, cy));
+    osg::ref_ptr<osg::Vec3Array> normals =
+        new osg::Vec3Array(1, osg::Vec3(0, 0, 1));
+    osg::ref_ptr<osg::DrawElementsUShort> indices =
+        new osg::DrawElementsUShort(GL_TRIANGLES);
+    const unsigned short quad[6] = {0, 1, 2, 0, 2, 3};
+    indices->insert(indices->end(), quad, quad + 6);
+
+    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+    geom->setVertexArray(vertices.get());
+    geom->setTexCoordArray(0, cells.get(), osg::Array::BIND_PER_VERTEX);
+    geom->setNormalArray(normals.get(), osg::Array::BIND_OVERALL);
+    geom->addPrimitiveSet(indices.get());
+    geom->getOrCreateStateSet()->setAttributeAndModes(GetGridProgram());
+    return geom;
+}
+
+} // namespace Vis
@@ -0,0 +1,22 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Geometry>
+
+namespace Vis
+{
+
+/**
+ * Build a plane of xlength by ylength centered at the origin, in the xy
+ * plane, with grid lines between 2 * half_x_num_cells by
+ * 2 * half_y_num_cells cells. Place it with the matrix of its transform.
+ *
+ * The plane is a single quad whatever the number of cells, the lines are
+ * drawn by its fragment shader about one pixel wide at any distance. The
+ * color of the plane is its overall color array, lines are a darker shade.
+ */
+osg::ref_ptr<osg::Geometry> CreateGridPlane(float xlength, float ylength,
+                                            int half_x_num_cells,
+                                            int half_y_num_cells);
+
+} // namespace Vis
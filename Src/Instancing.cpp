@@ -0,0 +1,486 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "Instancing.h"
+
+#include <osg/BoundingBox>
+#include <osg/Program>
+#include <osg/Shader>
+#include <osg/ValueObject>
+#include <osg/VertexAttribDivisor>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Vis
+{
+
+static const char *sg_instanced_vert = R"(
+#version 120
+attribute vec3 instance_center;
+attribute vec3 instance_scale;
+attribute vec4 instance_color;
+varying vec4 color;
+
+void main()
+{
+    vec4 pos = vec4(gl_Vertex.xyz * instance_scale + instance_center, 1.0);
+    // normals of a scaled shape are scaled by the inverse
+    vec3 n = normalize(gl_NormalMatrix * (gl_Normal / instance_scale));
+    // head light, same as the default OSG light
+    float diffuse = max(dot(n, vec3(0.0, 0.0, 1.0)), 0.0);
+    color = vec4(instance_color.rgb * (0.2 + 0.8 * diffuse), instance_color.a);
+    gl_Position = gl_ModelViewProjectionMatrix * pos;
+}
+)";
+
+static const char *sg_instanced_frag = R"(
+#version 120
+varying vec4 color;
+
+void main()
+{
+    gl_FragColor = color;
+}
+)";
+
+static const char *sg_copies_vert = R"(
+#version 120
+attribute vec4 instance_column0;
+attribute vec4 instance_column1;
+attribute vec4 instance_column2;
+attribute float instance_alpha;
+varying vec4 color;
+
+void main()
+{
+    // v * M for the row vectors of OSG
+    vec4 v = vec4(gl_Vertex.xyz, 1.0);
+    vec4 pos = vec4(dot(instance_column0, v), dot(instance_column1, v),
+                    dot(instance_column2, v), 1.0);
+    vec3 n = vec3(dot(instance_column0.xyz, gl_Normal),
+                  dot(instance_column1.xyz, gl_Normal),
+                  dot(instance_column2.xyz, gl_Normal));
+    n = normalize(gl_NormalMatrix * n);
+    // head light, same as the default OSG light
+    float diffuse = max(dot(n, vec3(0.0, 0.0, 1.0)), 0.0);
+    color = vec4(gl_Color.rgb * (0.2 + 0.8 * diffuse),
+                 gl_Color.a * instance_alpha);
+    gl_Position = gl_ModelViewProjectionMatrix * pos;
+}
+)";
+
+static const char *sg_shape_key = "InstancedShape";
+
+static const int sg_segments = 32;
+static const int sg_rings = 16;
+
+struct UnitMesh
+{
+    osg::ref_ptr<osg::Vec3Array> vertices{new osg::Vec3Array};
+    osg::ref_ptr<osg::Vec3Array> normals{new osg::Vec3Array};
+    osg::ref_ptr<osg::DrawElementsUShort> indices{
+        new osg::DrawElementsUShort(GL_TRIANGLES)};
+
+    unsigned short Add(const osg::Vec3 &v, const osg::Vec3 &n)
+    {
+        vertices->push_back(v);
+        normals->push_back(n);
+        return static_cast<unsigned short>(vertices->size() - 1);
+    }
+
+    void Triangle(unsigned short a, unsigned short b, unsigned short c)
+    {
+        indices->push_back(a);
+        indices->push_back(b);
+        indices->push_back(c);
+    }
+
+    void Quad(unsigned short a, unsigned short b, unsigned short c,
+              unsigned short d)
+    {
+        Triangle(a, b, c);
+        Triangle(a, c, d);
+    }
+};
+
+static void BuildSphere(UnitMesh &mesh)
+{
+    for (int r = 0; r <= sg_rings; ++r) {
+        const float phi = osg::PI * r / sg_rings;
+        for (int s = 0; s <= sg_segments; ++s) {
+            const float theta = 2 * osg::PI * s / sg_segments;
+            const osg::Vec3 p(std::sin(phi) * std::cos(theta),
+                              std::sin(phi) * std::sin(theta),
+                              -std::cos(phi));
+            mesh.Add(p, p);
+        }
+    }
+    const int row = sg_segments + 1;
+    for (int r = 0; r < sg_rings; ++r) {
+        for (int s = 0; s < sg_segments; ++s) {
+            mesh.Quad(r * row + s, r * row + s + 1, (r + 1) * row + s + 1,
+                      (r + 1) * row + s);
+        }
+    }
+}
+
+static void BuildBox(UnitMesh &mesh)
+{
+    // one face per axis direction, 4 vertices each for flat normals
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int sign = -1; sign <= 1; sign += 2) {
+            osg::Vec3 n, u, v;
+            n[axis] = sign;
+            u[(axis + 1) % 3] = 1;
+            v[(axis + 2) % 3] = sign;
+            const unsigned short a = mesh.Add(n - u - v, n);
+            const unsigned short b = mesh.Add(n + u - v, n);
+            const unsigned short c = mesh.Add(n + u + v, n);
+            const unsigned short d = mesh.Add(n - u + v, n);
+            mesh.Quad(a, b, c, d);
+        }
+    }
+}
+
+/// A cylinder-like side between rings at z0 (radius r0) and z1 (radius r1),
+/// with a cap at the bottom and, if r1 > 0, at the top.
+static void BuildRevolution(UnitMesh &mesh, float z0, float r0, float z1,
+                            float r1)
+{
+    // side normals lean towards +z when the radius shrinks upwards
+    const float slope = (r0 - r1) / (z1 - z0);
+    const unsigned short first = static_cast<unsigned short>(
+        mesh.vertices->size());
+    for (int s = 0; s <= sg_segments; ++s) {
+        const float theta = 2 * osg::PI * s / sg_segments;
+        const float c = std::cos(theta), si = std::sin(theta);
+        osg::Vec3 n(c, si, slope);
+        n.normalize();
+        mesh.Add(osg::Vec3(r0 * c, r0 * si, z0), n);
+        mesh.Add(osg::Vec3(r1 * c, r1 * si, z1), n);
+    }
+    for (int s = 0; s < sg_segments; ++s) {
+        const unsigned short i = first + s * 2;
+        mesh.Quad(i, i + 2, i + 3, i + 1);
+    }
+
+    const float zs[2] = {z0, z1};
+    const float rs[2] = {r0, r1};
+    for (int cap = 0; cap < 2; ++cap) {
+        if (rs[cap] <= 0) continue;
+        const osg::Vec3 n(0, 0, cap == 0 ? -1.f : 1.f);
+        const unsigned short center = mesh.Add(osg::Vec3(0, 0, zs[cap]), n);
+        for (int s = 0; s <= sg_segments; ++s) {
+            const float theta = 2 * osg::PI * s / sg_segments;
+            mesh.Add(osg::Vec3(rs[cap] * std::cos(theta),
+                               rs[cap] * std::sin(theta), zs[cap]),
+                     n);
+        }
+        for (int s = 0; s < sg_segments; ++s) {
+            if (cap == 0) {
+                mesh.Triangle(center, center + s + 2, center + s + 1);
+            }
+            else {
+                mesh.Triangle(center, center + s + 1, center + s + 2);
+            }
+        }
+    }
+}
+
+static osg::Program *GetInstancedProgram()
+{
+    static osg::ref_ptr<osg::Program> program;
+    if (!program) {
+        program = new osg::Program;
+        program->addShader(
+            new osg::Shader(osg::Shader::VERTEX, sg_instanced_vert));
+        program->addShader(
+            new osg::Shader(osg::Shader::FRAGMENT, sg_instanced_frag));
+        program->addBindAttribLocation("instance_center",
+                                       InstanceAttrib_Center);
+        program->addBindAttribLocation("instance_scale", InstanceAttrib_Scale);
+        program->addBindAttribLocation("instance_color", InstanceAttrib_Color);
+    }
+    return program.get();
+}
+
+static osg::Program *GetCopiesProgram()
+{
+    static osg::ref_ptr<osg::Program> program;
+    if (!program) {
+        program = new osg::Program;
+        program->addShader(
+            new osg::Shader(osg::Shader::VERTEX, sg_copies_vert));
+        program->addShader(
+            new osg::Shader(osg::Shader::FRAGMENT, sg_instanced_frag));
+        program->addBindAttribLocation("instance_column0",
+                                       InstanceAttrib_Column0);
+        program->addBindAttribLocation("instance_column1",
+                                       InstanceAttrib_Column1);
+        program->addBindAttribLocation("instance_column2",
+                                       InstanceAttrib_Column2);
+        program->addBindAttribLocation("instance_alpha", InstanceAttrib_Alpha);
+    }
+    return program.get();
+}
+
+osg::ref_ptr<osg::Geometry> CreateInstancedShapes(InstancedShape shape,
+                                                  const float *centers,
+                                                  const float *scales,
+                                                  const float *colors,
+                                                  size_t count)
+{
+    UnitMesh mesh;
+    switch (shape) {
+    case InstancedShape_Sphere:
+        BuildSphere(mesh);
+        break;
+    case InstancedShape_Box:
+        BuildBox(mesh);
+        break;
+    case InstancedShape_Cylinder:
+        BuildRevolution(mesh, -0.5f, 1.f, 0.5f, 1.f);
+        break;
+    case InstancedShape_Cone:
+        BuildRevolution(mesh, -0.25f, 1.f, 0.75f, 0.f);
+        break;
+    }
+
+    osg::ref_ptr<osg::Vec3Array> center_array =
+        new osg::Vec3Array(count, (const osg::Vec3 *)centers);
+    osg::ref_ptr<osg::Vec3Array> scale_array =
+        new osg::Vec3Array(count, (const osg::Vec3 *)scales);
+    osg::ref_ptr<osg::Vec4Array> color_array =
+        new osg::Vec4Array(count, (const osg::Vec4 *)colors);
+
+    // The unit mesh alone would give a bound around the origin, so provide
+    // the bound of all instances. The unit shapes fit in [-1, 1]^3.
+    osg::BoundingBox bb;
+    for (size_t i = 0; i < count; ++i) {
+        const osg::Vec3 &c = (*center_array)[i];
+        const osg::Vec3 &s = (*scale_array)[i];
+        bb.expandBy(c - s);
+        bb.expandBy(c + s);
+    }
+
+    mesh.indices->setNumInstances(static_cast<int>(count));
+
+    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+    geom->setVertexArray(mesh.vertices.get());
+    geom->setNormalArray(mesh.normals.get(), osg::Array::BIND_PER_VERTEX);
+    geom->setVertexAttribArray(InstanceAttrib_Center, center_array.get(),
+                               osg::Array::BIND_PER_VERTEX);
+    geom->setVertexAttribArray(InstanceAttrib_Scale, scale_array.get(),
+                               osg::Array::BIND_PER_VERTEX);
+    geom->setVertexAttribArray(InstanceAttrib_Color, color_array.get(),
+                               osg::Array::BIND_PER_VERTEX);
+    geom->addPrimitiveSet(mesh.indices.get());
+    geom->setInitialBound(bb);
+    geom->setUserValue(sg_shape_key, static_cast<int>(shape));
+    // instanced draws can not be compiled into display lists
+    geom->setUseDisplayList(false);
+    geom->setUseVertexBufferObjects(true);
+
+    osg::StateSet *ss = geom->getOrCreateStateSet();
+    ss->setAttributeAndModes(GetInstancedProgram());
+    ss->setAttribute(new osg::VertexAttribDivisor(InstanceAttrib_Center, 1));
+    ss->setAttribute(new osg::VertexAttribDivisor(InstanceAttrib_Scale, 1));
+    ss->setAttribute(new osg::VertexAttribDivisor(InstanceAttrib_Color, 1));
+    DirtyInstanceColors(geom.get());
+    return geom;
+}
+
+osg::ref_ptr<osg::Geometry> CreateInstancedCopies(const osg::Geometry &source,
+                                                  const osg::Matrix *matrices,
+                                                  const float *alphas,
+                                                  size_t count)
+{
+    // the program of the copies would replace theirs
+    const osg::StateSet *source_ss = source.getStateSet();
+    int shape = 0;
+    if (source.getUserValue(sg_shape_key, shape)
+        || (source_ss != nullptr
+            && source_ss->getAttribute(osg::StateAttribute::PROGRAM))) {
+        return nullptr;
+    }
+    for (unsigned int i = 0; i < source.getNumPrimitiveSets(); ++i) {
+        if (source.getPrimitiveSet(i)->getNumInstances() > 0) return nullptr;
+    }
+
+    osg::ref_ptr<osg::Vec4Array> columns[3];
+    for (int c = 0; c < 3; ++c) {
+        columns[c] = new osg::Vec4Array(count);
+    }
+    osg::ref_ptr<osg::FloatArray> alpha_array =
+        new osg::FloatArray(count, alphas);
+
+    const osg::BoundingBox &sbb = source.getBoundingBox();
+    osg::BoundingBox bb;
+    for (size_t i = 0; i < count; ++i) {
+        const osg::Matrix &m = matrices[i];
+        for (int c = 0; c < 3; ++c) {
+            (*columns[c])[i].set(m(0, c), m(1, c), m(2, c), m(3, c));
+        }
+        if (!sbb.valid()) continue;
+        for (unsigned int k = 0; k < 8; ++k) {
+            bb.expandBy(sbb.corner(k) * m);
+        }
+    }
+
+    // the arrays are shared, the primitive sets hold the instance count
+    osg::ref_ptr<osg::Geometry> geom =
+        new osg::Geometry(source, osg::CopyOp::SHALLOW_COPY);
+    geom->removePrimitiveSet(0, geom->getNumPrimitiveSets());
+    // the vertex attributes, user values and k-d tree of source are its own
+    geom->setVertexAttribArrayList(osg::Geometry::ArrayList());
+    geom->setUserDataContainer(nullptr);
+    geom->setShape(nullptr);
+    for (unsigned int i = 0; i < source.getNumPrimitiveSets(); ++i) {
+        osg::ref_ptr<osg::PrimitiveSet> ps =
+            static_cast<osg::PrimitiveSet *>(source.getPrimitiveSet(i)->clone(
+                osg::CopyOp::SHALLOW_COPY));
+        ps->setNumInstances(static_cast<int>(count));
+        geom->addPrimitiveSet(ps.get());
+    }
+    geom->setVertexAttribArray(InstanceAttrib_Column0, columns[0].get(),
+                               osg::Array::BIND_PER_VERTEX);
+    geom->setVertexAttribArray(InstanceAttrib_Column1, columns[1].get(),
+                               osg::Array::BIND_PER_VERTEX);
+    geom->setVertexAttribArray(InstanceAttrib_Column2, columns[2].get(),
+                               osg::Array::BIND_PER_VERTEX);
+    geom->setVertexAttribArray(InstanceAttrib_Alpha, alpha_array.get(),
+                               osg::Array::BIND_PER_VERTEX);
+    geom->setInitialBound(bb);
+    geom->setUseDisplayList(false);
+    geom->setUseVertexBufferObjects(true);
+
+    // its own state set, the one of source stays untouched
+    osg::ref_ptr<osg::StateSet> ss =
+        source_ss ? new osg::StateSet(*source_ss, osg::CopyOp::SHALLOW_COPY)
+                  : new osg::StateSet;
+    ss->setAttributeAndModes(GetCopiesProgram());
+    ss->setAttribute(new osg::VertexAttribDivisor(InstanceAttrib_Column0, 1));
+    ss->setAttribute(new osg::VertexAttribDivisor(InstanceAttrib_Column1, 1));
+    ss->setAttribute(new osg::VertexAttribDivisor(InstanceAttrib_Column2, 1));
+    ss->setAttribute(new osg::VertexAttribDivisor(InstanceAttrib_Alpha, 1));
+    geom->setStateSet(ss.get());
+    return geom;
+}
+
+osg::Vec4Array *GetInstanceColors(osg::Drawable *drawable)
+{
+    osg::Geometry *geom = drawable ? drawable->asGeometry() : nullptr;
+    if (geom == nullptr) return nullptr;
+    return dynamic_cast<osg::Vec4Array *>(
+        geom->getVertexAttribArray(InstanceAttrib_Color));
+}
+
+bool IntersectInstances(const osg::Geometry *geom, const osg::Vec3 &start,
+                        const osg::Vec3 &end, unsigned int &index,
+                        float &ratio, osg::Vec3 &normal)
+{
+    int shape = 0;
+    if (geom == nullptr || !geom->getUserValue(sg_shape_key, shape)) {
+        return false;
+    }
+    const osg::Vec3Array *centers = dynamic_cast<const osg::Vec3Array *>(
+        geom->getVertexAttribArray(InstanceAttrib_Center));
+    const osg::Vec3Array *scales = dynamic_cast<const osg::Vec3Array *>(
+        geom->getVertexAttribArray(InstanceAttrib_Scale));
+    if (centers == nullptr || scales == nullptr) return false;
+
+    // z range of the unit shape, x and y are in [-1, 1]
+    float z0 = -1.f, z1 = 1.f;
+    if (shape == InstancedShape_Cylinder) {
+        z0 = -0.5f;
+        z1 = 0.5f;
+    }
+    else if (shape == InstancedShape_Cone) {
+        z0 = -0.25f;
+        z1 = 0.75f;
+    }
+
+    const osg::Vec3 d = end - start;
+    bool hit = false;
+    ratio = 1.f;
+    const size_t count = std::min(centers->size(), scales->size());
+    for (size_t i = 0; i < count; ++i) {
+        const osg::Vec3 &c = (*centers)[i];
+        const osg::Vec3 &sc = (*scales)[i];
+        if (shape == InstancedShape_Sphere) {
+            // |start + d * t - c| = r
+            const float r = sc.x();
+            const osg::Vec3 o = start - c;
+            const float a = d * d;
+            const float b = 2.f * (o * d);
+            const float disc = b * b - 4.f * a * (o * o - r * r);
+            if (a <= 0.f || disc < 0.f) continue;
+            const float t = (-b - std::sqrt(disc)) / (2.f * a);
+            if (t < 0.f || t >= ratio) continue;
+            hit = true;
+            ratio = t;
+            index = static_cast<unsigned int>(i);
+            normal = (o + d * t) / r;
+            continue;
+        }
+
+        const osg::Vec3 lo = c + osg::Vec3(-sc.x(), -sc.y(), sc.z() * z0);
+        const osg::Vec3 hi = c + osg::Vec3(sc.x(), sc.y(), sc.z() * z1);
+        float tmin = 0.f, tmax = ratio;
+        int axis = -1;
+        float sign = 0.f;
+        for (int k = 0; k < 3 && tmin <= tmax; ++k) {
+            if (d[k] == 0.f) {
+                if (start[k] < lo[k] || start[k] > hi[k]) tmax = -1.f;
+                continue;
+            }
+            float t0 = (lo[k] - start[k]) / d[k];
+            float t1 = (hi[k] - start[k]) / d[k];
+            float s = -1.f;
+            if (t0 > t1) {
+                std::swap(t0, t1);
+                s = 1.f;
+            }
+            if (t0 > tmin) {
+                tmin = t0;
+                axis = k;
+                sign = s;
+            }
+            tmax = std::min(tmax, t1);
+        }
+        // a start inside the box gives no entry face, skip it
+        if (axis < 0 || tmin > tmax || tmin >= ratio) continue;
+        hit = true;
+        ratio = tmin;
+        index = static_cast<unsigned int>(i);
+        normal = osg::Vec3();
+        normal[axis] = sign;
+    }
+    return hit;
+}
+
+void DirtyInstanceColors(osg::Geometry *geom)
+{
+    osg::Vec4Array *colors = GetInstanceColors(geom);
+    if (colors == nullptr) return;
+    colors->dirty();
+
+    bool transparent = false;
+    for (const auto &c : *colors) {
+        if (c.a() < 1.f) {
+            transparent = true;
+            break;
+        }
+    }
+    osg::StateSet *ss = geom->getOrCreateStateSet();
+    if (transparent) {
+        ss->setMode(GL_BLEND, osg::StateAttribute::ON);
+        ss->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+    }
+    else {
+        ss->setMode(GL_BLEND, osg::StateAttribute::OFF);
+        ss->setRenderingHint(osg::StateSet::OPAQUE_BIN);
+    }
+}
+
+} // namespace Vis
@@ -0,0 +1,93 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Geometry>
+
+#include <stddef.h>
+
+namespace Vis
+{
+
+enum InstancedShape
+{
+    InstancedShape_Sphere = 0, // unit radius, centered at the origin
+    InstancedShape_Box,        // half lengths of 1, centered at the origin
+    InstancedShape_Cylinder,   // unit radius and height, centered, along z
+    InstancedShape_Cone, // unit radius and height along z, the origin is at
+                         // 1/4 height from the bottom like osg::Cone
+};
+
+// Generic vertex attribute slots used for the per-instance data.
+enum InstanceAttrib
+{
+    InstanceAttrib_Center = 6,
+    InstanceAttrib_Scale = 7,
+    InstanceAttrib_Color = 11,
+    // columns of the matrix and alpha factor of CreateInstancedCopies(...)
+    InstanceAttrib_Column0 = 12,
+    InstanceAttrib_Column1 = 13,
+    InstanceAttrib_Column2 = 14,
+    InstanceAttrib_Alpha = 15,
+};
+
+/**
+ * Build a geometry drawing count scaled and translated copies of a unit shape
+ * in a single instanced draw call.
+ *
+ * @param centers count * 3 floats, position of each instance
+ * @param scales count * 3 floats, per axis scale applied to the unit shape
+ * @param colors count * 4 floats, RGBA of each instance
+ */
+osg::ref_ptr<osg::Geometry> CreateInstancedShapes(InstancedShape shape,
+                                                  const float *centers,
+                                                  const float *scales,
+                                                  const float *colors,
+                                                  size_t count);
+
+/**
+ * Build a geometry drawing count copies of source, each one moved by its
+ * matrix and faded by its alpha factor, in a single instanced draw call.
+ *
+ * The result shares the arrays of source, only the primitive sets are
+ * copied, so beyond the per-instance data its size does not depend on count.
+ * It is lit by a head light from its colors, its textures are ignored.
+ * Sources drawing through a program of their own, such as instanced shapes
+ * and grid planes, can not be copied this way.
+ *
+ * @param matrices count matrices from the coordinates of source, rigid or
+ * uniformly scaled
+ * @param alphas count factors applied to the alpha of the colors
+ * @return nullptr if source is instanced or has a program
+ */
+osg::ref_ptr<osg::Geometry> CreateInstancedCopies(const osg::Geometry &source,
+                                                  const osg::Matrix *matrices,
+                                                  const float *alphas,
+                                                  size_t count);
+
+/**
+ * Return the per-instance RGBA array of a geometry made by
+ * CreateInstancedShapes, nullptr for any other drawable.
+ */
+osg::Vec4Array *GetInstanceColors(osg::Drawable *drawable);
+
+/**
+ * Intersect the segment from start to end, in the local coordinates of a
+ * geometry made by CreateInstancedShapes, with its instances. Spheres are
+ * tested exactly, the other shapes by their bounding box.
+ *
+ * @param index the first instance hit along the segment
+ * @param ratio where it is hit, in [0, 1] from start to end
+ * @param normal the surface normal there
+ * @return false if no instance is hit or geom is not instanced
+ */
+bool IntersectInstances(const osg::Geometry *geom, const osg::Vec3 &start,
+                        const osg::Vec3 &end, unsigned int &index,
+                        float &ratio, osg::Vec3 &normal);
+
+/**
+ * Mark the instance colors as modified and switch blending on or off
+ * depending on whether any of them is transparent.
+ */
+void DirtyInstanceColors(osg::Geometry *geom);
+
+} // namespace Vis
@@ -0,0 +1,38 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+namespace Vis
+{
+
+/**
+ * A file mapped read-only into memory, unmapped on destruction.
+ *
+ * Mapping fails for empty files, Data() is then null like for a file which
+ * can not be opened.
+ */
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+    bool IsOpen() const { return m_data != nullptr; }
+
+private:
+    const char *m_data{nullptr};
+    size_t m_size{0};
+#ifdef _WIN32
+    void *m_file{nullptr};
+    void *m_mapping{nullptr};
+#endif
+};
+
+} // namespace Vis
@@ -0,0 +1,205 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+
+namespace Vis
+{
+
+static const size_t sg_vertex_cache_size = 16;
+
+static inline uint64_t HashFloat(uint64_t h, float f)
+{
+    if (f == 0.f) f = 0.f; // -0 equals 0
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return (h ^ bits) * 0x100000001b3ull;
+}
+
+size_t WeldVertices(const std::vector<VertexAttribute> &attributes,
+                    size_t numverts, std::vector<unsigned int> &remap)
+{
+    const unsigned int empty = std::numeric_limits<unsigned int>::max();
+    size_t table_size = 16;
+    while (table_size < numverts * 2) table_size *= 2;
+    const size_t mask = table_size - 1;
+    // first vertex of each distinct set of attributes
+    std::vector<unsigned int> table(table_size, empty);
+
+    auto hash = [&attributes](size_t v) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (const auto &a : attributes) {
+            for (size_t i = 0; i < a.size; ++i) {
+                h = HashFloat(h, a.data[v * a.size + i]);
+            }
+        }
+        return h ^ (h >> 29);
+    };
+    auto equal = [&attributes](size_t u, size_t v) {
+        for (const auto &a : attributes) {
+            for (size_t i = 0; i < a.size; ++i) {
+                if (a.data[u * a.size + i] != a.data[v * a.size + i]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    remap.resize(numverts);
+    size_t count = 0;
+    for (size_t v = 0; v < numverts; ++v) {
+        size_t i = hash(v) & mask;
+        while (table[i] != empty && !equal(table[i], v)) {
+            i = (i + 1) & mask;
+        }
+        if (table[i] == empty) {
+            table[i] = static_cast<unsigned int>(v);
+            remap[v] = static_cast<unsigned int>(count++);
+        }
+        else {
+            remap[v] = remap[table[i]];
+        }
+    }
+    return count;
+}
+
+std::vector<float> RemapAttribute(const VertexAttribute &attribute,
+                                  const std::vector<unsigned int> &remap,
+                                  size_t count)
+{
+    std::vector<float> out(count * attribute.size);
+    for (size_t v = 0; v < remap.size(); ++v) {
+        std::copy(attribute.data + v * attribute.size,
+                  attribute.data + (v + 1) * attribute.size,
+                  out.begin() + remap[v] * attribute.size);
+    }
+    return out;
+}
+
+void OptimizeVertexCache(unsigned int *indices, size_t num_indices,
+                         size_t numverts)
+{
+    const size_t num_triangles = num_indices / 3;
+    if (num_triangles < 2) return;
+
+    // triangles using each vertex
+    std::vector<unsigned int> offsets(numverts + 1, 0);
+    for (size_t i = 0; i < num_triangles * 3; ++i) {
+        ++offsets[indices[i] + 1];
+    }
+    for (size_t v = 0; v < numverts; ++v) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<unsigned int> adjacency(num_triangles * 3);
+    {
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < num_triangles * 3; ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+    }
+
+    // number of triangles left to emit for each vertex
+    std::vector<unsigned int> live(numverts);
+    for (size_t v = 0; v < numverts; ++v) {
+        live[v] = offsets[v + 1] - offsets[v];
+    }
+    std::vector<size_t> cache_time(numverts, 0);
+    std::vector<char> emitted(num_triangles, 0);
+    std::vector<unsigned int> dead_end;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> output;
+    output.reserve(num_triangles * 3);
+
+    size_t time = sg_vertex_cache_size + 1;
+    size_t cursor = 0;
+    int64_t fanning = indices[0];
+    while (fanning >= 0) {
+        // emit the triangles around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1];
+             ++a) {
+            const unsigned int t = adjacency[a];
+            if (emitted[t]) continue;
+            for (int k = 0; k < 3; ++k) {
+                const unsigned int v = indices[3 * t + k];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - cache_time[v] > sg_vertex_cache_size) {
+                    cache_time[v] = time++;
+                }
+            }
+            emitted[t] = 1;
+        }
+
+        // continue with the candidate staying longest in the cache while
+        // its triangles are emitted
+        fanning = -1;
+        int64_t best = -1;
+        for (const unsigned int v : candidates) {
+            if (live[v] == 0) continue;
+            int64_t priority = 0;
+            if (time - cache_time[v] + 2 * live[v] <= sg_vertex_cache_size) {
+                priority = static_cast<int64_t>(time - cache_time[v]);
+            }
+            if (priority > best) {
+                best = priority;
+                fanning = v;
+            }
+        }
+        while (fanning < 0 && !dead_end.empty()) {
+            const unsigned int v = dead_end.back();
+            dead_end.pop_back();
+            if (live[v] > 0) fanning = v;
+        }
+        for (; fanning < 0 && cursor < numverts; ++cursor) {
+            if (live[cursor] > 0) fanning = static_cast<int64_t>(cursor);
+        }
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+template <typename DrawElements>
+static void AssignElements(osg::Geometry &geom, const unsigned int *indices,
+                           size_t num_indices)
+{
+    DrawElements *de = nullptr;
+    if (geom.getNumPrimitiveSets() > 0) {
+        de = dynamic_cast<DrawElements *>(geom.getPrimitiveSet(0));
+    }
+    if (de == nullptr) {
+        osg::ref_ptr<DrawElements> created = new DrawElements(GL_TRIANGLES);
+        de = created.get();
+        if (geom.getNumPrimitiveSets() > 0) {
+            geom.setPrimitiveSet(0, de);
+        }
+        else {
+            geom.addPrimitiveSet(de);
+        }
+    }
+    if (num_indices > de->capacity()) {
+        de->reserve(std::max(num_indices, (size_t)de->capacity() * 2));
+    }
+    de->resize(num_indices);
+    std::copy(indices, indices + num_indices, de->begin());
+    de->dirty();
+}
+
+void AssignTriangles(osg::Geometry &geom, const unsigned int *indices,
+                     size_t num_indices, size_t numverts)
+{
+    if (numverts <= size_t(std::numeric_limits<GLushort>::max()) + 1) {
+        AssignElements<osg::DrawElementsUShort>(geom, indices, num_indices);
+    }
+    else {
+        AssignElements<osg::DrawElementsUInt>(geom, indices, num_indices);
+    }
+}
+
+} // namespace Vis
@@ -0,0 +1,55 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Geometry>
+
+#include <stddef.h>
+#include <vector>
+
+namespace Vis
+{
+
+/// A per-vertex attribute of a mesh, size floats per vertex.
+struct VertexAttribute
+{
+    const float *data;
+    size_t size;
+};
+
+/**
+ * Find the vertices of a mesh whose attributes are all equal.
+ *
+ * @param remap set to the unique vertex of each vertex, unique vertices are
+ * numbered in the order of their first occurrence
+ * @return number of unique vertices
+ */
+size_t WeldVertices(const std::vector<VertexAttribute> &attributes,
+                    size_t numverts, std::vector<unsigned int> &remap);
+
+/**
+ * Gather an attribute of the unique vertices found by WeldVertices(...).
+ *
+ * @return count * attribute.size floats
+ */
+std::vector<float> RemapAttribute(const VertexAttribute &attribute,
+                                  const std::vector<unsigned int> &remap,
+                                  size_t count);
+
+/**
+ * Reorder triangles for the post-transform vertex cache of the GPU with
+ * Tipsify (Sander, Nehab and Barczak, 2007). The vertices keep their order.
+ *
+ * @param indices num_indices / 3 triangles, all below numverts
+ */
+void OptimizeVertexCache(unsigned int *indices, size_t num_indices,
+                         size_t numverts);
+
+/**
+ * Set the triangles of a geometry as its primitive set 0. The indices are
+ * stored in 16 bit when numverts allows it, halving their memory, and the
+ * current set is reused if it has the right type.
+ */
+void AssignTriangles(osg::Geometry &geom, const unsigned int *indices,
+                     size_t num_indices, size_t numverts);
+
+} // namespace Vis
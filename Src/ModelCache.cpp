@@ -0,0 +1,185 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "ModelCache.h"
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+namespace Vis
+{
+
+/// Sum the sizes of the arrays and index buffers of the geometries below a
+/// node, counting shared buffers once.
+class ModelSizeVisitor : public osg::NodeVisitor
+{
+public:
+    ModelSizeVisitor()
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+    {
+    }
+
+    virtual void apply(osg::Geode &geode)
+    {
+        for (unsigned int i = 0; i < geode.getNumDrawables(); ++i) {
+            const osg::Geometry *geom = geode.getDrawable(i)->asGeometry();
+            if (geom == nullptr) continue;
+            Add(geom->getVertexArray());
+            Add(geom->getNormalArray());
+            Add(geom->getColorArray());
+            Add(geom->getSecondaryColorArray());
+            for (unsigned int t = 0; t < geom->getNumTexCoordArrays(); ++t) {
+                Add(geom->getTexCoordArray(t));
+            }
+            for (unsigned int a = 0; a < geom->getNumVertexAttribArrays();
+                 ++a) {
+                Add(geom->getVertexAttribArray(a));
+            }
+            for (unsigned int p = 0; p < geom->getNumPrimitiveSets(); ++p) {
+                Add(geom->getPrimitiveSet(p));
+            }
+        }
+        traverse(geode);
+    }
+
+    size_t bytes{0};
+
+private:
+    void Add(const osg::BufferData *data)
+    {
+        if (data != nullptr && m_seen.insert(data).second) {
+            bytes += data->getTotalDataSize();
+        }
+    }
+
+    std::unordered_set<const osg::BufferData *> m_seen;
+};
+
+osg::ref_ptr<osg::Node> ModelCache::Get(const std::string &fname,
+                                        const ReadFunction &read)
+{
+    std::error_code ec;
+    const fs::path path = fs::canonical(fname, ec);
+    fs::file_time_type mtime;
+    uintmax_t size = 0;
+    if (!ec) mtime = fs::last_write_time(path, ec);
+    if (!ec) size = fs::file_size(path, ec);
+    if (ec) return read(fname);
+
+    const std::string key = path.string();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_capacity == 0) {
+        lock.unlock();
+        return read(fname);
+    }
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end() && it->second.mtime == mtime
+        && it->second.size == size) {
+        ++m_stats.hits;
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+        // may still be read by another thread
+        std::shared_future<osg::ref_ptr<osg::Node>> model = it->second.model;
+        lock.unlock();
+        return model.get();
+    }
+    if (it != m_entries.end()) {
+        Erase(it); // the file changed
+    }
+
+    ++m_stats.misses;
+    std::promise<osg::ref_ptr<osg::Node>> promise;
+    m_lru.push_front(key);
+    Entry &entry = m_entries[key];
+    entry.mtime = mtime;
+    entry.size = size;
+    entry.id = ++m_next_id;
+    entry.model = promise.get_future().share();
+    entry.lru = m_lru.begin();
+    const uint64_t id = entry.id;
+    lock.unlock();
+
+    osg::ref_ptr<osg::Node> model = read(fname);
+    size_t bytes = 0;
+    if (model) {
+        ModelSizeVisitor visitor;
+        model->accept(visitor);
+        bytes = visitor.bytes;
+    }
+    promise.set_value(model);
+
+    lock.lock();
+    it = m_entries.find(key);
+    // cleared or replaced meanwhile
+    if (it == m_entries.end() || it->second.id != id) return model;
+    if (!model) {
+        Erase(it); // the next call tries again
+        return model;
+    }
+    it->second.ready = true;
+    it->second.bytes = bytes;
+    m_stats.bytes += bytes;
+    Evict();
+    return model;
+}
+
+void ModelCache::SetCapacity(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = bytes;
+    if (m_capacity == 0) {
+        m_entries.clear();
+        m_lru.clear();
+        m_stats.bytes = 0;
+    }
+    else {
+        Evict();
+    }
+}
+
+void ModelCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_lru.clear();
+    m_stats.bytes = 0;
+}
+
+ModelCacheStats ModelCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ModelCacheStats stats = m_stats;
+    stats.entries = m_entries.size();
+    stats.capacity = m_capacity;
+    return stats;
+}
+
+void ModelCache::Erase(std::unordered_map<std::string, Entry>::iterator it)
+{
+    if (it->second.ready) {
+        m_stats.bytes -= it->second.bytes;
+    }
+    m_lru.erase(it->second.lru);
+    m_entries.erase(it);
+}
+
+void ModelCache::Evict()
+{
+    // entries still being read have no size yet and are skipped
+    auto lru = m_lru.end();
+    while (m_stats.bytes > m_capacity && lru != m_lru.begin()) {
+        --lru;
+        auto it = m_entries.find(*lru);
+        if (!it->second.ready) continue;
+        // erasing invalidates lru, step back from its successor instead
+        lru = std::next(lru);
+        Erase(it);
+        ++m_stats.evictions;
+    }
+}
+
+} // namespace Vis
@@ -0,0 +1,89 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Node>
+#include <osg/ref_ptr>
+
+#include <stdint.h>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Vis
+{
+
+struct ModelCacheStats
+{
+    size_t hits{0};
+    size_t misses{0};    // reads, including the ones of changed files
+    size_t evictions{0}; // entries dropped to stay below the capacity
+    size_t entries{0};
+    size_t bytes{0}; // estimated size of the cached geometry
+    size_t capacity{0};
+};
+
+/**
+ * Cache of model files, so that loading the same file again shares the
+ * already built subgraph, k-d trees included, instead of reading it again.
+ *
+ * Entries are keyed by the canonical path and validated by the modification
+ * time and size of the file. The least recently used entries are evicted
+ * while the estimated size of the cached vertex, attribute and index arrays
+ * exceeds the capacity. Evicting only drops the cache's reference, models in
+ * use stay alive. All methods are thread safe, concurrent requests for the
+ * same file read it once.
+ */
+class ModelCache
+{
+public:
+    using ReadFunction =
+        std::function<osg::ref_ptr<osg::Node>(const std::string &)>;
+
+    explicit ModelCache(size_t capacity = size_t(512) << 20)
+        : m_capacity(capacity)
+    {
+    }
+
+    /**
+     * Return the model of fname, reading it with read on a miss. Files which
+     * can not be stat'ed are read without caching.
+     * @return the shared model, which must not be modified, or null if read
+     * failed
+     */
+    osg::ref_ptr<osg::Node> Get(const std::string &fname,
+                                const ReadFunction &read);
+
+    /// Capacity in bytes, 0 disables caching.
+    void SetCapacity(size_t bytes);
+    void Clear();
+    ModelCacheStats GetStats() const;
+
+private:
+    struct Entry
+    {
+        std::filesystem::file_time_type mtime;
+        uintmax_t size{0};
+        uint64_t id{0}; // tells a replaced entry from its successor
+        std::shared_future<osg::ref_ptr<osg::Node>> model;
+        bool ready{false};
+        size_t bytes{0};
+        std::list<std::string>::iterator lru;
+    };
+
+    // requires m_mutex
+    void Erase(std::unordered_map<std::string, Entry>::iterator it);
+    void Evict();
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lru; // most recently used first
+    uint64_t m_next_id{0};
+    size_t m_capacity;
+    ModelCacheStats m_stats;
+};
+
+} // namespace Vis
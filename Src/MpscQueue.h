@@ -0,0 +1,67 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+namespace Vis
+{
+
+/**
+ * Unbounded lock-free queue for many producers and a single consumer
+ * (D. Vyukov's intrusive MPSC queue).
+ *
+ * Push is wait-free and may be called from any thread. Pop must only be
+ * called from one thread at a time. A value pushed while Pop runs may not be
+ * seen until the next Pop.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue() : m_head(new Node), m_tail(m_head.load()) {}
+
+    ~MpscQueue()
+    {
+        T value;
+        while (Pop(value)) {
+        }
+        delete m_tail;
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    void Push(T value)
+    {
+        Node *node = new Node;
+        node->value = std::move(value);
+        Node *prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool Pop(T &value)
+    {
+        // m_tail is a stub whose value was already taken
+        Node *tail = m_tail;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) return false;
+        value = std::move(next->value);
+        next->value = T();
+        m_tail = next;
+        delete tail;
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node *> next{nullptr};
+        T value;
+    };
+
+    std::atomic<Node *> m_head; // last pushed node, shared by producers
+    Node *m_tail;               // consumer side
+};
+
+} // namespace Vis
@@ -0,0 +1,183 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "Normals.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+namespace Vis
+{
+
+static const size_t sg_min_triangles = 1 << 16; // per parallel chunk
+
+/// Angle between two edges leaving a corner.
+static inline float CornerAngle(osg::Vec3 e1, osg::Vec3 e2)
+{
+    if (e1.normalize() == 0.f || e2.normalize() == 0.f) return 0.f;
+    return std::acos(std::max(-1.f, std::min(1.f, e1 * e2)));
+}
+
+template <typename Index>
+static void ComputeVertexNormalsT(const osg::Vec3 *vertices, size_t numverts,
+                                  const Index *indices, size_t num_indices,
+                                  NormalWeighting weighting,
+                                  osg::Vec3 *normals)
+{
+    const size_t num_triangles = num_indices / 3;
+    const size_t num_chunks = ParallelChunks(num_triangles, sg_min_triangles);
+    const bool by_area = weighting == NormalWeighting_Area;
+
+    // the contribution of each triangle, or of each corner when weighted by
+    // angle
+    std::vector<osg::Vec3> weighted(by_area ? num_triangles
+                                            : num_triangles * 3);
+    ParallelFor(num_triangles, num_chunks,
+                [&](size_t begin, size_t end, size_t) {
+                    for (size_t t = begin; t < end; ++t) {
+                        const osg::Vec3 &a = vertices[indices[3 * t]];
+                        const osg::Vec3 &b = vertices[indices[3 * t + 1]];
+                        const osg::Vec3 &c = vertices[indices[3 * t + 2]];
+                        // its length is twice the area
+                        osg::Vec3 n = (b - a) ^ (c - a);
+                        if (by_area) {
+                            weighted[t] = n;
+                            continue;
+                        }
+                        n.normalize();
+                        weighted[3 * t] = n * CornerAngle(b - a, c - a);
+                        weighted[3 * t + 1] = n * CornerAngle(c - b, a - b);
+                        weighted[3 * t + 2] = n * CornerAngle(a - c, b - c);
+                    }
+                });
+
+    const size_t num_corners = num_triangles * 3;
+    if (num_chunks == 1) {
+        std::fill(normals, normals + numverts, osg::Vec3(0.f, 0.f, 0.f));
+        for (size_t i = 0; i < num_corners; ++i) {
+            normals[indices[i]] += weighted[by_area ? i / 3 : i];
+        }
+        for (size_t v = 0; v < numverts; ++v) {
+            normals[v].normalize();
+        }
+        return;
+    }
+
+    // Bucket the corners by the chunk of vertices they use, a counting sort
+    // over the chunks, so that each chunk of vertices only reads its own
+    // corners. Chunks are a power of two vertices wide.
+    int shift = 0;
+    while ((size_t(1) << shift) * num_chunks < numverts) {
+        ++shift;
+    }
+    const size_t num_vertex_chunks = ((numverts - 1) >> shift) + 1;
+    // per chunk of corners, where its corners of each chunk of vertices go
+    std::vector<size_t> next(num_chunks * num_vertex_chunks, 0);
+    ParallelFor(num_corners, num_chunks,
+                [&](size_t begin, size_t end, size_t c) {
+                    size_t *count = &next[c * num_vertex_chunks];
+                    for (size_t i = begin; i < end; ++i) {
+                        ++count[indices[i] >> shift];
+                    }
+                });
+    std::vector<size_t> starts(num_vertex_chunks + 1, 0);
+    size_t total = 0;
+    for (size_t v = 0; v < num_vertex_chunks; ++v) {
+        starts[v] = total;
+        for (size_t c = 0; c < num_chunks; ++c) {
+            const size_t count = next[c * num_vertex_chunks + v];
+            next[c * num_vertex_chunks + v] = total;
+            total += count;
+        }
+    }
+    starts[num_vertex_chunks] = total;
+    std::vector<uint32_t> corners(num_corners);
+    ParallelFor(num_corners, num_chunks,
+                [&](size_t begin, size_t end, size_t c) {
+                    size_t *to = &next[c * num_vertex_chunks];
+                    for (size_t i = begin; i < end; ++i) {
+                        corners[to[indices[i] >> shift]++] =
+                            static_cast<uint32_t>(i);
+                    }
+                });
+
+    ParallelFor(num_vertex_chunks, num_vertex_chunks,
+                [&](size_t begin, size_t end, size_t) {
+                    for (size_t v = begin; v < end; ++v) {
+                        const size_t first = v << shift;
+                        const size_t last =
+                            std::min(numverts, first + (size_t(1) << shift));
+                        std::fill(normals + first, normals + last,
+                                  osg::Vec3(0.f, 0.f, 0.f));
+                        for (size_t k = starts[v]; k < starts[v + 1]; ++k) {
+                            const size_t i = corners[k];
+                            normals[indices[i]] +=
+                                weighted[by_area ? i / 3 : i];
+                        }
+                        for (size_t n = first; n < last; ++n) {
+                            normals[n].normalize();
+                        }
+                    }
+                });
+}
+
+void ComputeVertexNormals(const osg::Vec3 *vertices, size_t numverts,
+                          const unsigned int *indices, size_t num_indices,
+                          NormalWeighting weighting, osg::Vec3 *normals)
+{
+    ComputeVertexNormalsT(vertices, numverts, indices, num_indices, weighting,
+                          normals);
+}
+
+void ComputeVertexNormals(const osg::Vec3 *vertices, size_t numverts,
+                          const unsigned short *indices, size_t num_indices,
+                          NormalWeighting weighting, osg::Vec3 *normals)
+{
+    ComputeVertexNormalsT(vertices, numverts, indices, num_indices, weighting,
+                          normals);
+}
+
+bool ComputeNormals(osg::Geometry &geom, NormalWeighting weighting)
+{
+    const osg::Vec3Array *vertices =
+        dynamic_cast<const osg::Vec3Array *>(geom.getVertexArray());
+    if (vertices == nullptr || vertices->empty()
+        || geom.getNumPrimitiveSets() == 0
+        || geom.getPrimitiveSet(0)->getMode() != GL_TRIANGLES) {
+        return false;
+    }
+    const size_t numverts = vertices->size();
+
+    osg::ref_ptr<osg::Vec3Array> normals =
+        dynamic_cast<osg::Vec3Array *>(geom.getNormalArray());
+    if (!normals || normals->getBinding() != osg::Array::BIND_PER_VERTEX) {
+        normals = new osg::Vec3Array(osg::Array::BIND_PER_VERTEX);
+    }
+    normals->resize(numverts);
+
+    osg::PrimitiveSet *ps = geom.getPrimitiveSet(0);
+    if (auto *us = dynamic_cast<osg::DrawElementsUShort *>(ps)) {
+        if (us->empty()) return false;
+        ComputeVertexNormals(&vertices->front(), numverts, &us->front(),
+                             us->size(), weighting, &normals->front());
+    }
+    else if (auto *ui = dynamic_cast<osg::DrawElementsUInt *>(ps)) {
+        if (ui->empty()) return false;
+        ComputeVertexNormals(&vertices->front(), numverts, &ui->front(),
+                             ui->size(), weighting, &normals->front());
+    }
+    else {
+        return false;
+    }
+
+    if (normals.get() != geom.getNormalArray()) {
+        geom.setNormalArray(normals.get(), osg::Array::BIND_PER_VERTEX);
+    }
+    normals->dirty();
+    return true;
+}
+
+} // namespace Vis
@@ -0,0 +1,48 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Geometry>
+
+#include <stddef.h>
+
+namespace Vis
+{
+
+enum NormalWeighting
+{
+    NormalWeighting_Area = 0, // by the area of the triangles
+    NormalWeighting_Angle,    // by the angle of the triangles at the vertex
+};
+
+/**
+ * Compute the normal of each vertex of a triangle mesh as the weighted
+ * average of the normals of the triangles using it. Vertices used by no
+ * triangle get a null normal.
+ *
+ * The triangles are processed in parallel chunks. Their corners are then
+ * bucketed by the chunk of vertices they use and every chunk of vertices
+ * sums its own bucket, so no two threads write the same normal, no atomics
+ * are needed and each corner is read once in total.
+ *
+ * @param indices num_indices / 3 triangles, all below numverts, at most
+ * 2^32 - 1 indices
+ * @param normals numverts normals, overwritten
+ */
+void ComputeVertexNormals(const osg::Vec3 *vertices, size_t numverts,
+                          const unsigned int *indices, size_t num_indices,
+                          NormalWeighting weighting, osg::Vec3 *normals);
+void ComputeVertexNormals(const osg::Vec3 *vertices, size_t numverts,
+                          const unsigned short *indices, size_t num_indices,
+                          NormalWeighting weighting, osg::Vec3 *normals);
+
+/**
+ * Set the per-vertex normals of a geometry whose primitive set 0 holds
+ * triangles as DrawElementsUShort or DrawElementsUInt, reusing its normal
+ * array when it can.
+ *
+ * @return false if the geometry has no such triangles
+ */
+bool ComputeNormals(osg::Geometry &geom,
+                    NormalWeighting weighting = NormalWeighting_Area);
+
+} // namespace Vis
@@ -49,6 +49,11 @@ bool MouseMapper::eventFilter(QObject *obj, QEvent *event)
     case QEvent::MouseButtonRelease:
     case QEvent::MouseMove: {
         const QMouseEvent *e = static_cast<QMouseEvent *>(event);
+        // nothing to process or draw for plain moves, unless hovering
+        if (event->type() == QEvent::MouseMove
+            && e->buttons() == Qt::NoButton && !o->NeedsHoverEvents()) {
+            return true;
+        }
 
         switch (event->type()) {
         case QEvent::MouseButtonPress:
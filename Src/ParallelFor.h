@@ -0,0 +1,81 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace Vis
+{
+
+/**
+ * Number of chunks to split count items into so that each chunk has at
+ * least min_chunk items, at most one chunk per hardware thread.
+ */
+inline size_t ParallelChunks(size_t count, size_t min_chunk)
+{
+    const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(threads, count / min_chunk));
+}
+
+/// The threads running the chunks of ParallelFor, shared by all its callers.
+inline ThreadPool &ParallelPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+/**
+ * Call f(begin, end, chunk) for num_chunks contiguous chunks of [0, count)
+ * in parallel and wait for all of them.
+ *
+ * The chunks are taken in turn by the calling thread and the threads of
+ * ParallelPool(), so however many threads call it at once, e.g. model reads
+ * on the view's workers, no more threads than the pool has are added. The
+ * calling thread never waits for a chunk no thread started: it runs the
+ * chunks left over itself, so nested calls and a busy pool can not deadlock.
+ */
+template <typename F>
+void ParallelFor(size_t count, size_t num_chunks, F &&f)
+{
+    num_chunks = std::max<size_t>(1, std::min(num_chunks, count));
+    if (num_chunks == 1) {
+        f(size_t(0), count, size_t(0));
+        return;
+    }
+
+    // shared with the pool tasks, which may start after this call returned
+    // and then only find that no chunk is left
+    struct State
+    {
+        std::atomic<size_t> next{0};
+        size_t done{0};
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    const std::shared_ptr<State> state = std::make_shared<State>();
+    auto run_chunks = [&f, count, num_chunks](State &s) {
+        size_t c;
+        while ((c = s.next++) < num_chunks) {
+            f(count * c / num_chunks, count * (c + 1) / num_chunks, c);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (++s.done == num_chunks) s.cv.notify_one();
+        }
+    };
+
+    ThreadPool &pool = ParallelPool();
+    const size_t num_tasks = std::min(num_chunks - 1, pool.Size());
+    for (size_t t = 0; t < num_tasks; ++t) {
+        pool.Submit([state, run_chunks]() { run_chunks(*state); });
+    }
+    run_chunks(*state);
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&] { return state->done == num_chunks; });
+}
+
+} // namespace Vis
@@ -0,0 +1,520 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "PickHandler.h"
+
+#include "Instancing.h"
+
+#include <osg/Geode>
+#include <osg/KdTree>
+#include <osg/Transform>
+#include <osgUtil/LineSegmentIntersector>
+#include <osgUtil/PolytopeIntersector>
+#include <osgViewer/View>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace Vis
+{
+
+// pick tolerance around the mouse, in pixels
+static const float sg_pick_tolerance = 5.f;
+
+/**
+ * Bounding volume hierarchy over the vertices of a point cloud, used to find
+ * the point closest to the pick ray without testing every point.
+ *
+ * Cached in the user data of the geometry. It keeps a reference to the vertex
+ * array it was built from and is rebuilt when the array is replaced or
+ * dirtied, e.g. by View::UpdatePoints.
+ */
+class PointBvh : public osg::Referenced
+{
+public:
+    explicit PointBvh(const osg::Array *vertices)
+        : m_vertices(vertices), m_modified(vertices->getModifiedCount())
+    {
+        const unsigned int num = vertices->getNumElements();
+        m_indices.resize(num);
+        for (unsigned int i = 0; i < num; ++i) {
+            m_indices[i] = i;
+        }
+        m_nodes.reserve(2 * (num / sg_leaf_size + 1));
+        if (num > 0) Build(Points(), 0, num);
+    }
+
+    bool IsValid(const osg::Array *vertices) const
+    {
+        return vertices == m_vertices.get()
+               && vertices->getModifiedCount() == m_modified;
+    }
+
+    /**
+     * Find the point closest to the segment from s to e within the radius
+     * rs at s, growing linearly to re at e. The score of a point is its
+     * distance to the segment relative to that radius.
+     * @param ratio position of the point along the segment, in [0, 1]
+     */
+    bool Query(const osg::Vec3f &s, const osg::Vec3f &e, float rs, float re,
+               unsigned int &index, float &ratio) const
+    {
+        const osg::Vec3f d = e - s;
+        const float len2 = d.length2();
+        if (m_nodes.empty() || len2 <= 0.f) return false;
+        const float inv_len = 1.f / std::sqrt(len2);
+        const osg::Vec3f *points = Points();
+        auto radius_at = [rs, re](float t) { return rs + (re - rs) * t; };
+        auto clamp01 = [](float t) {
+            return t < 0.f ? 0.f : (t > 1.f ? 1.f : t);
+        };
+
+        bool found = false;
+        float best_score = 1.f;
+        float best_ratio = 1.f;
+        uint32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = m_nodes[stack[--top]];
+            const float tc = clamp01((node.center - s) * d / len2);
+            const float dist = (node.center - (s + d * tc)).length();
+            // largest radius any point of the node can be tested against
+            const float dt = node.radius * inv_len;
+            const float rmax = std::max(radius_at(clamp01(tc - dt)),
+                                        radius_at(clamp01(tc + dt)));
+            if (dist - node.radius > rmax * best_score) continue;
+
+            if (!node.leaf) {
+                if (top + 2 > 64) continue;
+                stack[top++] = node.a;
+                stack[top++] = node.b;
+                continue;
+            }
+            for (uint32_t i = node.a; i < node.a + node.b; ++i) {
+                const osg::Vec3f &p = points[m_indices[i]];
+                const float t = clamp01((p - s) * d / len2);
+                const float r = radius_at(t);
+                if (r <= 0.f) continue;
+                const float score = (p - (s + d * t)).length() / r;
+                if (score < best_score
+                    || (found && score == best_score && t < best_ratio)) {
+                    found = true;
+                    best_score = score;
+                    best_ratio = t;
+                    index = m_indices[i];
+                }
+            }
+        }
+        ratio = best_ratio;
+        return found;
+    }
+
+private:
+    static const uint32_t sg_leaf_size = 64;
+
+    struct Node
+    {
+        osg::Vec3f center;
+        float radius;
+        bool leaf;
+        uint32_t a; // leaf: first index, else left child
+        uint32_t b; // leaf: number of indices, else right child
+    };
+
+    const osg::Vec3f *Points() const
+    {
+        return static_cast<const osg::Vec3f *>(m_vertices->getDataPointer());
+    }
+
+    uint32_t Build(const osg::Vec3f *points, uint32_t first, uint32_t count)
+    {
+        osg::BoundingBoxf bb;
+        for (uint32_t i = first; i < first + count; ++i) {
+            bb.expandBy(points[m_indices[i]]);
+        }
+        const uint32_t id = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.push_back({bb.center(), bb.radius(), true, first, count});
+        if (count <= sg_leaf_size) return id;
+
+        // median split along the longest axis
+        const osg::Vec3f extent = bb._max - bb._min;
+        int axis = extent.x() > extent.y() ? 0 : 1;
+        if (extent.z() > extent[axis]) axis = 2;
+        const uint32_t half = count / 2;
+        std::nth_element(m_indices.begin() + first,
+                         m_indices.begin() + first + half,
+                         m_indices.begin() + first + count,
+                         [points, axis](uint32_t l, uint32_t r) {
+                             return points[l][axis] < points[r][axis];
+                         });
+        const uint32_t left = Build(points, first, half);
+        const uint32_t right = Build(points, first + half, count - half);
+        m_nodes[id].leaf = false;
+        m_nodes[id].a = left;
+        m_nodes[id].b = right;
+        return id;
+    }
+
+    osg::ref_ptr<const osg::Array> m_vertices;
+    unsigned int m_modified;
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_indices;
+};
+
+static const PointBvh *GetPointBvh(osg::Geometry *geom)
+{
+    const osg::Array *vertices = geom->getVertexArray();
+    if (vertices == nullptr || vertices->getDataSize() != 3
+        || vertices->getDataType() != GL_FLOAT) {
+        return nullptr;
+    }
+    PointBvh *bvh = dynamic_cast<PointBvh *>(geom->getUserData());
+    if (bvh == nullptr || !bvh->IsValid(vertices)) {
+        bvh = new PointBvh(vertices);
+        geom->setUserData(bvh);
+    }
+    return bvh;
+}
+
+static bool HasTriangles(const osg::Geometry &geom)
+{
+    for (unsigned int i = 0; i < geom.getNumPrimitiveSets(); ++i) {
+        if (geom.getPrimitiveSet(i)->getMode() >= GL_TRIANGLES) return true;
+    }
+    return false;
+}
+
+/**
+ * osg::KdTree::build(...) only takes an osg::Vec3Array, while meshes read
+ * from a scene file have their vertices in an ExternalVec3Array. Those are
+ * given to it as a shallow copy of the geometry with a copy of the vertices,
+ * which the k-d tree keeps.
+ */
+static osg::ref_ptr<osg::Geometry> KdTreeSource(osg::Geometry *geom)
+{
+    const osg::Array *vertices = geom->getVertexArray();
+    if (vertices == nullptr
+        || dynamic_cast<const osg::Vec3Array *>(vertices) != nullptr
+        || vertices->getType() != osg::Array::Vec3ArrayType
+        || vertices->getDataType() != GL_FLOAT) {
+        return geom;
+    }
+    osg::ref_ptr<osg::Geometry> copy = new osg::Geometry(*geom);
+    copy->setVertexArray(new osg::Vec3Array(
+        vertices->getNumElements(),
+        static_cast<const osg::Vec3 *>(vertices->getDataPointer())));
+    return copy;
+}
+
+static const Handle *FindHandle(const osg::NodePath &path)
+{
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        const HandleTag *tag =
+            dynamic_cast<const HandleTag *>((*it)->getUserData());
+        if (tag) return &tag->handle;
+    }
+    return nullptr;
+}
+
+/**
+ * Collect the geometries PickHandler tests itself, with their handle and the
+ * transforms above them, and build the k-d trees used by the intersectors for
+ * the others. Hidden objects are skipped.
+ */
+class PickVisitor : public osg::NodeVisitor
+{
+public:
+    PickVisitor() : osg::NodeVisitor(TRAVERSE_ACTIVE_CHILDREN) {}
+
+    virtual void apply(osg::Geode &geode)
+    {
+        bool intersect = true;
+        for (const osg::Node *node : getNodePath()) {
+            intersect = intersect && (node->getNodeMask() & NodeMask_Intersect);
+        }
+        if (intersect) {
+            for (unsigned int i = 0; i < geode.getNumDrawables(); ++i) {
+                osg::Geometry *geom = geode.getDrawable(i)->asGeometry();
+                // ShapeDrawables keep their shape
+                if (geom && geom->getShape() == nullptr
+                    && HasTriangles(*geom)) {
+                    osg::ref_ptr<osg::KdTree> kdtree = new osg::KdTree;
+                    if (kdtree->build(m_options, KdTreeSource(geom).get())) {
+                        geom->setShape(kdtree.get());
+                    }
+                }
+            }
+            return;
+        }
+
+        const Handle *h = FindHandle(getNodePath());
+        if (h == nullptr) return;
+        std::vector<osg::observer_ptr<osg::Node>> transforms;
+        for (osg::Node *node : getNodePath()) {
+            if (node->asTransform()) transforms.push_back(node);
+        }
+        for (unsigned int i = 0; i < geode.getNumDrawables(); ++i) {
+            osg::Geometry *geom = geode.getDrawable(i)->asGeometry();
+            if (geom) items.push_back({*h, geom, transforms});
+        }
+    }
+
+    std::vector<PickHandler::Pickable> items;
+
+private:
+    osg::KdTree::BuildOptions m_options;
+};
+
+void PickHandler::UpdatePickables()
+{
+    const uint64_t revision = m_vis3d->scene_revision;
+    if (revision == m_pickables_revision) return;
+
+    PickVisitor pv;
+    m_vis3d->node_switch->accept(pv);
+    m_pickables.swap(pv.items);
+    m_pickables_revision = revision;
+}
+
+struct PickResult
+{
+    Handle handle;
+    osg::Vec3d point;
+    osg::Vec3d normal;
+    double depth{std::numeric_limits<double>::max()};
+};
+
+template <typename Intersections>
+static bool FirstTagged(const Intersections &intersections,
+                        uint64_t only_type, const osg::NodePath *&path,
+                        typename Intersections::const_iterator &hit)
+{
+    for (hit = intersections.begin(); hit != intersections.end(); ++hit) {
+        const Handle *h = FindHandle(hit->nodePath);
+        if (h && (only_type == ViewObjectType_None || h->type == only_type)) {
+            path = &hit->nodePath;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PickHandler::Pick(osgViewer::View *view, float x, float y)
+{
+    const IntersectorMode mode = m_vis3d->insector_mode;
+    float lx = 0.f, ly = 0.f;
+    osg::Camera *camera = const_cast<osg::Camera *>(
+        view->getCameraContainingPosition(x, y, lx, ly));
+    if (camera == nullptr || camera->getViewport() == nullptr) return false;
+
+    // the pick ray and its tolerance, from the near to the far plane
+    const osg::Matrixd vpw = camera->getViewMatrix()
+                             * camera->getProjectionMatrix()
+                             * camera->getViewport()->computeWindowMatrix();
+    const osg::Matrixd inv = osg::Matrixd::inverse(vpw);
+    const osg::Vec3d start = osg::Vec3d(lx, ly, 0.) * inv;
+    const osg::Vec3d end = osg::Vec3d(lx, ly, 1.) * inv;
+    const osg::Vec3d start_side =
+        osg::Vec3d(lx + sg_pick_tolerance, ly, 0.) * inv - start;
+    const osg::Vec3d end_side =
+        osg::Vec3d(lx + sg_pick_tolerance, ly, 1.) * inv - end;
+    osg::Vec3d dir = end - start;
+    const double length = dir.normalize();
+    if (length <= 0.) return false;
+
+    UpdatePickables();
+
+    PickResult best;
+    auto consider = [&](const Handle &h, const osg::Vec3d &p,
+                        const osg::Vec3d &n) {
+        const double depth = (p - start) * dir;
+        if (depth < best.depth) {
+            best.handle = h;
+            best.point = p;
+            best.normal = n;
+            best.depth = depth;
+        }
+    };
+
+    if (mode == IntersectorMode_LineSegment) {
+        osg::ref_ptr<osgUtil::LineSegmentIntersector> intersector =
+            new osgUtil::LineSegmentIntersector(osgUtil::Intersector::WINDOW,
+                                                lx, ly);
+        osgUtil::IntersectionVisitor iv(intersector.get());
+        iv.setTraversalMask(NodeMask_Intersect);
+        camera->accept(iv);
+        const osg::NodePath *path = nullptr;
+        osgUtil::LineSegmentIntersector::Intersections::const_iterator hit;
+        if (FirstTagged(intersector->getIntersections(), ViewObjectType_None,
+                        path, hit)) {
+            consider(*FindHandle(*path), hit->getWorldIntersectPoint(),
+                     hit->getWorldIntersectNormal());
+        }
+    }
+    else if (mode == IntersectorMode_Polytope
+             || mode == IntersectorMode_Line) {
+        osg::ref_ptr<osgUtil::PolytopeIntersector> intersector =
+            new osgUtil::PolytopeIntersector(
+                osgUtil::Intersector::WINDOW, lx - sg_pick_tolerance,
+                ly - sg_pick_tolerance, lx + sg_pick_tolerance,
+                ly + sg_pick_tolerance);
+        if (mode == IntersectorMode_Line) {
+            intersector->setDimensionMask(
+                osgUtil::PolytopeIntersector::DimOne);
+        }
+        osgUtil::IntersectionVisitor iv(intersector.get());
+        iv.setTraversalMask(NodeMask_Intersect);
+        camera->accept(iv);
+        const osg::NodePath *path = nullptr;
+        osgUtil::PolytopeIntersector::Intersections::const_iterator hit;
+        if (FirstTagged(intersector->getIntersections(),
+                        mode == IntersectorMode_Line ? ViewObjectType_Line
+                                                     : ViewObjectType_None,
+                        path, hit)) {
+            osg::Vec3d p = hit->localIntersectionPoint;
+            if (hit->matrix.valid()) p = p * (*hit->matrix);
+            consider(*FindHandle(*path), p, osg::Vec3d());
+        }
+    }
+
+    osg::NodePath transforms;
+    std::vector<osg::ref_ptr<osg::Node>> locked;
+    for (const auto &item : m_pickables) {
+        // objects deleted since the collection are gone
+        osg::ref_ptr<osg::Geometry> geom;
+        if (!item.geom.lock(geom)) continue;
+        transforms.clear();
+        locked.resize(item.transforms.size());
+        for (size_t i = 0; i < item.transforms.size(); ++i) {
+            if (!item.transforms[i].lock(locked[i])) break;
+            transforms.push_back(locked[i].get());
+        }
+        if (transforms.size() != item.transforms.size()) continue;
+        const osg::Matrixd matrix = osg::computeLocalToWorld(transforms);
+        const osg::Matrixd local = osg::Matrixd::inverse(matrix);
+        const osg::Vec3f s = start * local;
+        const osg::Vec3f e = end * local;
+
+        if ((item.handle.type == ViewObjectType_Point
+             || item.handle.type == ViewObjectType_PointCloudLOD)
+            && (mode == IntersectorMode_Point
+                || mode == IntersectorMode_Polytope)) {
+            const PointBvh *bvh = GetPointBvh(geom.get());
+            const float rs =
+                osg::Matrixd::transform3x3(start_side, local).length();
+            const float re =
+                osg::Matrixd::transform3x3(end_side, local).length();
+            unsigned int index = 0;
+            float ratio = 0.f;
+            if (bvh == nullptr || !bvh->Query(s, e, rs, re, index, ratio)) {
+                continue;
+            }
+            const osg::Vec3f *points = static_cast<const osg::Vec3f *>(
+                geom->getVertexArray()->getDataPointer());
+            osg::Vec3d n;
+            const osg::Array *normals = geom->getNormalArray();
+            if (normals && normals->getBinding() == osg::Array::BIND_PER_VERTEX
+                && normals->getDataSize() == 3
+                && normals->getDataType() == GL_FLOAT
+                && index < normals->getNumElements()) {
+                // normals go by the inverse transpose
+                n = osg::Matrixd::transform3x3(
+                    local, static_cast<const osg::Vec3f *>(
+                               normals->getDataPointer())[index]);
+                n.normalize();
+            }
+            consider(item.handle, osg::Vec3d(points[index]) * matrix, n);
+        }
+        else if (mode == IntersectorMode_LineSegment
+                 || mode == IntersectorMode_Polytope) {
+            unsigned int index = 0;
+            float ratio = 0.f;
+            osg::Vec3 n;
+            if (IntersectInstances(geom.get(), s, e, index, ratio, n)) {
+                osg::Vec3d wn = osg::Matrixd::transform3x3(local, n);
+                wn.normalize();
+                consider(item.handle,
+                         osg::Vec3d(s + (e - s) * ratio) * matrix, wn);
+            }
+        }
+    }
+
+    if (best.depth == std::numeric_limits<double>::max()) {
+        m_vis3d->picked.Reset();
+        return false;
+    }
+    m_vis3d->picked = best.handle;
+    for (int i = 0; i < 3; ++i) {
+        m_vis3d->pointnorm[i] = best.point[i];
+        m_vis3d->pointnorm[i + 3] = best.normal[i];
+    }
+    return true;
+}
+
+void PickHandler::Hover(osgViewer::View *view, float x, float y)
+{
+    // the same answer as last time unless something changed
+    const osg::Camera *camera = view->getCamera();
+    const osg::Matrixd camera_matrix =
+        camera->getViewMatrix() * camera->getProjectionMatrix();
+    const uint64_t revision = m_vis3d->scene_revision;
+    const uint64_t moves = m_vis3d->move_revision;
+    if (m_hovered && x == m_hover_x && y == m_hover_y
+        && camera_matrix == m_hover_camera && revision == m_hover_revision
+        && moves == m_hover_moves && m_vis3d->insector_mode == m_hover_mode) {
+        return;
+    }
+    Pick(view, x, y);
+    m_hovered = true;
+    m_hover_x = x;
+    m_hover_y = y;
+    m_hover_camera = camera_matrix;
+    m_hover_revision = revision;
+    m_hover_moves = moves;
+    m_hover_mode = m_vis3d->insector_mode;
+}
+
+bool PickHandler::handle(const osgGA::GUIEventAdapter &ea,
+                         osgGA::GUIActionAdapter &aa)
+{
+    if (m_vis3d->insector_mode == IntersectorMode_Disable
+        || m_vis3d->gizmo.capture) {
+        return false;
+    }
+    osgViewer::View *view = dynamic_cast<osgViewer::View *>(&aa);
+    if (view == nullptr) return false;
+
+    // never consume the events, the manipulators still need them
+    switch (ea.getEventType()) {
+    case osgGA::GUIEventAdapter::PUSH:
+        m_push_x = ea.getX();
+        m_push_y = ea.getY();
+        break;
+    case osgGA::GUIEventAdapter::RELEASE:
+        if (!m_vis3d->insector_hover
+            && ea.getButton() == osgGA::GUIEventAdapter::LEFT_MOUSE_BUTTON
+            && std::abs(ea.getX() - m_push_x) <= sg_pick_tolerance
+            && std::abs(ea.getY() - m_push_y) <= sg_pick_tolerance) {
+            Pick(view, ea.getX(), ea.getY());
+        }
+        break;
+    case osgGA::GUIEventAdapter::MOVE:
+        if (m_vis3d->insector_hover) {
+            Hover(view, ea.getX(), ea.getY());
+        }
+        break;
+    case osgGA::GUIEventAdapter::FRAME:
+        // objects may have moved under a still mouse
+        if (m_vis3d->insector_hover && m_hovered) {
+            Hover(view, m_hover_x, m_hover_y);
+        }
+        break;
+    default:
+        break;
+    }
+    return false;
+}
+
+} // namespace Vis
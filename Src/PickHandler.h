@@ -0,0 +1,100 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include "Vis.h"
+
+#include <osg/Geometry>
+#include <osg/Node>
+#include <osg/observer_ptr>
+#include <osg/Referenced>
+#include <osgGA/GUIEventHandler>
+
+#include <vector>
+
+namespace Vis
+{
+
+/**
+ * Node mask bit tested by the scene graph intersectors. Geodes without it
+ * are picked by PickHandler itself: point clouds through a cached BVH,
+ * instanced shapes analytically, gizmos not at all.
+ */
+const osg::Node::NodeMask NodeMask_Intersect = 0x1;
+
+/**
+ * User data of the MatrixTransform of every object, maps a node path found by
+ * an intersector back to the handle of the object.
+ */
+class HandleTag : public osg::Referenced
+{
+public:
+    explicit HandleTag(const Handle &h) : handle(h) {}
+    const Handle handle;
+    // node mask of the transform while shown, see View::Hide
+    osg::Node::NodeMask shown_mask{~0u};
+};
+
+/**
+ * Event handler implementing the IntersectorMode set by
+ * View::SetIntersectMode, it fills Vis3d::picked and Vis3d::pointnorm.
+ *
+ * Without hover an object is picked by a left click, a press and release
+ * without moving, so that camera drags do not pick. With hover the object
+ * under the mouse is picked on every mouse move and on frames where objects
+ * moved under a still mouse, unless neither the mouse, the camera, the scene
+ * nor the objects changed since the last one.
+ *
+ * The objects it tests itself are collected from the scene once and again
+ * only after Vis3d::scene_revision changed, their world matrices are read at
+ * each pick so that moving objects does not cost a new collection. The
+ * collection only observes them, so deleted objects are freed right away.
+ */
+class PickHandler : public osgGA::GUIEventHandler
+{
+public:
+    // vis3d owns the viewer which owns this handler.
+    explicit PickHandler(Vis3d *vis3d) : m_vis3d(vis3d) {}
+
+    virtual bool handle(const osgGA::GUIEventAdapter &ea,
+                        osgGA::GUIActionAdapter &aa);
+
+    /**
+     * Pick at window position (x, y) of view with the current mode.
+     * @return true if an object was picked, else picked is reset.
+     */
+    bool Pick(osgViewer::View *view, float x, float y);
+
+    /// An object tested by PickHandler itself rather than the intersectors.
+    struct Pickable
+    {
+        Handle handle;
+        osg::observer_ptr<osg::Geometry> geom;
+        // the transforms above geom, for its world matrix
+        std::vector<osg::observer_ptr<osg::Node>> transforms;
+    };
+
+private:
+    /// Collect m_pickables again if the scene changed since the last time.
+    void UpdatePickables();
+
+    /// Hover pick at (x, y), unless nothing changed since the last one.
+    void Hover(osgViewer::View *view, float x, float y);
+
+    Vis3d *m_vis3d;
+    float m_push_x{0.f};
+    float m_push_y{0.f};
+
+    std::vector<Pickable> m_pickables;
+    uint64_t m_pickables_revision{~0ull};
+
+    // what the last hover pick was done for
+    bool m_hovered{false};
+    float m_hover_x{0.f};
+    float m_hover_y{0.f};
+    osg::Matrixd m_hover_camera; // view times projection matrix
+    uint64_t m_hover_revision{~0ull};
+    uint64_t m_hover_moves{~0ull};
+    IntersectorMode m_hover_mode{IntersectorMode_Disable};
+};
+
+} // namespace Vis
@@ -0,0 +1,283 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "PointCloudLOD.h"
+
+#include <osg/BoundingBox>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osgUtil/CullVisitor>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <stdint.h>
+#include <utility>
+
+namespace Vis
+{
+
+// Each cell keeps one point per cell of a grid of sg_grid^3 over its box.
+static const uint32_t sg_grid = 128;
+// A cell keeps at most this many samples, so volumetric clouds do not fill
+// the whole grid of the root.
+static const size_t sg_cell_points = 65536;
+// Cells with at most this many points are not split further.
+static const size_t sg_leaf_points = 20000;
+// Bounds the depth of the octree for clouds with many duplicated points.
+static const int sg_max_depth = 20;
+
+size_t PointCloudLODNode::GetNumPoints() const
+{
+    size_t num = 0;
+    for (const auto &cell : m_cells) {
+        num += cell.count;
+    }
+    return num;
+}
+
+/**
+ * Projected point spacing of a cell in pixels, at the distance of the eye to
+ * the cell's bound rather than at its center, which may be behind the eye.
+ * A cell around the eye of a perspective camera gets an infinite error.
+ *
+ * @param psv pixel size vector of the cull visitor, in local coordinates
+ * @param eye eye position in local coordinates
+ */
+static float ProjectedSpacing(const osg::Vec4 &psv, const osg::Vec3 &eye,
+                              const PointCloudLODNode::Cell &cell)
+{
+    const float distance = std::max(
+        (cell.bound.center() - eye).length() - cell.bound.radius(), 0.f);
+    // psv * v is the depth of v times the world size of a pixel at depth 1,
+    // plus the constant size of a pixel of an orthographic camera
+    const osg::Vec3 axis(psv.x(), psv.y(), psv.z());
+    const float scale = axis.length() * distance + (axis * eye + psv.w());
+    if (scale <= 1e-12f) return std::numeric_limits<float>::infinity();
+    return cell.spacing / scale;
+}
+
+void PointCloudLODNode::traverse(osg::NodeVisitor &nv)
+{
+    osgUtil::CullVisitor *cv =
+        nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR
+            ? dynamic_cast<osgUtil::CullVisitor *>(&nv)
+            : nullptr;
+    if (cv == nullptr || m_cells.empty()) {
+        osg::Group::traverse(nv);
+        return;
+    }
+
+    const osg::Vec4 psv = cv->getCurrentCullingSet().getPixelSizeVector();
+    const osg::Vec3 eye = cv->getEyeLocal();
+    // largest projected point spacing first
+    std::priority_queue<std::pair<float, int>> queue;
+    if (!cv->isCulled(m_cells[0].bound)) {
+        queue.push({ProjectedSpacing(psv, eye, m_cells[0]), 0});
+    }
+    size_t drawn = 0;
+    while (!queue.empty()) {
+        const std::pair<float, int> top = queue.top();
+        queue.pop();
+        const Cell &cell = m_cells[top.second];
+        // a smaller cell may still fit
+        if (drawn + cell.count > m_budget) continue;
+        drawn += cell.count;
+        _children[cell.child]->accept(nv);
+
+        if (top.first <= m_pixel_error) continue;
+        for (int c : cell.children) {
+            if (c < 0) continue;
+            const Cell &child = m_cells[c];
+            if (cv->isCulled(child.bound)) continue;
+            queue.push({ProjectedSpacing(psv, eye, child), c});
+        }
+    }
+}
+
+class PointCloudLODBuilder
+{
+public:
+    PointCloudLODBuilder(const float *xyzs, const float *colors,
+                         int color_channels, size_t count,
+                         const osg::Vec4 &color, PointCloudLODNode *node)
+        : m_xyzs(xyzs), m_colors(colors), m_color_channels(color_channels),
+          m_node(node), m_indices(count), m_stamps(sg_grid * sg_grid * sg_grid)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            m_indices[i] = static_cast<uint32_t>(i);
+        }
+        if (m_colors == nullptr) {
+            m_overall_color = new osg::Vec4Array(1, &color);
+        }
+    }
+
+    void Build()
+    {
+        if (m_indices.empty()) return;
+        osg::BoundingBoxf bb;
+        for (uint32_t i : m_indices) {
+            bb.expandBy(Point(i));
+        }
+        // cubic cells keep the grid spacing the same along all axes
+        const osg::Vec3f extent = bb._max - bb._min;
+        const float side =
+            std::max(std::max(extent.x(), extent.y()), extent.z()) * 1.0001f
+            + 1e-6f;
+        BuildCell(bb._min, side, 0, m_indices.size(), 0);
+    }
+
+private:
+    const osg::Vec3f &Point(uint32_t i) const
+    {
+        return *reinterpret_cast<const osg::Vec3f *>(m_xyzs + 3 * size_t(i));
+    }
+
+    int BuildCell(const osg::Vec3f &origin, float side, size_t begin,
+                  size_t end, int depth)
+    {
+        const int id = static_cast<int>(m_node->GetCells().size());
+        m_node->GetCells().emplace_back();
+
+        size_t kept = end;
+        if (end - begin > sg_leaf_points && depth < sg_max_depth) {
+            // grid sampling: the first point of each grid cell stays here,
+            // the other ones are sorted by octant into m_rest
+            const uint32_t stamp = static_cast<uint32_t>(id) + 1;
+            const float scale = sg_grid / side;
+            kept = begin;
+            m_rest.clear();
+            for (size_t i = begin; i < end; ++i) {
+                const uint32_t index = m_indices[i];
+                const osg::Vec3f p = (Point(index) - origin) * scale;
+                uint32_t g[3];
+                for (int k = 0; k < 3; ++k) {
+                    g[k] = std::min(
+                        sg_grid - 1,
+                        static_cast<uint32_t>(std::max(p[k], 0.f)));
+                }
+                uint32_t &s =
+                    m_stamps[(g[2] * sg_grid + g[1]) * sg_grid + g[0]];
+                if (s != stamp && kept - begin < sg_cell_points) {
+                    s = stamp;
+                    m_indices[kept++] = index;
+                }
+                else {
+                    m_rest.push_back(index);
+                }
+            }
+        }
+
+        AddCellGeometry(id, origin, side, begin, kept);
+        if (kept == end) return id;
+
+        // counting sort of the remaining points into the octants
+        const float half = side * 0.5f;
+        const osg::Vec3f center = origin + osg::Vec3f(half, half, half);
+        size_t offsets[9] = {0};
+        for (uint32_t index : m_rest) {
+            ++offsets[Octant(Point(index), center) + 1];
+        }
+        for (int o = 0; o < 8; ++o) {
+            offsets[o + 1] += offsets[o];
+        }
+        size_t fill[8];
+        for (int o = 0; o < 8; ++o) {
+            fill[o] = kept + offsets[o];
+        }
+        for (uint32_t index : m_rest) {
+            m_indices[fill[Octant(Point(index), center)]++] = index;
+        }
+
+        // m_rest is reused by the children
+        for (int o = 0; o < 8; ++o) {
+            const size_t b = kept + offsets[o];
+            const size_t e = kept + offsets[o + 1];
+            if (b == e) continue;
+            const osg::Vec3f child_origin(origin.x() + (o & 1 ? half : 0.f),
+                                          origin.y() + (o & 2 ? half : 0.f),
+                                          origin.z() + (o & 4 ? half : 0.f));
+            const int child = BuildCell(child_origin, half, b, e, depth + 1);
+            m_node->GetCells()[id].children[o] = child;
+        }
+        return id;
+    }
+
+    static int Octant(const osg::Vec3f &p, const osg::Vec3f &center)
+    {
+        return (p.x() >= center.x() ? 1 : 0) | (p.y() >= center.y() ? 2 : 0)
+               | (p.z() >= center.z() ? 4 : 0);
+    }
+
+    void AddCellGeometry(int id, const osg::Vec3f &origin, float side,
+                         size_t begin, size_t end)
+    {
+        const unsigned int num = static_cast<unsigned int>(end - begin);
+        osg::ref_ptr<osg::Vec3Array> vs = new osg::Vec3Array(num);
+        for (unsigned int i = 0; i < num; ++i) {
+            (*vs)[i] = Point(m_indices[begin + i]);
+        }
+
+        osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+        geom->setVertexArray(vs.get());
+        if (m_colors == nullptr) {
+            geom->setColorArray(m_overall_color.get(),
+                                osg::Array::BIND_OVERALL);
+        }
+        else if (m_color_channels == 3) {
+            osg::ref_ptr<osg::Vec3Array> cs = new osg::Vec3Array(num);
+            for (unsigned int i = 0; i < num; ++i) {
+                (*cs)[i] = *reinterpret_cast<const osg::Vec3f *>(
+                    m_colors + 3 * size_t(m_indices[begin + i]));
+            }
+            geom->setColorArray(cs.get(), osg::Array::BIND_PER_VERTEX);
+        }
+        else {
+            osg::ref_ptr<osg::Vec4Array> cs = new osg::Vec4Array(num);
+            for (unsigned int i = 0; i < num; ++i) {
+                (*cs)[i] = *reinterpret_cast<const osg::Vec4f *>(
+                    m_colors + 4 * size_t(m_indices[begin + i]));
+            }
+            geom->setColorArray(cs.get(), osg::Array::BIND_PER_VERTEX);
+        }
+        geom->addPrimitiveSet(
+            new osg::DrawArrays(osg::PrimitiveSet::POINTS, 0, num));
+
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+        geode->addDrawable(geom.get());
+
+        PointCloudLODNode::Cell &cell = m_node->GetCells()[id];
+        const float half = side * 0.5f;
+        cell.bound.set(origin + osg::Vec3f(half, half, half),
+                       half * std::sqrt(3.f));
+        cell.spacing = side / sg_grid;
+        cell.count = num;
+        cell.child = m_node->getNumChildren();
+        m_node->addChild(geode.get());
+    }
+
+    const float *m_xyzs;
+    const float *m_colors;
+    int m_color_channels;
+    PointCloudLODNode *m_node;
+    osg::ref_ptr<osg::Vec4Array> m_overall_color;
+
+    std::vector<uint32_t> m_indices; // points of a cell are contiguous
+    std::vector<uint32_t> m_rest;
+    std::vector<uint32_t> m_stamps; // grid cell -> last cell id + 1 using it
+};
+
+osg::ref_ptr<PointCloudLODNode> CreatePointCloudLOD(const float *xyzs,
+                                                    const float *colors,
+                                                    int color_channels,
+                                                    size_t count,
+                                                    const osg::Vec4 &color)
+{
+    osg::ref_ptr<PointCloudLODNode> node = new PointCloudLODNode;
+    PointCloudLODBuilder builder(xyzs, colors, color_channels, count, color,
+                                 node.get());
+    builder.Build();
+    return node;
+}
+
+} // namespace Vis
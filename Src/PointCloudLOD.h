@@ -0,0 +1,85 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/BoundingSphere>
+#include <osg/Group>
+#include <osg/Vec4>
+
+#include <stddef.h>
+#include <vector>
+
+namespace Vis
+{
+
+/**
+ * A point cloud split into an octree of cells, drawn with level of detail.
+ *
+ * Every cell holds a grid subsample of the points inside it, the remaining
+ * points go down to its children, so the cells of a path from the root add
+ * up to ever denser versions of the cloud. Each cell is a Geode child of
+ * this group. The cull traversal only visits the cells in the view frustum,
+ * coarse to fine by their projected point spacing, and refines until the
+ * spacing is below the point size or the point budget is spent. Other
+ * traversals see all cells.
+ */
+class PointCloudLODNode : public osg::Group
+{
+public:
+    struct Cell
+    {
+        osg::BoundingSphere bound;
+        float spacing{0.f}; // distance between grid samples in the cell
+        unsigned int count{0};
+        unsigned int child{0}; // index of the cell's Geode in the group
+        int children[8]{-1, -1, -1, -1, -1, -1, -1, -1};
+    };
+
+    PointCloudLODNode() {}
+
+    PointCloudLODNode(const PointCloudLODNode &other,
+                      const osg::CopyOp &copyop = osg::CopyOp::SHALLOW_COPY)
+        : osg::Group(other, copyop), m_cells(other.m_cells),
+          m_budget(other.m_budget), m_pixel_error(other.m_pixel_error)
+    {
+    }
+
+    META_Node(Vis, PointCloudLODNode);
+
+    virtual void traverse(osg::NodeVisitor &nv);
+
+    /// Maximum number of points drawn per frame.
+    void SetPointBudget(size_t budget) { m_budget = budget; }
+    size_t GetPointBudget() const { return m_budget; }
+
+    /// Cells are refined while their point spacing is larger than this many
+    /// pixels on screen.
+    void SetPixelError(float pixels) { m_pixel_error = pixels; }
+    float GetPixelError() const { return m_pixel_error; }
+
+    std::vector<Cell> &GetCells() { return m_cells; }
+    size_t GetNumPoints() const;
+
+protected:
+    virtual ~PointCloudLODNode() {}
+
+    std::vector<Cell> m_cells; // m_cells[0] is the root
+    size_t m_budget{2000000};
+    float m_pixel_error{1.f};
+};
+
+/**
+ * Build the octree of a point cloud. The points (and colors) are copied into
+ * the cells, the input is only read during the call.
+ *
+ * @param xyzs count * 3 floats
+ * @param colors count * color_channels floats, or nullptr to use color
+ * @param color_channels 3 or 4
+ * @param color overall color when colors is nullptr
+ */
+osg::ref_ptr<PointCloudLODNode> CreatePointCloudLOD(const float *xyzs,
+                                                    const float *colors,
+                                                    int color_channels,
+                                                    size_t count,
+                                                    const osg::Vec4 &color);
+
+} // namespace Vis
@@ -32,10 +32,11 @@ SOFTWARE.
 
 using namespace Vis;
 
-QViewerWidget::QViewerWidget(QWidget *parent, Qt::WindowFlags f)
+QViewerWidget::QViewerWidget(QWidget *parent, Qt::WindowFlags f,
+                             RenderPolicy policy)
     : QOpenGLWidget(parent, f)
 {
-    m_view = std::make_shared<Vis::View>();
+    m_view = std::make_shared<Vis::View>(policy);
     m_graphics_window = GetOsgViewer()->setUpViewerAsEmbeddedInWindow(
         x(), y(), width(), height());
     GetOsgViewer()->getCamera()->setGraphicsContext(m_graphics_window.get());
@@ -49,8 +50,16 @@ QViewerWidget::QViewerWidget(QWidget *parent, Qt::WindowFlags f)
         std::shared_ptr<KeyboardMapper>(new KeyboardMapper(this));
     GetOsgViewer()->home();
     setFocusPolicy(Qt::StrongFocus);
+    // mouse moves without a pressed button are needed for hover picking
+    setMouseTracking(true);
+    // the view may change from any thread, update() is for the GUI thread
+    m_view->SetRedrawRequest([this]() {
+        QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+    });
 }
 
+QViewerWidget::~QViewerWidget() { m_view->SetRedrawRequest(nullptr); }
+
 void QViewerWidget::initializeGL()
 {
     QOpenGLWidget::initializeGL();
@@ -70,11 +79,21 @@ void QViewerWidget::resizeGL(int w, int h)
     GetOsgViewer()->getCamera()->setViewport(0, 0, w, h);
 }
 
-void QViewerWidget::paintGL() { GetOsgViewer()->frame(); }
+void QViewerWidget::paintGL()
+{
+    if (m_view->Frame()) {
+        update();
+    }
+}
 
 osgViewer::Viewer *QViewerWidget::GetOsgViewer()
 {
     return m_view->GetOsgViewer();
 }
 
-std::shared_ptr<Vis::View> QViewerWidget::GetView() { return m_view; }
\ No newline at end of file
+std::shared_ptr<Vis::View> QViewerWidget::GetView() { return m_view; }
+
+bool QViewerWidget::NeedsHoverEvents() const
+{
+    return m_view->NeedsHoverEvents();
+}
\ No newline at end of file
@@ -43,8 +43,10 @@ class QViewerWidget : public QOpenGLWidget
     Q_OBJECT
 
 public:
-    explicit QViewerWidget(QWidget *parent = nullptr,
-                           Qt::WindowFlags f = Qt::WindowFlags());
+    explicit QViewerWidget(
+        QWidget *parent = nullptr, Qt::WindowFlags f = Qt::WindowFlags(),
+        RenderPolicy policy = RenderPolicy_VertexBufferObject);
+    ~QViewerWidget();
 
 
     // explicit Widget(osg::ref_ptr<osgViewer::Viewer> &viewer,
@@ -77,6 +79,10 @@ public:
     // }
     std::shared_ptr<Vis::View> GetView();
 
+    // Whether mouse moves without a pressed button should be forwarded and
+    // drawn, see View::SetRenderOnDemand.
+    bool NeedsHoverEvents() const;
+
 protected:
     virtual void initializeGL() override;
     virtual void resizeGL(int w, int h) override;
@@ -0,0 +1,583 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "SceneFile.h"
+
+#include "ExternalArray.h"
+#include "Logger.h"
+#include "MappedFile.h"
+#include "PointCloudLOD.h"
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/KdTree>
+#include <osg/NodeVisitor>
+#include <osg/StateSet>
+#include <osgDB/ReaderWriter>
+#include <osgDB/Registry>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <streambuf>
+#include <type_traits>
+
+namespace fs = std::filesystem;
+
+namespace Vis
+{
+
+static const char sg_magic[8] = {'O', 'Q', 'V', 'S', 'C', 'E', 'N', 'E'};
+static const uint32_t sg_version = 2;
+static const uint32_t sg_byte_order = 0x01020304;
+
+struct SceneFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // sg_byte_order as written
+    uint64_t num_objects;
+    uint64_t objects_offset;
+};
+
+struct SceneFileObject
+{
+    uint64_t type;
+    uint64_t uid;
+    uint64_t parent_uid;
+    double matrix[16];
+    uint32_t visible;
+    uint32_t num_arrays;
+    uint64_t graph_offset; // a group of the content children, osgb format
+    uint64_t graph_size;
+    uint64_t arrays_offset; // num_arrays SceneFileArray
+    uint64_t cells_offset;  // PointCloudLODNode::Cell
+    uint64_t num_cells;
+    float pixel_error; // PointCloudLODNode::GetPixelError()
+    uint32_t padding;
+};
+
+enum SceneFileSlot
+{
+    SceneFileSlot_Vertex = 0,
+    SceneFileSlot_Normal,
+    SceneFileSlot_Color,
+    SceneFileSlot_Primitive, // plus the index of the primitive set
+};
+
+struct SceneFileArray
+{
+    uint32_t geometry; // index in the order of GeometryCollector
+    uint32_t slot;
+    uint32_t type; // osg::Array::Type or osg::PrimitiveSet::Type
+    uint32_t binding;
+    uint64_t offset;
+    uint64_t count; // number of elements
+};
+
+static_assert(std::is_trivially_copyable<SceneFileObject>::value, "");
+static_assert(std::is_trivially_copyable<PointCloudLODNode::Cell>::value, "");
+
+/// Collect the geometries of a graph, in the same order for a graph and its
+/// copies.
+class GeometryCollector : public osg::NodeVisitor
+{
+public:
+    GeometryCollector()
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+    {
+    }
+
+    virtual void apply(osg::Geode &geode)
+    {
+        for (unsigned int i = 0; i < geode.getNumDrawables(); ++i) {
+            osg::Geometry *geom = geode.getDrawable(i)->asGeometry();
+            if (geom != nullptr) geometries.push_back(geom);
+        }
+    }
+
+    std::vector<osg::Geometry *> geometries;
+};
+
+/// Read-only stream buffer over memory, e.g. a mapped file.
+class MemoryBuffer : public std::streambuf
+{
+public:
+    MemoryBuffer(const char *data, size_t size)
+    {
+        char *begin = const_cast<char *>(data);
+        setg(begin, begin, begin + size);
+    }
+
+protected:
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which)
+    {
+        if (!(which & std::ios_base::in)) return pos_type(off_type(-1));
+        char *base = dir == std::ios_base::beg   ? eback()
+                     : dir == std::ios_base::cur ? gptr()
+                                                 : egptr();
+        char *pos = base + off;
+        if (pos < eback() || pos > egptr()) return pos_type(off_type(-1));
+        setg(eback(), pos, egptr());
+        return pos_type(pos - eback());
+    }
+
+    virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+static osg::ref_ptr<osgDB::Options> BinaryOptions()
+{
+    osg::ref_ptr<osgDB::Options> options = new osgDB::Options;
+    options->setPluginStringData("fileType", "Binary");
+    return options;
+}
+
+static void AlignStream(std::ostream &out)
+{
+    static const char zeros[16] = {0};
+    const std::streamoff pos = out.tellp();
+    out.write(zeros, (16 - pos % 16) % 16);
+}
+
+static bool IsRawArray(const osg::Array *array)
+{
+    return array != nullptr && array->getDataType() == GL_FLOAT
+           && (array->getType() == osg::Array::Vec3ArrayType
+               || array->getType() == osg::Array::Vec4ArrayType);
+}
+
+/// Write the raw data of array and describe it in arrays.
+static void WriteArray(std::ostream &out, const osg::Array *array,
+                       uint32_t geometry, uint32_t slot,
+                       std::vector<SceneFileArray> &arrays)
+{
+    AlignStream(out);
+    SceneFileArray fa{};
+    fa.geometry = geometry;
+    fa.slot = slot;
+    fa.type = array->getType();
+    fa.binding = array->getBinding();
+    fa.offset = static_cast<uint64_t>(out.tellp());
+    fa.count = array->getNumElements();
+    out.write(static_cast<const char *>(array->getDataPointer()),
+              array->getTotalDataSize());
+    arrays.push_back(fa);
+}
+
+/**
+ * Write the arrays of the geometries of graph, a copy of the content sharing
+ * its arrays, and take them out of the copy.
+ */
+static void WriteArrays(std::ostream &out, osg::Node *graph,
+                        std::vector<SceneFileArray> &arrays)
+{
+    GeometryCollector collector;
+    graph->accept(collector);
+    for (size_t g = 0; g < collector.geometries.size(); ++g) {
+        osg::Geometry *geom = collector.geometries[g];
+        const uint32_t index = static_cast<uint32_t>(g);
+        if (IsRawArray(geom->getVertexArray())) {
+            WriteArray(out, geom->getVertexArray(), index,
+                       SceneFileSlot_Vertex, arrays);
+            geom->setVertexArray(nullptr);
+        }
+        if (IsRawArray(geom->getNormalArray())) {
+            WriteArray(out, geom->getNormalArray(), index,
+                       SceneFileSlot_Normal, arrays);
+            geom->setNormalArray(nullptr);
+        }
+        if (IsRawArray(geom->getColorArray())) {
+            WriteArray(out, geom->getColorArray(), index, SceneFileSlot_Color,
+                       arrays);
+            geom->setColorArray(nullptr);
+        }
+        for (unsigned int p = 0; p < geom->getNumPrimitiveSets(); ++p) {
+            osg::DrawElements *de =
+                geom->getPrimitiveSet(p)->getDrawElements();
+            if (de == nullptr || de->getNumIndices() == 0) continue;
+            AlignStream(out);
+            SceneFileArray fa{};
+            fa.geometry = index;
+            fa.slot = SceneFileSlot_Primitive + p;
+            fa.type = de->getType();
+            fa.offset = static_cast<uint64_t>(out.tellp());
+            fa.count = de->getNumIndices();
+            out.write(static_cast<const char *>(de->getDataPointer()),
+                      de->getTotalDataSize());
+            arrays.push_back(fa);
+            // an empty set of the same type and mode keeps its place
+            osg::ref_ptr<osg::DrawElements> empty =
+                static_cast<osg::DrawElements *>(de->cloneType());
+            empty->setMode(de->getMode());
+            empty->setNumInstances(de->getNumInstances());
+            geom->setPrimitiveSet(p, empty.get());
+        }
+        // k-d trees have no serializer, picking builds them again
+        if (dynamic_cast<osg::KdTree *>(geom->getShape()) != nullptr) {
+            geom->setShape(nullptr);
+        }
+    }
+}
+
+bool WriteSceneFile(const std::string &path,
+                    const std::vector<SceneObject> &objects)
+{
+    osgDB::ReaderWriter *rw =
+        osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+    if (rw == nullptr) {
+        LOG_ERROR("No osgb plugin to write scene {0}.", path);
+        return false;
+    }
+    const osg::ref_ptr<osgDB::Options> options = BinaryOptions();
+
+    const std::string tmp = path + ".tmp";
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        LOG_ERROR("Can not open {0} for writing.", tmp);
+        return false;
+    }
+    SceneFileHeader header{};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    std::vector<SceneFileObject> table;
+    table.reserve(objects.size());
+    for (const auto &object : objects) {
+        SceneFileObject fo{};
+        fo.type = object.type;
+        fo.uid = object.uid;
+        fo.parent_uid = object.parent_uid;
+        std::memcpy(fo.matrix, object.matrix.ptr(), sizeof(fo.matrix));
+        fo.visible = object.visible ? 1 : 0;
+
+        // the copy shares the arrays, WriteArrays(...) takes them out of it
+        osg::ref_ptr<osg::Group> graph = new osg::Group;
+        const osg::CopyOp copyop(osg::CopyOp::DEEP_COPY_NODES
+                                 | osg::CopyOp::DEEP_COPY_DRAWABLES);
+        const PointCloudLODNode *lod =
+            object.contents.size() == 1
+                ? dynamic_cast<const PointCloudLODNode *>(
+                      object.contents[0].get())
+                : nullptr;
+        if (lod != nullptr) {
+            // the class has no serializer, its cells are written raw and the
+            // group takes its state set
+            for (unsigned int i = 0; i < lod->getNumChildren(); ++i) {
+                graph->addChild(
+                    static_cast<osg::Node *>(lod->getChild(i)->clone(copyop)));
+            }
+            if (lod->getStateSet() != nullptr) {
+                graph->setStateSet(new osg::StateSet(*lod->getStateSet()));
+            }
+            fo.pixel_error = lod->GetPixelError();
+        }
+        else {
+            for (const auto &content : object.contents) {
+                graph->addChild(
+                    static_cast<osg::Node *>(content->clone(copyop)));
+            }
+        }
+
+        std::vector<SceneFileArray> arrays;
+        WriteArrays(out, graph.get(), arrays);
+
+        std::ostringstream graph_stream;
+        const osgDB::ReaderWriter::WriteResult result =
+            rw->writeNode(*graph, graph_stream, options.get());
+        if (!result.success()) {
+            LOG_ERROR("Can not write object: type: {0}, uid: {1}.",
+                      object.type, object.uid);
+            out.close();
+            fs::remove(tmp);
+            return false;
+        }
+        const std::string bytes = graph_stream.str();
+        AlignStream(out);
+        fo.graph_offset = static_cast<uint64_t>(out.tellp());
+        fo.graph_size = bytes.size();
+        out.write(bytes.data(), bytes.size());
+
+        AlignStream(out);
+        fo.arrays_offset = static_cast<uint64_t>(out.tellp());
+        fo.num_arrays = static_cast<uint32_t>(arrays.size());
+        out.write(reinterpret_cast<const char *>(arrays.data()),
+                  arrays.size() * sizeof(SceneFileArray));
+
+        if (lod != nullptr) {
+            const std::vector<PointCloudLODNode::Cell> &cells =
+                const_cast<PointCloudLODNode *>(lod)->GetCells();
+            AlignStream(out);
+            fo.cells_offset = static_cast<uint64_t>(out.tellp());
+            fo.num_cells = cells.size();
+            out.write(reinterpret_cast<const char *>(cells.data()),
+                      cells.size() * sizeof(PointCloudLODNode::Cell));
+        }
+        table.push_back(fo);
+    }
+
+    AlignStream(out);
+    std::memcpy(header.magic, sg_magic, sizeof(sg_magic));
+    header.version = sg_version;
+    header.byte_order = sg_byte_order;
+    header.num_objects = table.size();
+    header.objects_offset = static_cast<uint64_t>(out.tellp());
+    out.write(reinterpret_cast<const char *>(table.data()),
+              table.size() * sizeof(SceneFileObject));
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        LOG_ERROR("Failed to write {0}.", tmp);
+        fs::remove(tmp);
+        return false;
+    }
+
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        LOG_ERROR("Can not rename {0} to {1}: {2}", tmp, path, ec.message());
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+/// Whether [offset, offset + size) lies within a file of file_size bytes.
+static bool InFile(uint64_t offset, uint64_t size, uint64_t file_size)
+{
+    return offset <= file_size && size <= file_size - offset;
+}
+
+/// Same as above for count elements of elem_size bytes, count being checked
+/// before the size is computed so that a corrupt count can not wrap it.
+static bool InFile(uint64_t offset, uint64_t count, uint64_t elem_size,
+                   uint64_t file_size)
+{
+    return count <= file_size / elem_size
+           && InFile(offset, count * elem_size, file_size);
+}
+
+static size_t IndexSize(uint32_t type)
+{
+    switch (type) {
+    case osg::PrimitiveSet::DrawElementsUBytePrimitiveType:
+        return 1;
+    case osg::PrimitiveSet::DrawElementsUShortPrimitiveType:
+        return 2;
+    case osg::PrimitiveSet::DrawElementsUIntPrimitiveType:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+/// Put the arrays described by fa back into the geometries of graph.
+static bool RestoreArray(const SceneFileArray &fa,
+                         const std::vector<osg::Geometry *> &geometries,
+                         const std::shared_ptr<const MappedFile> &file)
+{
+    // osg arrays count their elements in unsigned int
+    if (fa.geometry >= geometries.size()
+        || fa.count > std::numeric_limits<unsigned int>::max()) {
+        return false;
+    }
+    osg::Geometry *geom = geometries[fa.geometry];
+
+    if (fa.slot >= SceneFileSlot_Primitive) {
+        const unsigned int p = fa.slot - SceneFileSlot_Primitive;
+        const size_t index_size = IndexSize(fa.type);
+        if (p >= geom->getNumPrimitiveSets() || index_size == 0
+            || !InFile(fa.offset, fa.count, index_size, file->Size())) {
+            return false;
+        }
+        const char *data = file->Data() + fa.offset;
+        osg::DrawElements *de = geom->getPrimitiveSet(p)->getDrawElements();
+        if (de == nullptr || de->getType() != fa.type) return false;
+        de->resizeElements(static_cast<unsigned int>(fa.count));
+        std::memcpy(const_cast<GLvoid *>(de->getDataPointer()), data,
+                    fa.count * index_size);
+        de->dirty();
+        return true;
+    }
+
+    osg::ref_ptr<osg::Array> array;
+    const unsigned int count = static_cast<unsigned int>(fa.count);
+    const char *data = file->Data() + fa.offset;
+    if (fa.type == osg::Array::Vec3ArrayType
+        && InFile(fa.offset, fa.count, sizeof(osg::Vec3), file->Size())) {
+        array = new ExternalVec3Array(reinterpret_cast<const osg::Vec3 *>(data),
+                                      count, file);
+    }
+    else if (fa.type == osg::Array::Vec4ArrayType
+             && InFile(fa.offset, fa.count, sizeof(osg::Vec4),
+                       file->Size())) {
+        array = new ExternalVec4Array(reinterpret_cast<const osg::Vec4 *>(data),
+                                      count, file);
+    }
+    else {
+        return false;
+    }
+    const osg::Array::Binding binding =
+        static_cast<osg::Array::Binding>(fa.binding);
+    switch (fa.slot) {
+    case SceneFileSlot_Vertex:
+        geom->setVertexArray(array.get());
+        break;
+    case SceneFileSlot_Normal:
+        geom->setNormalArray(array.get(), binding);
+        break;
+    case SceneFileSlot_Color:
+        geom->setColorArray(array.get(), binding);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+/// Whether the cells read from a file only refer to existing Geodes and
+/// cells, as PointCloudLODNode::traverse(...) does not check.
+static bool ValidCells(PointCloudLODNode &lod)
+{
+    const std::vector<PointCloudLODNode::Cell> &cells = lod.GetCells();
+    for (const auto &cell : cells) {
+        if (cell.child >= lod.getNumChildren()) return false;
+        for (int c : cell.children) {
+            if (c >= 0 && static_cast<uint64_t>(c) >= cells.size()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool ReadSceneFile(const std::string &path, std::vector<SceneObject> &objects)
+{
+    const std::shared_ptr<const MappedFile> file =
+        std::make_shared<MappedFile>(path);
+    if (!file->IsOpen()) {
+        LOG_ERROR("Can not open scene {0}.", path);
+        return false;
+    }
+    const uint64_t size = file->Size();
+    SceneFileHeader header{};
+    if (size < sizeof(header)) {
+        LOG_ERROR("{0} is not a scene file.", path);
+        return false;
+    }
+    std::memcpy(&header, file->Data(), sizeof(header));
+    if (std::memcmp(header.magic, sg_magic, sizeof(sg_magic)) != 0) {
+        LOG_ERROR("{0} is not a scene file.", path);
+        return false;
+    }
+    if (header.byte_order != sg_byte_order || header.version != sg_version) {
+        LOG_ERROR("Scene {0} has version {1}, byte order {2:x}, expected "
+                  "{3}, {4:x}.",
+                  path, header.version, header.byte_order, sg_version,
+                  sg_byte_order);
+        return false;
+    }
+    if (!InFile(header.objects_offset, header.num_objects,
+                sizeof(SceneFileObject), size)) {
+        LOG_ERROR("Scene {0} is truncated.", path);
+        return false;
+    }
+
+    osgDB::ReaderWriter *rw =
+        osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+    if (rw == nullptr) {
+        LOG_ERROR("No osgb plugin to read scene {0}.", path);
+        return false;
+    }
+    const osg::ref_ptr<osgDB::Options> options = BinaryOptions();
+
+    objects.clear();
+    objects.reserve(header.num_objects);
+    for (uint64_t i = 0; i < header.num_objects; ++i) {
+        SceneFileObject fo;
+        std::memcpy(&fo,
+                    file->Data() + header.objects_offset
+                        + i * sizeof(SceneFileObject),
+                    sizeof(fo));
+        if (!InFile(fo.graph_offset, fo.graph_size, size)
+            || !InFile(fo.arrays_offset, fo.num_arrays,
+                       sizeof(SceneFileArray), size)
+            || !InFile(fo.cells_offset, fo.num_cells,
+                       sizeof(PointCloudLODNode::Cell), size)) {
+            LOG_ERROR("Scene {0} is truncated.", path);
+            return false;
+        }
+
+        MemoryBuffer buffer(file->Data() + fo.graph_offset, fo.graph_size);
+        std::istream in(&buffer);
+        const osgDB::ReaderWriter::ReadResult result =
+            rw->readNode(in, options.get());
+        osg::ref_ptr<osg::Node> graph = result.getNode();
+        if (!graph) {
+            LOG_ERROR("Can not read object: type: {0}, uid: {1} from {2}.",
+                      fo.type, fo.uid, path);
+            return false;
+        }
+
+        GeometryCollector collector;
+        graph->accept(collector);
+        for (uint32_t a = 0; a < fo.num_arrays; ++a) {
+            SceneFileArray fa;
+            std::memcpy(&fa,
+                        file->Data() + fo.arrays_offset
+                            + a * sizeof(SceneFileArray),
+                        sizeof(fa));
+            if (!RestoreArray(fa, collector.geometries, file)) {
+                LOG_ERROR("Invalid array of object: type: {0}, uid: {1} in "
+                          "{2}.",
+                          fo.type, fo.uid, path);
+                return false;
+            }
+        }
+
+        osg::Group *group = graph->asGroup();
+        if (group == nullptr) {
+            LOG_ERROR("Invalid content of object: type: {0}, uid: {1} in {2}.",
+                      fo.type, fo.uid, path);
+            return false;
+        }
+        SceneObject object;
+        object.type = fo.type;
+        object.uid = fo.uid;
+        object.parent_uid = fo.parent_uid;
+        object.visible = fo.visible != 0;
+        object.matrix.set(fo.matrix);
+        if (fo.num_cells > 0) {
+            osg::ref_ptr<PointCloudLODNode> lod = new PointCloudLODNode;
+            for (unsigned int c = 0; c < group->getNumChildren(); ++c) {
+                lod->addChild(group->getChild(c));
+            }
+            lod->setStateSet(group->getStateSet());
+            lod->SetPixelError(fo.pixel_error);
+            lod->GetCells().resize(fo.num_cells);
+            std::memcpy(lod->GetCells().data(), file->Data() + fo.cells_offset,
+                        fo.num_cells * sizeof(PointCloudLODNode::Cell));
+            if (!ValidCells(*lod)) {
+                LOG_ERROR("Invalid cells of object: type: {0}, uid: {1} in "
+                          "{2}.",
+                          fo.type, fo.uid, path);
+                return false;
+            }
+            object.contents.push_back(lod);
+        }
+        else {
+            for (unsigned int c = 0; c < group->getNumChildren(); ++c) {
+                object.contents.push_back(group->getChild(c));
+            }
+        }
+        objects.push_back(object);
+    }
+    return true;
+}
+
+} // namespace Vis
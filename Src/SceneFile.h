@@ -0,0 +1,55 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Matrixd>
+#include <osg/Node>
+#include <osg/ref_ptr>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Vis
+{
+
+/// An object of a scene file, its content is the children of its
+/// MatrixTransform but the chained objects.
+struct SceneObject
+{
+    uint64_t type{0};
+    uint64_t uid{0};
+    uint64_t parent_uid{0}; // object this one is chained to, 0 for none
+    bool visible{true};
+    osg::Matrixd matrix;
+    std::vector<osg::ref_ptr<osg::Node>> contents;
+};
+
+/**
+ * Write objects to a scene file.
+ *
+ * The file starts with a versioned header and ends with a table of fixed
+ * size object records, in native byte order. For each object it holds the
+ * content graph in OSG's native binary format, but with the float vertex,
+ * normal and color arrays and the index arrays taken out: these follow raw
+ * and 16 byte aligned, with a table telling where they go. PointCloudLOD
+ * content also stores its cells raw, its state set and its pixel error.
+ *
+ * The file is written next to path and then renamed, so a scene read from
+ * path before keeps its mapping.
+ *
+ * @return false on errors, which are logged
+ */
+bool WriteSceneFile(const std::string &path,
+                    const std::vector<SceneObject> &objects);
+
+/**
+ * Read a scene file written by WriteSceneFile(...). The file is mapped
+ * read-only, the raw vertex, normal and color arrays are used in place and
+ * keep the mapping alive, index arrays are copied, only the small remaining
+ * graphs are parsed.
+ *
+ * @return false on errors, which are logged
+ */
+bool ReadSceneFile(const std::string &path, std::vector<SceneObject> &objects);
+
+} // namespace Vis
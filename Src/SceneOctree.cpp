@@ -0,0 +1,249 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "SceneOctree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace Vis
+{
+
+static const int sg_num_levels = 9;
+static const int sg_level_shift = 3; // each level is 8 times wider
+// width of the cells of level 0
+static const double sg_min_cell_size = 1.0 / 4096;
+// beyond, the cell coordinates would not fit
+static const double sg_max_coordinate = 1e15;
+
+/// A group of the octree, knowing its own key to drop it once empty.
+class OctreeCell : public osg::Group
+{
+public:
+    OctreeCell(int cell_level, int64_t cx, int64_t cy, int64_t cz)
+        : level(cell_level), x(cx), y(cy), z(cz)
+    {
+    }
+
+    void Reserve(size_t n) { _children.reserve(n); }
+
+    /// Remove the children found in nodes in a single pass, where
+    /// removeChild(...) would search the children for each one.
+    void RemoveChildren(const std::unordered_set<const osg::Node *> &nodes)
+    {
+        const auto first = std::stable_partition(
+            _children.begin(), _children.end(),
+            [&nodes](const osg::ref_ptr<osg::Node> &child) {
+                return nodes.find(child.get()) == nodes.end();
+            });
+        const size_t kept = first - _children.begin();
+        removeChildren(static_cast<unsigned int>(kept),
+                       static_cast<unsigned int>(_children.size() - kept));
+    }
+
+    const int level;
+    const int64_t x, y, z;
+};
+
+static inline double CellSize(int level)
+{
+    return std::ldexp(sg_min_cell_size, level * sg_level_shift);
+}
+
+/// Floor division by 8, for the coordinates of the parent cell.
+static inline int64_t ParentCoordinate(int64_t c)
+{
+    return c >= 0 ? c >> sg_level_shift
+                  : -((-c + (1 << sg_level_shift) - 1) >> sg_level_shift);
+}
+
+size_t SceneOctree::CellKeyHasher::operator()(const CellKey &k) const
+{
+    uint64_t h = static_cast<uint64_t>(k.level);
+    for (const int64_t c : {k.x, k.y, k.z}) {
+        h = (h ^ static_cast<uint64_t>(c)) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+    }
+    return static_cast<size_t>(h);
+}
+
+bool SceneOctree::KeyOf(const osg::BoundingSphere &bs, CellKey &key)
+{
+    if (!bs.valid()) return false;
+    const double diameter = 2.0 * bs.radius();
+    int level = 0;
+    while (level < sg_num_levels && CellSize(level) < diameter) {
+        ++level;
+    }
+    if (level == sg_num_levels) return false;
+
+    const double size = CellSize(level);
+    int64_t c[3];
+    for (int i = 0; i < 3; ++i) {
+        const double f = std::floor(bs.center()[i] / size);
+        if (!(std::abs(f) < sg_max_coordinate)) return false;
+        c[i] = static_cast<int64_t>(f);
+    }
+    key = CellKey{level, c[0], c[1], c[2]};
+    return true;
+}
+
+osg::Group *SceneOctree::ParentOf(osg::Node *node) const
+{
+    for (unsigned int i = 0; i < node->getNumParents(); ++i) {
+        osg::Group *parent = node->getParent(i);
+        if (parent == m_root || dynamic_cast<OctreeCell *>(parent)) {
+            return parent;
+        }
+    }
+    return nullptr;
+}
+
+OctreeCell *SceneOctree::GetOrCreateCell(const CellKey &key)
+{
+    auto it = m_cells.find(key);
+    if (it != m_cells.end()) return static_cast<OctreeCell *>(it->second.get());
+
+    osg::ref_ptr<OctreeCell> cell =
+        new OctreeCell(key.level, key.x, key.y, key.z);
+    osg::Group *parent = m_root;
+    if (key.level + 1 < sg_num_levels) {
+        parent = GetOrCreateCell(CellKey{key.level + 1,
+                                         ParentCoordinate(key.x),
+                                         ParentCoordinate(key.y),
+                                         ParentCoordinate(key.z)});
+    }
+    parent->addChild(cell.get());
+    m_cells.emplace(key, cell.get());
+    return cell.get();
+}
+
+void SceneOctree::Prune(OctreeCell *cell)
+{
+    while (cell != nullptr && cell->getNumChildren() == 0) {
+        osg::ref_ptr<OctreeCell> dropped = cell;
+        osg::Group *parent =
+            cell->getNumParents() > 0 ? cell->getParent(0) : nullptr;
+        if (parent) parent->removeChild(cell);
+        m_cells.erase(CellKey{cell->level, cell->x, cell->y, cell->z});
+        cell = dynamic_cast<OctreeCell *>(parent);
+    }
+}
+
+void SceneOctree::Insert(osg::Node *node)
+{
+    CellKey key;
+    if (KeyOf(node->getBound(), key)) {
+        GetOrCreateCell(key)->addChild(node);
+    }
+    else {
+        m_root->addChild(node);
+    }
+}
+
+void SceneOctree::Insert(const std::vector<osg::Node *> &nodes)
+{
+    std::unordered_map<CellKey, std::vector<osg::Node *>, CellKeyHasher>
+        cell_nodes;
+    for (osg::Node *node : nodes) {
+        CellKey key;
+        if (KeyOf(node->getBound(), key)) {
+            cell_nodes[key].push_back(node);
+        }
+        else {
+            m_root->addChild(node);
+        }
+    }
+    for (const auto &it : cell_nodes) {
+        OctreeCell *cell = GetOrCreateCell(it.first);
+        cell->Reserve(cell->getNumChildren() + it.second.size());
+        for (osg::Node *node : it.second) {
+            cell->addChild(node);
+        }
+    }
+}
+
+void SceneOctree::Remove(osg::Node *node)
+{
+    osg::Group *parent = ParentOf(node);
+    if (parent == nullptr) return;
+    parent->removeChild(node);
+    Prune(dynamic_cast<OctreeCell *>(parent));
+}
+
+void SceneOctree::Update(osg::Node *node)
+{
+    osg::Group *parent = ParentOf(node);
+    if (parent == nullptr) return;
+
+    CellKey key;
+    const bool in_cell = KeyOf(node->getBound(), key);
+    const OctreeCell *cell = dynamic_cast<const OctreeCell *>(parent);
+    if (in_cell && cell
+        && key == CellKey{cell->level, cell->x, cell->y, cell->z}) {
+        return;
+    }
+    if (!in_cell && parent == m_root) return;
+
+    osg::ref_ptr<osg::Node> keep = node;
+    Remove(node);
+    if (in_cell) {
+        GetOrCreateCell(key)->addChild(node);
+    }
+    else {
+        m_root->addChild(node);
+    }
+}
+
+void SceneOctree::Update(const std::vector<osg::Node *> &nodes)
+{
+    // the nodes to move, kept alive while detached
+    std::vector<osg::ref_ptr<osg::Node>> moved;
+    std::vector<osg::Node *> moved_nodes;
+    std::unordered_map<OctreeCell *, std::unordered_set<const osg::Node *>>
+        leaving;
+    for (osg::Node *node : nodes) {
+        osg::Group *parent = ParentOf(node);
+        if (parent == nullptr) continue;
+
+        CellKey key;
+        const bool in_cell = KeyOf(node->getBound(), key);
+        OctreeCell *cell = dynamic_cast<OctreeCell *>(parent);
+        if (in_cell && cell
+            && key == CellKey{cell->level, cell->x, cell->y, cell->z}) {
+            continue;
+        }
+        if (!in_cell && parent == m_root) continue;
+
+        // listed once, even if the node is given twice
+        if (cell && !leaving[cell].insert(node).second) continue;
+        moved.push_back(node);
+        moved_nodes.push_back(node);
+        if (!cell) m_root->removeChild(node);
+    }
+    if (moved.empty()) return;
+
+    // pruned once all nodes left, as a cell may be the ancestor of another
+    std::vector<osg::ref_ptr<OctreeCell>> cells;
+    cells.reserve(leaving.size());
+    for (const auto &it : leaving) {
+        it.first->RemoveChildren(it.second);
+        cells.push_back(it.first);
+    }
+    for (const auto &cell : cells) {
+        // already dropped with a descendant
+        if (cell->getNumParents() == 0) continue;
+        Prune(cell.get());
+    }
+    Insert(moved_nodes);
+}
+
+bool SceneOctree::InRoot(const osg::BoundingSphere &bs)
+{
+    CellKey key;
+    return !KeyOf(bs, key);
+}
+
+void SceneOctree::Clear() { m_cells.clear(); }
+
+} // namespace Vis
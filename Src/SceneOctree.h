@@ -0,0 +1,97 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Group>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Vis
+{
+
+class OctreeCell;
+
+/**
+ * A loose octree of groups between the scene root and the objects, so that
+ * culling rejects whole regions and moving an object only dirties the bounds
+ * of its own branch.
+ *
+ * An object goes to the smallest level whose cells are at least as wide as
+ * its bounding sphere, in the cell holding its center; since the object
+ * spans at most half a cell past it, cells are loose by a factor of two.
+ * To keep branches short the levels are 8 times apart, from 1/4096 to 4096
+ * units wide, so each level merges three levels of a binary octree. Cells
+ * are made on demand, each one the child of the cell containing it one
+ * level up, and dropped once empty. Objects without a valid bound, e.g.
+ * still loading, or wider than the top cells are children of the root.
+ *
+ * The groups always bound their children, so an object left in a cell it
+ * moved out of is still drawn and culled right, only less efficiently.
+ */
+class SceneOctree
+{
+public:
+    void SetRoot(osg::Group *root) { m_root = root; }
+
+    /// Attach a node to the cell its bound belongs to, or to the root.
+    void Insert(osg::Node *node);
+
+    /// Insert nodes at once, e.g. the objects of a batch: each cell is looked
+    /// up and grown once for all its nodes.
+    void Insert(const std::vector<osg::Node *> &nodes);
+
+    /// Detach a node inserted before, dropping the cells left empty.
+    void Remove(osg::Node *node);
+
+    /// Move a node inserted before to its cell after its bound changed.
+    /// Nodes that were not inserted, e.g. chained objects, are ignored.
+    void Update(osg::Node *node);
+
+    /// Update nodes at once, e.g. the objects of SetTransforms: the nodes
+    /// leaving a cell are removed from it in a single pass over its children.
+    void Update(const std::vector<osg::Node *> &nodes);
+
+    /// Whether a node with this bound is a child of the root.
+    static bool InRoot(const osg::BoundingSphere &bs);
+
+    /// Forget all cells, the root is left to the caller.
+    void Clear();
+
+    size_t NumCells() const { return m_cells.size(); }
+
+private:
+    struct CellKey
+    {
+        int level;
+        int64_t x, y, z;
+
+        bool operator==(const CellKey &o) const
+        {
+            return level == o.level && x == o.x && y == o.y && z == o.z;
+        }
+    };
+
+    struct CellKeyHasher
+    {
+        size_t operator()(const CellKey &k) const;
+    };
+
+    /// The cell of a bound, false if it belongs to the root.
+    static bool KeyOf(const osg::BoundingSphere &bs, CellKey &key);
+
+    /// The cell or root node is a child of, nullptr if neither.
+    osg::Group *ParentOf(osg::Node *node) const;
+
+    OctreeCell *GetOrCreateCell(const CellKey &key);
+
+    /// Drop cell and its ancestors while they are empty.
+    void Prune(OctreeCell *cell);
+
+    osg::Group *m_root{nullptr}; // owned by the caller
+    std::unordered_map<CellKey, osg::ref_ptr<osg::Group>, CellKeyHasher>
+        m_cells;
+};
+
+} // namespace Vis
@@ -0,0 +1,193 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace Vis
+{
+
+/**
+ * A generational slot map from handles to values.
+ *
+ * Values live in a dense array of slots, freed slots are recycled through a
+ * free list. The uid of a handle packs the slot index (low 32 bits, stored
+ * plus one so that a uid of 0 is never valid) and the generation of the slot
+ * (high 32 bits). Erasing bumps the generation of the slot, so a handle to an
+ * erased value stays invalid even after its slot has been reused. Resolving a
+ * handle is a single indexed load and a compare.
+ *
+ * Key must have uint64_t members type and uid and a Key(type, uid)
+ * constructor, see Handle.
+ */
+template <typename T, typename Key>
+class SlotMap
+{
+public:
+    /// Store value and return its new handle, of the given type.
+    Key Insert(uint64_t type, T value)
+    {
+        uint32_t index;
+        // InsertAt(...) leaves the slots it takes in the free list
+        while (!m_free.empty() && m_slots[m_free.back()].occupied) {
+            m_free.pop_back();
+        }
+        if (!m_free.empty()) {
+            index = m_free.back();
+            m_free.pop_back();
+        }
+        else {
+            index = static_cast<uint32_t>(m_slots.size());
+            m_slots.emplace_back();
+        }
+        Slot &slot = m_slots[index];
+        slot.value = std::move(value);
+        slot.type = type;
+        slot.occupied = true;
+        ++m_size;
+        return Key(type, MakeUid(index, slot.generation));
+    }
+
+    /**
+     * Store value under a key given out before, e.g. by a saved scene. Its
+     * slot must be free, the slot takes the generation of key, so handles to
+     * earlier values of the slot may become valid again.
+     * @return false if key is invalid or its slot is in use
+     */
+    bool InsertAt(const Key &key, T value)
+    {
+        const uint32_t index1 = static_cast<uint32_t>(key.uid);
+        if (index1 == 0) return false;
+        const uint32_t index = index1 - 1;
+        if (index >= m_slots.size()) {
+            for (size_t i = m_slots.size(); i < index; ++i) {
+                m_free.push_back(static_cast<uint32_t>(i));
+            }
+            m_slots.resize(static_cast<size_t>(index) + 1);
+        }
+        Slot &slot = m_slots[index];
+        if (slot.occupied) return false;
+        slot.value = std::move(value);
+        slot.type = key.type;
+        slot.generation = static_cast<uint32_t>(key.uid >> 32);
+        slot.occupied = true;
+        ++m_size;
+        return true;
+    }
+
+    /// Return the value of key, nullptr if key is invalid or was erased.
+    T *Find(const Key &key)
+    {
+        Slot *slot = Resolve(key);
+        return slot ? &slot->value : nullptr;
+    }
+
+    const T *Find(const Key &key) const
+    {
+        const Slot *slot = const_cast<SlotMap *>(this)->Resolve(key);
+        return slot ? &slot->value : nullptr;
+    }
+
+    bool Contains(const Key &key) const { return Find(key) != nullptr; }
+
+    bool Erase(const Key &key)
+    {
+        Slot *slot = Resolve(key);
+        if (slot == nullptr) return false;
+        Release(*slot);
+        m_free.push_back(static_cast<uint32_t>(slot - m_slots.data()));
+        --m_size;
+        return true;
+    }
+
+    /// Erase all values. Handles given out before stay invalid.
+    void Clear()
+    {
+        m_free.clear();
+        m_free.reserve(m_slots.size());
+        for (size_t i = m_slots.size(); i > 0; --i) {
+            Slot &slot = m_slots[i - 1];
+            if (slot.occupied) Release(slot);
+            // lowest indices are reused first
+            m_free.push_back(static_cast<uint32_t>(i - 1));
+        }
+        m_size = 0;
+    }
+
+    size_t Size() const { return m_size; }
+
+    bool Empty() const { return m_size == 0; }
+
+    void Reserve(size_t num)
+    {
+        m_slots.reserve(num);
+        m_free.reserve(num);
+    }
+
+    /// Call f(key, value) for every stored value, in slot order.
+    template <typename F>
+    void ForEach(F &&f) const
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            const Slot &slot = m_slots[i];
+            if (!slot.occupied) continue;
+            f(Key(slot.type,
+                  MakeUid(static_cast<uint32_t>(i), slot.generation)),
+              slot.value);
+        }
+    }
+
+    template <typename F>
+    void ForEach(F &&f)
+    {
+        for (size_t i = 0; i < m_slots.size(); ++i) {
+            Slot &slot = m_slots[i];
+            if (!slot.occupied) continue;
+            f(Key(slot.type,
+                  MakeUid(static_cast<uint32_t>(i), slot.generation)),
+              slot.value);
+        }
+    }
+
+private:
+    struct Slot
+    {
+        T value{};
+        uint64_t type{0};
+        uint32_t generation{0};
+        bool occupied{false};
+    };
+
+    static uint64_t MakeUid(uint32_t index, uint32_t generation)
+    {
+        return (static_cast<uint64_t>(generation) << 32)
+               | (static_cast<uint64_t>(index) + 1);
+    }
+
+    Slot *Resolve(const Key &key)
+    {
+        const uint32_t index = static_cast<uint32_t>(key.uid);
+        if (index == 0 || index > m_slots.size()) return nullptr;
+        Slot &slot = m_slots[index - 1];
+        if (!slot.occupied || slot.type != key.type
+            || slot.generation != static_cast<uint32_t>(key.uid >> 32)) {
+            return nullptr;
+        }
+        return &slot;
+    }
+
+    static void Release(Slot &slot)
+    {
+        slot.value = T{};
+        slot.occupied = false;
+        ++slot.generation;
+    }
+
+    std::vector<Slot> m_slots;
+    std::vector<uint32_t> m_free;
+    size_t m_size{0};
+};
+
+} // namespace Vis
@@ -0,0 +1,469 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "StlReader.h"
+
+#include "Logger.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+
+#include <osg/BoundingBox>
+#include <osg/Geometry>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Vis
+{
+
+static const size_t sg_min_triangles = 1 << 16; // per parallel chunk
+static const size_t sg_min_bytes = 1 << 22;     // of ASCII per chunk
+static const unsigned int sg_grid_bits = 21;    // per axis of a cell key
+static const float sg_crease_cos = 0.866f;      // cos(30 degrees)
+static const uint64_t sg_empty_key = ~uint64_t(0); // cell keys use 63 bits
+
+static inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f'
+           || c == '\v';
+}
+
+static inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+/// Parse a decimal number at p, whatever the C locale set by Qt is.
+static bool ParseFloat(const char *&p, const char *end, float &value)
+{
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    uint64_t mantissa = 0;
+    int digits = 0; // significant digits in mantissa
+    int exponent = 0;
+    bool any = false;
+    for (; p != end && IsDigit(*p); ++p, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else {
+            ++exponent;
+        }
+    }
+    if (p != end && *p == '.') {
+        for (++p; p != end && IsDigit(*p); ++p, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if (!any) return false;
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negative_exponent = false;
+        if (p != end && (*p == '-' || *p == '+')) {
+            negative_exponent = *p++ == '-';
+        }
+        if (p == end || !IsDigit(*p)) return false;
+        int e = 0;
+        for (; p != end && IsDigit(*p); ++p) {
+            e = std::min(e * 10 + (*p - '0'), 100000);
+        }
+        exponent += negative_exponent ? -e : e;
+    }
+    if (p != end && !IsSpace(*p)) return false;
+    const double v = static_cast<double>(mantissa) * std::pow(10.0, exponent);
+    value = static_cast<float>(negative ? -v : v);
+    return true;
+}
+
+/// Parse the corners given by the "vertex x y z" lines of [begin, end).
+static bool ParseAscii(const char *begin, const char *end,
+                       std::vector<osg::Vec3> &corners)
+{
+    static const char keyword[] = "vertex";
+    const char *p = begin;
+    for (;;) {
+        p = std::search(p, end, keyword, keyword + sizeof(keyword) - 1);
+        if (p == end) return true;
+        const bool word = p == begin || IsSpace(p[-1]);
+        p += sizeof(keyword) - 1;
+        if (!word) continue;
+        osg::Vec3 v;
+        for (int k = 0; k < 3; ++k) {
+            while (p != end && IsSpace(*p)) ++p;
+            if (!ParseFloat(p, end, v[k])) return false;
+        }
+        corners.push_back(v);
+    }
+}
+
+/// Split the file at "endfacet" so that every chunk has whole facets, and
+/// parse the chunks in parallel.
+static bool DecodeAscii(const char *data, size_t size,
+                        std::vector<osg::Vec3> &corners)
+{
+    static const char endfacet[] = "endfacet";
+    const char *end = data + size;
+    const size_t num_chunks = ParallelChunks(size, sg_min_bytes);
+    std::vector<const char *> bounds(num_chunks + 1, end);
+    bounds[0] = data;
+    for (size_t c = 1; c < num_chunks; ++c) {
+        const char *from =
+            std::max(bounds[c - 1], data + size * c / num_chunks);
+        const char *at =
+            std::search(from, end, endfacet, endfacet + sizeof(endfacet) - 1);
+        bounds[c] = at == end ? end : at + sizeof(endfacet) - 1;
+    }
+
+    std::vector<std::vector<osg::Vec3>> chunks(num_chunks);
+    std::vector<char> ok(num_chunks, 0);
+    ParallelFor(num_chunks, num_chunks, [&](size_t first, size_t last, size_t) {
+        for (size_t c = first; c < last; ++c) {
+            ok[c] = ParseAscii(bounds[c], bounds[c + 1], chunks[c])
+                    && chunks[c].size() % 3 == 0;
+        }
+    });
+    size_t total = 0;
+    for (size_t c = 0; c < num_chunks; ++c) {
+        if (!ok[c]) return false;
+        total += chunks[c].size();
+    }
+    corners.reserve(total);
+    for (auto &chunk : chunks) {
+        corners.insert(corners.end(), chunk.begin(), chunk.end());
+        std::vector<osg::Vec3>().swap(chunk);
+    }
+    return true;
+}
+
+/// Binary STL is little endian, like the machines the viewer runs on.
+static void DecodeBinary(const char *data, size_t num_triangles,
+                         std::vector<osg::Vec3> &corners)
+{
+    corners.resize(num_triangles * 3);
+    ParallelFor(num_triangles, ParallelChunks(num_triangles, sg_min_triangles),
+                [&](size_t begin, size_t end, size_t) {
+                    for (size_t i = begin; i < end; ++i) {
+                        // normal, 3 vertices and 2 attribute bytes
+                        const char *triangle = data + 84 + 50 * i;
+                        std::memcpy(&corners[3 * i], triangle + 12,
+                                    3 * sizeof(osg::Vec3));
+                    }
+                });
+}
+
+/// splitmix64 finalizer, spreads the bits of grid cell keys.
+static inline uint64_t Mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+/// Cell of the weld grid containing a vertex.
+struct WeldGrid
+{
+    uint64_t Key(const osg::Vec3 &v) const
+    {
+        const float max_cell = static_cast<float>((1u << sg_grid_bits) - 1);
+        uint64_t key = 0;
+        for (int k = 0; k < 3; ++k) {
+            const float q = std::min((v[k] - origin[k]) * scale, max_cell);
+            key = (key << sg_grid_bits) | static_cast<uint64_t>(q >= 0 ? q : 0);
+        }
+        return key;
+    }
+
+    osg::Vec3 origin;
+    float scale;
+};
+
+/// Open addressing map from grid cells to vertex indices.
+class WeldTable
+{
+public:
+    explicit WeldTable(size_t capacity)
+    {
+        size_t size = 16;
+        while (size < capacity * 2) size *= 2;
+        m_slots.resize(size);
+    }
+
+    /// Return the vertex of the cell, or insert id if the cell has none.
+    uint32_t Find(uint64_t key, uint32_t id)
+    {
+        if ((m_used + 1) * 2 > m_slots.size()) Grow();
+        Slot &slot = Probe(key);
+        if (slot.key == sg_empty_key) {
+            slot.key = key;
+            slot.id = id;
+            ++m_used;
+        }
+        return slot.id;
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t key{sg_empty_key};
+        uint32_t id{0};
+    };
+
+    Slot &Probe(uint64_t key)
+    {
+        const size_t mask = m_slots.size() - 1;
+        size_t i = Mix(key) & mask;
+        while (m_slots[i].key != sg_empty_key && m_slots[i].key != key) {
+            i = (i + 1) & mask;
+        }
+        return m_slots[i];
+    }
+
+    void Grow()
+    {
+        std::vector<Slot> slots(m_slots.size() * 2);
+        slots.swap(m_slots);
+        for (const Slot &slot : slots) {
+            if (slot.key != sg_empty_key) Probe(slot.key) = slot;
+        }
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_used{0};
+};
+
+struct WeldedPart
+{
+    std::vector<osg::Vec3> vertices;
+    std::vector<osg::Vec3> normals;
+};
+
+/**
+ * Weld the corners of partition part, writing their vertex index in the
+ * partition to indices, and compute the normals of its vertices.
+ */
+static void WeldPart(const std::vector<osg::Vec3> &corners,
+                     const std::vector<osg::Vec3> &facets,
+                     const std::vector<uint8_t> &parts, uint8_t part,
+                     size_t count, const WeldGrid &grid, GLuint *indices,
+                     WeldedPart &out)
+{
+    const size_t num_corners = corners.size();
+    std::vector<osg::Vec3> vertices;
+    std::vector<osg::Vec3> normals;
+    {
+        WeldTable table(count / 4);
+        for (size_t i = 0; i < num_corners; ++i) {
+            if (parts[i] != part) continue;
+            const uint32_t next = static_cast<uint32_t>(vertices.size());
+            const uint32_t id = table.Find(grid.Key(corners[i]), next);
+            if (id == next) {
+                vertices.push_back(corners[i]);
+                normals.push_back(osg::Vec3());
+            }
+            indices[i] = id;
+            normals[id] += facets[i / 3];
+        }
+    }
+    for (auto &n : normals) {
+        n.normalize();
+    }
+
+    // split the vertices on sharp edges, corners of triangles facing the
+    // same way share the split vertex
+    std::unordered_map<uint64_t, uint32_t> splits;
+    for (size_t i = 0; i < num_corners; ++i) {
+        if (parts[i] != part) continue;
+        osg::Vec3 n = facets[i / 3];
+        if (n.normalize() == 0.f || n * normals[indices[i]] >= sg_crease_cos) {
+            continue;
+        }
+        uint64_t key = indices[i];
+        for (int k = 0; k < 3; ++k) {
+            key = (key << 10) | static_cast<uint64_t>((n[k] + 1.f) * 511.f);
+        }
+        const uint32_t next = static_cast<uint32_t>(vertices.size());
+        auto it = splits.emplace(key, next);
+        if (it.second) {
+            const osg::Vec3 v = vertices[indices[i]];
+            vertices.push_back(v);
+        }
+        indices[i] = it.first->second;
+    }
+
+    // keep the vertices still used, in the order of their first use, and
+    // average the normals of their triangles
+    std::vector<uint32_t> remap(vertices.size(),
+                                std::numeric_limits<uint32_t>::max());
+    out.vertices.reserve(vertices.size());
+    out.normals.reserve(vertices.size());
+    for (size_t i = 0; i < num_corners; ++i) {
+        if (parts[i] != part) continue;
+        uint32_t &r = remap[indices[i]];
+        if (r == std::numeric_limits<uint32_t>::max()) {
+            r = static_cast<uint32_t>(out.vertices.size());
+            out.vertices.push_back(vertices[indices[i]]);
+            out.normals.push_back(osg::Vec3());
+        }
+        indices[i] = r;
+        out.normals[r] += facets[i / 3];
+    }
+    for (auto &n : out.normals) {
+        n.normalize();
+    }
+}
+
+/// Build an indexed geometry of a triangle soup.
+static osg::ref_ptr<osg::Geometry>
+CreateWeldedGeometry(const std::vector<osg::Vec3> &corners)
+{
+    const size_t num_corners = corners.size();
+    const size_t num_triangles = num_corners / 3;
+    const size_t num_chunks = ParallelChunks(num_triangles, sg_min_triangles);
+
+    // normals weighted by the area of the triangles and the bounding box
+    std::vector<osg::Vec3> facets(num_triangles);
+    std::vector<osg::BoundingBox> boxes(num_chunks);
+    ParallelFor(num_triangles, num_chunks,
+                [&](size_t begin, size_t end, size_t c) {
+                    for (size_t i = begin; i < end; ++i) {
+                        const osg::Vec3 *v = &corners[3 * i];
+                        facets[i] = (v[1] - v[0]) ^ (v[2] - v[0]);
+                        boxes[c].expandBy(v[0]);
+                        boxes[c].expandBy(v[1]);
+                        boxes[c].expandBy(v[2]);
+                    }
+                });
+    osg::BoundingBox box;
+    for (const auto &b : boxes) {
+        box.expandBy(b);
+    }
+    const float extent = std::max({box.xMax() - box.xMin(),
+                                   box.yMax() - box.yMin(),
+                                   box.zMax() - box.zMin()});
+    WeldGrid grid;
+    grid.origin = box._min;
+    grid.scale = extent > 0.f ? ((1u << sg_grid_bits) - 1) / extent : 0.f;
+
+    // Every partition of the cells is welded by one thread, without locks.
+    const size_t num_parts = std::min<size_t>(num_chunks, 256);
+    std::vector<uint8_t> parts(num_corners);
+    std::vector<std::vector<size_t>> counts(num_chunks,
+                                            std::vector<size_t>(num_parts));
+    ParallelFor(num_corners, num_chunks,
+                [&](size_t begin, size_t end, size_t c) {
+                    for (size_t i = begin; i < end; ++i) {
+                        const uint64_t h = Mix(grid.Key(corners[i]));
+                        parts[i] = static_cast<uint8_t>((h >> 32) % num_parts);
+                        ++counts[c][parts[i]];
+                    }
+                });
+
+    osg::ref_ptr<osg::DrawElementsUInt> indices =
+        new osg::DrawElementsUInt(GL_TRIANGLES, num_corners);
+    GLuint *local = &indices->front();
+    std::vector<WeldedPart> welded(num_parts);
+    ParallelFor(num_parts, num_parts, [&](size_t begin, size_t end, size_t) {
+        for (size_t p = begin; p < end; ++p) {
+            size_t count = 0;
+            for (const auto &chunk : counts) {
+                count += chunk[p];
+            }
+            WeldPart(corners, facets, parts, static_cast<uint8_t>(p), count,
+                     grid, local, welded[p]);
+        }
+    });
+
+    std::vector<GLuint> offsets(num_parts + 1, 0);
+    for (size_t p = 0; p < num_parts; ++p) {
+        offsets[p + 1] =
+            offsets[p] + static_cast<GLuint>(welded[p].vertices.size());
+    }
+    osg::ref_ptr<osg::Vec3Array> vertices =
+        new osg::Vec3Array(offsets[num_parts]);
+    osg::ref_ptr<osg::Vec3Array> normals =
+        new osg::Vec3Array(offsets[num_parts]);
+    ParallelFor(num_parts, num_parts, [&](size_t begin, size_t end, size_t) {
+        for (size_t p = begin; p < end; ++p) {
+            std::copy(welded[p].vertices.begin(), welded[p].vertices.end(),
+                      vertices->begin() + offsets[p]);
+            std::copy(welded[p].normals.begin(), welded[p].normals.end(),
+                      normals->begin() + offsets[p]);
+            welded[p] = WeldedPart();
+        }
+    });
+    ParallelFor(num_corners, num_chunks,
+                [&](size_t begin, size_t end, size_t) {
+                    for (size_t i = begin; i < end; ++i) {
+                        local[i] += offsets[parts[i]];
+                    }
+                });
+
+    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
+    geom->setVertexArray(vertices.get());
+    geom->setNormalArray(normals.get(), osg::Array::BIND_PER_VERTEX);
+    geom->addPrimitiveSet(indices.get());
+    return geom;
+}
+
+osg::ref_ptr<osg::Geode> ReadStlFile(const std::string &path)
+{
+    std::vector<osg::Vec3> corners;
+    {
+        MappedFile file(path);
+        if (!file.IsOpen()) {
+            LOG_WARN("Can not map {0}.", path);
+            return nullptr;
+        }
+        const char *data = file.Data();
+        const size_t size = file.Size();
+        uint32_t num_triangles = 0;
+        if (size >= 84) std::memcpy(&num_triangles, data + 80, 4);
+
+        if (size >= 84 && size == 84 + size_t(50) * num_triangles) {
+            static const char color[] = "COLOR=";
+            if (std::search(data, data + 80, color, color + 6) != data + 80) {
+                LOG_DEBUG("{0} has colors, leave it to the plugin.", path);
+                return nullptr;
+            }
+            DecodeBinary(data, num_triangles, corners);
+        }
+        else {
+            const char *p = data;
+            while (p != data + size && IsSpace(*p)) ++p;
+            if (size_t(data + size - p) < 5 || std::memcmp(p, "solid", 5)) {
+                LOG_WARN("{0} is not an STL file.", path);
+                return nullptr;
+            }
+            if (!DecodeAscii(data, size, corners)) {
+                LOG_WARN("Can not parse {0}.", path);
+                return nullptr;
+            }
+        }
+    }
+    if (corners.empty()) {
+        LOG_WARN("{0} has no triangles.", path);
+        return nullptr;
+    }
+    if (corners.size() > std::numeric_limits<GLuint>::max()) {
+        LOG_WARN("{0} has too many triangles: {1}.", path, corners.size() / 3);
+        return nullptr;
+    }
+
+    osg::ref_ptr<osg::Geometry> geom = CreateWeldedGeometry(corners);
+    LOG_DEBUG("Read {0}: {1} triangles, {2} vertices.", path,
+              corners.size() / 3, geom->getVertexArray()->getNumElements());
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    geode->addDrawable(geom.get());
+    return geode;
+}
+
+} // namespace Vis
@@ -0,0 +1,27 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Geode>
+#include <osg/ref_ptr>
+
+#include <string>
+
+namespace Vis
+{
+
+/**
+ * Read a binary or ASCII STL file into a single indexed triangle geometry.
+ *
+ * The file is mapped and its triangles are decoded in parallel chunks.
+ * Vertices falling in the same cell of a grid about a millionth of the model
+ * size wide are welded. Normals are averaged over the triangles sharing a
+ * vertex, weighted by their area, except across edges sharper than 30
+ * degrees where the vertex is split so that both sides stay flat.
+ *
+ * Binary files with per-facet colors are left to the osgDB plugin.
+ *
+ * @return nullptr if the file can not be read this way, which is logged
+ */
+osg::ref_ptr<osg::Geode> ReadStlFile(const std::string &path);
+
+} // namespace Vis
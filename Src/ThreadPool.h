@@ -0,0 +1,90 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Vis
+{
+
+/**
+ * Fixed size pool of worker threads running tasks in submission order.
+ *
+ * The threads are started by the first Submit, so a pool that is never used
+ * costs nothing. Destroying the pool drops the tasks not started yet and
+ * waits for the running ones.
+ */
+class ThreadPool
+{
+public:
+    /// @param num_threads 0 for one thread per hardware thread
+    explicit ThreadPool(size_t num_threads = 0)
+        : m_num_threads(num_threads > 0
+                            ? num_threads
+                            : std::max(1u, std::thread::hardware_concurrency()))
+    {
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+            m_tasks.clear();
+        }
+        m_cv.notify_all();
+        for (auto &t : m_threads) {
+            t.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void Submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_threads.empty()) {
+                for (size_t i = 0; i < m_num_threads; ++i) {
+                    m_threads.emplace_back(&ThreadPool::Run, this);
+                }
+            }
+            m_tasks.push_back(std::move(task));
+        }
+        m_cv.notify_one();
+    }
+
+    size_t Size() const { return m_num_threads; }
+
+private:
+    void Run()
+    {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+                if (m_stop) return;
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    const size_t m_num_threads;
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop{false};
+};
+
+} // namespace Vis
@@ -0,0 +1,98 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "Trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace Vis
+{
+
+Trajectory::Trajectory(size_t num_objects, std::vector<double> timestamps,
+                       std::vector<float> poses, Interpolation interpolation)
+    : m_num_objects(num_objects), m_times(std::move(timestamps)),
+      m_poses(std::move(poses)), m_interpolation(interpolation)
+{
+    // unit quaternions, as slerp expects
+    for (size_t i = 0; i + 7 <= m_poses.size(); i += 7) {
+        float *q = m_poses.data() + i + 3;
+        const float len =
+            std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+        if (len > 0.f) {
+            for (int j = 0; j < 4; ++j) q[j] /= len;
+        }
+    }
+}
+
+osg::Vec3d Trajectory::Tangent(size_t key, size_t object) const
+{
+    // finite difference of the neighbouring keyframes, one sided at the ends
+    const size_t prev = key > 0 ? key - 1 : key;
+    const size_t next = key + 1 < m_times.size() ? key + 1 : key;
+    const float *a = Pose(prev, object);
+    const float *b = Pose(next, object);
+    const double dt = m_times[next] - m_times[prev];
+    return osg::Vec3d(b[0] - a[0], b[1] - a[1], b[2] - a[2]) / dt;
+}
+
+void Trajectory::Sample(double t, osg::Matrix *matrices)
+{
+    const size_t num_keys = m_times.size();
+    size_t k = 0;
+    double u = 0.0; // in the segment from key k to k + 1
+    if (num_keys == 1 || t <= m_times.front()) {
+        k = 0;
+        u = 0.0;
+    }
+    else if (t >= m_times.back()) {
+        k = num_keys - 2;
+        u = 1.0;
+    }
+    else {
+        k = std::min(m_segment, num_keys - 2);
+        if (t < m_times[k] || t >= m_times[k + 1]) {
+            if (t >= m_times[k + 1] && k + 2 < num_keys
+                && t < m_times[k + 2]) {
+                ++k;
+            }
+            else if (t < m_times[k] && k > 0 && t >= m_times[k - 1]) {
+                --k;
+            }
+            else {
+                k = std::upper_bound(m_times.begin(), m_times.end(), t)
+                    - m_times.begin() - 1;
+            }
+        }
+        u = (t - m_times[k]) / (m_times[k + 1] - m_times[k]);
+    }
+    m_segment = k;
+
+    const size_t k1 = num_keys == 1 ? k : k + 1;
+    const double dt = m_times[k1] - m_times[k];
+    // cubic Hermite basis
+    const double u2 = u * u, u3 = u2 * u;
+    const double h00 = 2 * u3 - 3 * u2 + 1, h10 = u3 - 2 * u2 + u;
+    const double h01 = -2 * u3 + 3 * u2, h11 = u3 - u2;
+
+    for (size_t i = 0; i < m_num_objects; ++i) {
+        const float *a = Pose(k, i);
+        const float *b = Pose(k1, i);
+        const osg::Vec3d p0(a[0], a[1], a[2]), p1(b[0], b[1], b[2]);
+        osg::Vec3d p;
+        if (m_interpolation == Interpolation_Spline && num_keys > 1) {
+            p = p0 * h00 + Tangent(k, i) * (h10 * dt) + p1 * h01
+                + Tangent(k1, i) * (h11 * dt);
+        }
+        else {
+            p = p0 + (p1 - p0) * u;
+        }
+        osg::Quat q;
+        q.slerp(u, osg::Quat(a[3], a[4], a[5], a[6]),
+                osg::Quat(b[3], b[4], b[5], b[6]));
+        matrices[i].makeRotate(q);
+        matrices[i].setTrans(p);
+    }
+}
+
+} // namespace Vis
@@ -0,0 +1,63 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <osg/Matrix>
+
+#include <stddef.h>
+#include <vector>
+
+namespace Vis
+{
+
+enum Interpolation
+{
+    Interpolation_Linear = 0, // lerp the positions, slerp the rotations
+    Interpolation_Spline,     // cubic Hermite positions, slerp the rotations
+};
+
+/**
+ * The keyframed poses of a set of objects.
+ *
+ * Each keyframe holds a pose (x, y, z, qx, qy, qz, qw) for each object.
+ * Sampling at a time between two keyframes interpolates them, before the
+ * first or after the last it holds the first or the last poses. Sampling
+ * remembers the last segment, so playing forward or backward finds the next
+ * one without a search.
+ */
+class Trajectory
+{
+public:
+    Trajectory() = default;
+
+    /**
+     * @param timestamps strictly increasing times of the keyframes, at least
+     * one
+     * @param poses timestamps.size() * num_objects * 7 floats
+     */
+    Trajectory(size_t num_objects, std::vector<double> timestamps,
+               std::vector<float> poses, Interpolation interpolation);
+
+    size_t NumObjects() const { return m_num_objects; }
+    double StartTime() const { return m_times.front(); }
+    double EndTime() const { return m_times.back(); }
+
+    /// Write the matrix of each object at time t.
+    void Sample(double t, osg::Matrix *matrices);
+
+private:
+    const float *Pose(size_t key, size_t object) const
+    {
+        return m_poses.data() + 7 * (key * m_num_objects + object);
+    }
+
+    /// Time derivative of the position of object at key, for the spline.
+    osg::Vec3d Tangent(size_t key, size_t object) const;
+
+    size_t m_num_objects{0};
+    std::vector<double> m_times;
+    std::vector<float> m_poses;
+    Interpolation m_interpolation{Interpolation_Linear};
+    size_t m_segment{0}; // of the last sample
+};
+
+} // namespace Vis
@@ -0,0 +1,157 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+
+#include "Transforms.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define VIS_TRANSFORMS_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define VIS_TRANSFORMS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace Vis
+{
+
+// Four floats, one lane per pose. Only the few operations the kernel needs.
+#if defined(VIS_TRANSFORMS_SSE2)
+
+struct F4
+{
+    __m128 v;
+};
+
+static inline F4 Load(const float *p) { return {_mm_loadu_ps(p)}; }
+static inline void Store(float *p, F4 a) { _mm_storeu_ps(p, a.v); }
+static inline F4 Set1(float a) { return {_mm_set1_ps(a)}; }
+static inline F4 operator+(F4 a, F4 b) { return {_mm_add_ps(a.v, b.v)}; }
+static inline F4 operator-(F4 a, F4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+static inline F4 operator*(F4 a, F4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+static inline F4 operator/(F4 a, F4 b) { return {_mm_div_ps(a.v, b.v)}; }
+
+/// a where cond > 0, else 0.
+static inline F4 WherePositive(F4 a, F4 cond)
+{
+    return {_mm_and_ps(a.v, _mm_cmpgt_ps(cond.v, _mm_setzero_ps()))};
+}
+
+static inline void Transpose(F4 &r0, F4 &r1, F4 &r2, F4 &r3)
+{
+    _MM_TRANSPOSE4_PS(r0.v, r1.v, r2.v, r3.v);
+}
+
+#elif defined(VIS_TRANSFORMS_NEON)
+
+struct F4
+{
+    float32x4_t v;
+};
+
+static inline F4 Load(const float *p) { return {vld1q_f32(p)}; }
+static inline void Store(float *p, F4 a) { vst1q_f32(p, a.v); }
+static inline F4 Set1(float a) { return {vdupq_n_f32(a)}; }
+static inline F4 operator+(F4 a, F4 b) { return {vaddq_f32(a.v, b.v)}; }
+static inline F4 operator-(F4 a, F4 b) { return {vsubq_f32(a.v, b.v)}; }
+static inline F4 operator*(F4 a, F4 b) { return {vmulq_f32(a.v, b.v)}; }
+static inline F4 operator/(F4 a, F4 b) { return {vdivq_f32(a.v, b.v)}; }
+
+/// a where cond > 0, else 0.
+static inline F4 WherePositive(F4 a, F4 cond)
+{
+    const uint32x4_t mask = vcgtq_f32(cond.v, vdupq_n_f32(0.f));
+    return {vreinterpretq_f32_u32(
+        vandq_u32(vreinterpretq_u32_f32(a.v), mask))};
+}
+
+static inline void Transpose(F4 &r0, F4 &r1, F4 &r2, F4 &r3)
+{
+    const float32x4x2_t t01 = vtrnq_f32(r0.v, r1.v);
+    const float32x4x2_t t23 = vtrnq_f32(r2.v, r3.v);
+    r0.v = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    r1.v = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    r2.v = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r3.v = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#endif
+
+/// The pose of one object, written out as osg::Matrixf::setRotate and
+/// setTrans would.
+static inline void PoseToMatrix(const float *p, const float *q, float *m)
+{
+    const float len2 = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+    const float s = len2 > 0.f ? 2.f / len2 : 0.f;
+    const float x2 = q[0] * s, y2 = q[1] * s, z2 = q[2] * s;
+    const float xx = q[0] * x2, xy = q[0] * y2, xz = q[0] * z2;
+    const float yy = q[1] * y2, yz = q[1] * z2, zz = q[2] * z2;
+    const float wx = q[3] * x2, wy = q[3] * y2, wz = q[3] * z2;
+
+    m[0] = 1.f - (yy + zz);
+    m[1] = xy + wz;
+    m[2] = xz - wy;
+    m[3] = 0.f;
+    m[4] = xy - wz;
+    m[5] = 1.f - (xx + zz);
+    m[6] = yz + wx;
+    m[7] = 0.f;
+    m[8] = xz + wy;
+    m[9] = yz - wx;
+    m[10] = 1.f - (xx + yy);
+    m[11] = 0.f;
+    m[12] = p[0];
+    m[13] = p[1];
+    m[14] = p[2];
+    m[15] = 1.f;
+}
+
+void PosesToMatrices(const float *positions, const float *quats, size_t n,
+                     float *matrices)
+{
+    size_t i = 0;
+#if defined(VIS_TRANSFORMS_SSE2) || defined(VIS_TRANSFORMS_NEON)
+    const F4 one = Set1(1.f), two = Set1(2.f), zero = Set1(0.f);
+    for (; i + 4 <= n; i += 4) {
+        // one pose per lane
+        F4 x = Load(quats + 4 * i);
+        F4 y = Load(quats + 4 * i + 4);
+        F4 z = Load(quats + 4 * i + 8);
+        F4 w = Load(quats + 4 * i + 12);
+        Transpose(x, y, z, w);
+
+        const F4 len2 = x * x + y * y + z * z + w * w;
+        const F4 s = WherePositive(two / len2, len2);
+        const F4 x2 = x * s, y2 = y * s, z2 = z * s;
+        const F4 xx = x * x2, xy = x * y2, xz = x * z2;
+        const F4 yy = y * y2, yz = y * z2, zz = z * z2;
+        const F4 wx = w * x2, wy = w * y2, wz = w * z2;
+
+        // the rows of the rotations, back to one pose per register
+        F4 r00 = one - (yy + zz), r01 = xy + wz, r02 = xz - wy, r03 = zero;
+        F4 r10 = xy - wz, r11 = one - (xx + zz), r12 = yz + wx, r13 = zero;
+        F4 r20 = xz + wy, r21 = yz - wx, r22 = one - (xx + yy), r23 = zero;
+        Transpose(r00, r01, r02, r03);
+        Transpose(r10, r11, r12, r13);
+        Transpose(r20, r21, r22, r23);
+
+        const F4 rows[3][4] = {{r00, r01, r02, r03},
+                               {r10, r11, r12, r13},
+                               {r20, r21, r22, r23}};
+        for (size_t k = 0; k < 4; ++k) {
+            float *m = matrices + 16 * (i + k);
+            const float *p = positions + 3 * (i + k);
+            Store(m, rows[0][k]);
+            Store(m + 4, rows[1][k]);
+            Store(m + 8, rows[2][k]);
+            m[12] = p[0];
+            m[13] = p[1];
+            m[14] = p[2];
+            m[15] = 1.f;
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        PoseToMatrix(positions + 3 * i, quats + 4 * i, matrices + 16 * i);
+    }
+}
+
+} // namespace Vis
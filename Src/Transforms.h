@@ -0,0 +1,25 @@
+// Copyright (c) RVBUST, Inc - All rights reserved.
+#pragma once
+
+#include <stddef.h>
+
+namespace Vis
+{
+
+/**
+ * Convert n poses to 4x4 matrices in the layout of osg::Matrixf, row major
+ * with the translation in the last row.
+ *
+ * The quaternions need not be unit ones, each is normalized as
+ * osg::Matrixf::setRotate does; a null quaternion gives no rotation. Four
+ * poses are converted at a time with SSE2 on x86-64 or NEON on AArch64, the
+ * remaining ones and other targets use the same formula one by one.
+ *
+ * @param positions n (x, y, z) positions
+ * @param quats n (x, y, z, w) quaternions
+ * @param matrices 16 * n floats, overwritten
+ */
+void PosesToMatrices(const float *positions, const float *quats, size_t n,
+                     float *matrices);
+
+} // namespace Vis
@@ -3,8 +3,17 @@
 #include "Vis.h"
 
 #include "Logger.h"
+#include "ExternalArray.h"
 #include "GizmoDrawable.h"
+#include "GridPlane.h"
+#include "Instancing.h"
+#include "MeshOptimizer.h"
+#include "PickHandler.h"
+#include "PointCloudLOD.h"
+#include "SceneFile.h"
+#include "StlReader.h"
 #include "TouchballManipulator.h"
+#include "Transforms.h"
 
 #include <unordered_map>
 #include <osg/ref_ptr>
@@ -13,23 +22,76 @@
 #include <osg/ShapeDrawable>
 #include <osg/LineWidth>
 #include <osg/Point>
+#include <osg/KdTree>
+#include <osg/OccluderNode>
+#include <osg/Stats>
 #include <osgViewer/Viewer>
+#include <osgDB/FileNameUtils>
 #include <osgDB/ReadFile>
-#include <osgUtil/SmoothingVisitor>
+#include <osgDB/Registry>
 #include <osgFX/Outline>
 #include <osgGA/TrackballManipulator>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <limits>
 #include <unordered_set>
-#include <filesystem>
 
-namespace fs = std::filesystem;
 using namespace Vis;
 
 static inline bool Vis3d__HasNode(const std::shared_ptr<Vis3d> vis3d,
                                   const Handle &nh)
 {
-    return vis3d->node_map.find(nh) != vis3d->node_map.end();
+    return vis3d->node_map.Contains(nh);
+}
+
+/// Return the node of nh with a single lookup, nullptr if nh is not alive.
+static inline osg::MatrixTransform *Vis3d__GetNode(
+    const std::shared_ptr<Vis3d> vis3d, const Handle &nh)
+{
+    osg::ref_ptr<osg::MatrixTransform> *node = vis3d->node_map.Find(nh);
+    return node ? node->get() : nullptr;
+}
+
+/// Whether mt is a child of node_switch itself, not of an octree cell or of
+/// another object.
+static inline bool Vis3d__IsTopLevel(const std::shared_ptr<Vis3d> vis3d,
+                                     const osg::MatrixTransform *mt)
+{
+    for (unsigned int i = 0; i < mt->getNumParents(); ++i) {
+        if (mt->getParent(i) == vis3d->node_switch.get()) return true;
+    }
+    return false;
+}
+
+/// Whether a child of an object's MatrixTransform is part of its content,
+/// rather than a chained object, which is a MatrixTransform with a HandleTag.
+static inline bool Vis3d__IsContent(const osg::Node *child)
+{
+    const osg::Transform *transform = child->asTransform();
+    return transform == nullptr || transform->asMatrixTransform() == nullptr
+           || dynamic_cast<const HandleTag *>(transform->getUserData())
+                  == nullptr;
+}
+
+/// Hidden objects keep their place in the scene graph, with a null mask no
+/// traversal visits them. The mask they had is kept in their HandleTag and
+/// given back when shown.
+static inline void Vis3d__SetVisible(osg::Node *node, bool visible)
+{
+    HandleTag *tag = dynamic_cast<HandleTag *>(node->getUserData());
+    if (!visible) {
+        if (node->getNodeMask() == 0u) return;
+        if (tag) tag->shown_mask = node->getNodeMask();
+        node->setNodeMask(0u);
+    }
+    else if (node->getNodeMask() == 0u) {
+        node->setNodeMask(tag ? tag->shown_mask : ~0u);
+    }
 }
 
 static inline bool Vis3d__HasOutline(const std::shared_ptr<Vis3d> vis3d,
@@ -38,9 +100,107 @@ static inline bool Vis3d__HasOutline(const std::shared_ptr<Vis3d> vis3d,
     return vis3d->outlinemap.find(vh) != vis3d->outlinemap.end();
 }
 
+/// Ask for a frame. The redraw is requested once per change, not once per
+/// mutation.
+static inline void Vis3d__RequestRedraw(Vis3d &vis3d)
+{
+    if (!vis3d.dirty.exchange(true)) {
+        std::lock_guard<std::mutex> lock(vis3d.redraw_mutex);
+        if (vis3d.request_redraw) {
+            vis3d.request_redraw();
+        }
+    }
+}
+
+/// Flag the scene as changed: objects were added, removed, shown, hidden or
+/// their content changed.
+static inline void Vis3d__MarkDirty(Vis3d &vis3d)
+{
+    ++vis3d.scene_revision;
+    Vis3d__RequestRedraw(vis3d);
+}
+
+static inline void Vis3d__MarkDirty(const std::shared_ptr<Vis3d> vis3d)
+{
+    Vis3d__MarkDirty(*vis3d);
+}
+
+/// Flag the scene as changed by moving objects or the camera only.
+static inline void Vis3d__MarkMoved(Vis3d &vis3d)
+{
+    ++vis3d.move_revision;
+    Vis3d__RequestRedraw(vis3d);
+}
+
+static inline void Vis3d__MarkMoved(const std::shared_ptr<Vis3d> vis3d)
+{
+    Vis3d__MarkMoved(*vis3d);
+}
+
+/// Queue a command for the next frame, from any thread.
+static void Vis3d__PostCommand(Vis3d &vis3d,
+                               std::function<void(View &)> command)
+{
+    vis3d.commands.Push(std::move(command));
+    // set after the push, so a frame that cleared the flag before this
+    // point either runs the command or sees the flag when it returns
+    vis3d.commands_pending = true;
+    Vis3d__RequestRedraw(vis3d);
+}
+
+/// Return 3 or 4 if colors holds a single color or one color for each of num
+/// elements, else 0.
+static size_t ResolveColorChannels(size_t colors_size, size_t num)
+{
+    if (colors_size == 0 || (colors_size % 3 != 0 && colors_size % 4 != 0)) {
+        return 0;
+    }
+    size_t color_channels = 0;
+    if (colors_size % 3 == 0 && colors_size % 4 == 0) {
+        if (colors_size / 3 == num) {
+            color_channels = 3;
+        }
+        else if (colors_size / 4 == num) {
+            color_channels = 4;
+        }
+        else {
+            return 0;
+        }
+    }
+    else {
+        color_channels = colors_size % 3 == 0 ? 3 : 4;
+    }
+    const size_t numcl = colors_size / color_channels;
+    return (numcl == 1 || numcl == num) ? color_channels : 0;
+}
+
+/// Objects drawn as one instanced geometry, see Instancing.h
+static inline bool IsInstancedType(uint64_t type)
+{
+    return type == ViewObjectType_Spheres || type == ViewObjectType_Boxes
+           || type == ViewObjectType_Cylinders || type == ViewObjectType_Cones;
+}
+
+/// The instance colors of an instanced object, nullptr for other objects.
+static osg::Vec4Array *Vis3d__GetInstanceColors(
+    const std::shared_ptr<Vis3d> vis3d, const Handle &nh,
+    osg::Geometry **geom = nullptr)
+{
+    if (!IsInstancedType(nh.type)) return nullptr;
+    osg::MatrixTransform *mt = Vis3d__GetNode(vis3d, nh);
+    if (geom) *geom = nullptr;
+    if (mt == nullptr || mt->getNumChildren() == 0) return nullptr;
+    // the content may still be a placeholder, see Vis3d__ReserveNode
+    osg::Geode *geode = mt->getChild(0)->asGeode();
+    if (geode == nullptr || geode->getNumDrawables() == 0) return nullptr;
+    osg::Drawable *drawable = geode->getDrawable(0);
+    if (geom) *geom = drawable ? drawable->asGeometry() : nullptr;
+    return GetInstanceColors(drawable);
+}
+
 void RemoveOutline(const std::shared_ptr<Vis3d> vis3d, const Handle h)
 {
-    auto node = vis3d->node_map[h];
+    osg::MatrixTransform *node = Vis3d__GetNode(vis3d, h);
     auto outline_tmp = vis3d->outlinemap[h];
     vis3d->outlinemap.erase(h);
     outline_tmp->removeChild(node);
@@ -51,20 +211,275 @@ void RemoveOutline(const std::shared_ptr<Vis3d> vis3d, const Handle h)
 
 static std::atomic<uint64_t> sg_uid{0};
 
-static inline uint64_t NextHandleID()
+static inline uint64_t NextObjectID()
 {
     return ++sg_uid; // valid from one
 }
 
-static inline uint64_t NextObjectID()
+/// Make a drawable follow the view's render policy. Dynamic drawables are the
+/// ones whose arrays get rewritten, e.g. by UpdatePoints(...).
+static void ApplyRenderPolicy(RenderPolicy policy, osg::Drawable &drawable,
+                              bool dynamic = false)
 {
-    return ++sg_uid; // valid from one
+    osg::Geometry *geom = drawable.asGeometry();
+    if (policy != RenderPolicy_VertexBufferObject || geom == nullptr) return;
+
+    geom->setUseDisplayList(false);
+    geom->setUseVertexBufferObjects(true);
+    if (dynamic) {
+        geom->setDataVariance(osg::Object::DYNAMIC);
+        osg::Array *vs = geom->getVertexArray();
+        if (vs && vs->getBufferObject()) {
+            vs->getBufferObject()->setUsage(GL_DYNAMIC_DRAW_ARB);
+        }
+    }
+}
+
+class RenderPolicyVisitor : public osg::NodeVisitor
+{
+public:
+    RenderPolicyVisitor(RenderPolicy policy)
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+          m_policy(policy)
+    {
+    }
+
+    void apply(osg::Drawable &drawable) override
+    {
+        ApplyRenderPolicy(m_policy, drawable);
+    }
+
+private:
+    RenderPolicy m_policy;
+};
+
+static inline void Vis3d__ApplyRenderPolicy(const std::shared_ptr<Vis3d> vis3d,
+                                            osg::Node *node)
+{
+    if (vis3d->render_policy == RenderPolicy_DisplayList) return;
+    RenderPolicyVisitor visitor(vis3d->render_policy);
+    node->accept(visitor);
+}
+
+/// The scene switch, parent of the octree cells and of the objects outside of
+/// them, which can make room for a whole batch of children at once.
+class SceneSwitch : public osg::Switch
+{
+public:
+    void Reserve(size_t num)
+    {
+        _children.reserve(num);
+        _values.reserve(num);
+    }
+
+    /// Remove all children found in targets in a single pass over the
+    /// children, where removeChild(...) would search the list for each one.
+    /// The traversal counters are updated as osg::Group::removeChildren does.
+    size_t RemoveChildren(const std::unordered_set<const osg::Node *> &targets)
+    {
+        unsigned int update_removed = 0;
+        unsigned int event_removed = 0;
+        unsigned int culling_disabled_removed = 0;
+        unsigned int occluders_removed = 0;
+        size_t kept = 0;
+        for (size_t i = 0; i < _children.size(); ++i) {
+            osg::Node *child = _children[i].get();
+            if (targets.find(child) != targets.end()) {
+                child->removeParent(this);
+                if (child->getNumChildrenRequiringUpdateTraversal() > 0
+                    || child->getUpdateCallback()) {
+                    ++update_removed;
+                }
+                if (child->getNumChildrenRequiringEventTraversal() > 0
+                    || child->getEventCallback()) {
+                    ++event_removed;
+                }
+                if (child->getNumChildrenWithCullingDisabled() > 0
+                    || !child->getCullingActive()) {
+                    ++culling_disabled_removed;
+                }
+                if (child->getNumChildrenWithOccluderNodes() > 0
+                    || dynamic_cast<osg::OccluderNode *>(child)) {
+                    ++occluders_removed;
+                }
+                continue;
+            }
+            if (kept != i) {
+                _children[kept] = _children[i];
+                _values[kept] = _values[i];
+            }
+            ++kept;
+        }
+
+        const size_t removed = _children.size() - kept;
+        _children.resize(kept);
+        _values.resize(kept);
+        if (update_removed > 0) {
+            setNumChildrenRequiringUpdateTraversal(
+                getNumChildrenRequiringUpdateTraversal() - update_removed);
+        }
+        if (event_removed > 0) {
+            setNumChildrenRequiringEventTraversal(
+                getNumChildrenRequiringEventTraversal() - event_removed);
+        }
+        if (culling_disabled_removed > 0) {
+            setNumChildrenWithCullingDisabled(
+                getNumChildrenWithCullingDisabled() - culling_disabled_removed);
+        }
+        if (occluders_removed > 0) {
+            setNumChildrenWithOccluderNodes(
+                getNumChildrenWithOccluderNodes() - occluders_removed);
+        }
+        if (removed > 0) {
+            dirtyBound();
+        }
+        return removed;
+    }
+};
+
+/**
+ * Prepare a node built for an object of the given type: apply the render
+ * policy, keep it away from the intersectors if PickHandler picks it itself
+ * and name it for debugging.
+ */
+static void Vis3d__PrepareContent(const std::shared_ptr<Vis3d> vis3d,
+                                  uint64_t type, osg::Node *node)
+{
+    Vis3d__ApplyRenderPolicy(vis3d, node);
+    if (type == ViewObjectType_Point || type == ViewObjectType_PointCloudLOD
+        || type == ViewObjectType_Gzimo || IsInstancedType(type)
+        || type == ViewObjectType_Ghosts) {
+        node->setNodeMask(node->getNodeMask() & ~NodeMask_Intersect);
+    }
+    if (!vis3d->batch.active || vis3d->debug_names) {
+        node->setName(std::to_string(NextObjectID()));
+    }
+}
+
+/**
+ * Register a freshly built object: prepare its nodes, attach it to the scene
+ * (or to the pending batch) and give it a handle.
+ */
+static Handle Vis3d__AddNode(const std::shared_ptr<Vis3d> vis3d, uint64_t type,
+                             osg::MatrixTransform *mt)
+{
+    for (unsigned int i = 0; i < mt->getNumChildren(); ++i) {
+        osg::Node *child = mt->getChild(i);
+        // shared with the source of a clone, already prepared
+        if (child->getNumParents() > 1) continue;
+        Vis3d__PrepareContent(vis3d, type, child);
+    }
+
+    const Handle h = vis3d->node_map.Insert(type, mt);
+    mt->setUserData(new HandleTag(h));
+    if (!vis3d->batch.active || vis3d->debug_names) {
+        mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
+    }
+
+    if (vis3d->batch.active) {
+        vis3d->batch.pending.push_back(mt);
+    }
+    else {
+        vis3d->octree.Insert(mt);
+    }
+    Vis3d__MarkDirty(vis3d);
+    return h;
+}
+
+/**
+ * Register an object whose content is built later by a worker. Its child 0
+ * is an empty group until Vis3d__Materialize(...) replaces it, so that chained
+ * objects are child 1 as usual.
+ */
+static Handle Vis3d__ReserveNode(const std::shared_ptr<Vis3d> vis3d,
+                                 uint64_t type, const osg::Matrix &m)
+{
+    osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform(m);
+    mt->addChild(new osg::Group);
+    const Handle h = Vis3d__AddNode(vis3d, type, mt);
+    vis3d->loading[h];
+    return h;
+}
+
+static inline bool Vis3d__IsLoading(const std::shared_ptr<Vis3d> vis3d,
+                                    const Handle &h)
+{
+    return vis3d->loading.find(h) != vis3d->loading.end();
 }
 
-View::View()
+/// Queue op if h is still being built and return true, else return false.
+static bool Vis3d__DeferWhileLoading(const std::shared_ptr<Vis3d> vis3d,
+                                     const Handle &h,
+                                     std::function<void(View &)> op)
+{
+    auto it = vis3d->loading.find(h);
+    if (it == vis3d->loading.end()) return false;
+    it->second.push_back(std::move(op));
+    return true;
+}
+
+/**
+ * Objects cloned with CloneMode_Shared share their content, all children but
+ * the chained objects, with their source. Give the object of h a copy of its
+ * own before the content is changed in place: a loaded model only needs its
+ * own group and state set, the model below is never changed, other types
+ * copy all of it.
+ */
+static void Vis3d__UnshareContent(const std::shared_ptr<Vis3d> vis3d,
+                                  const Handle &h)
+{
+    osg::MatrixTransform *mt = Vis3d__GetNode(vis3d, h);
+    if (mt == nullptr) return;
+
+    const osg::CopyOp copyop =
+        h.type == ViewObjectType_Model
+            ? osg::CopyOp(osg::CopyOp::DEEP_COPY_STATESETS
+                          | osg::CopyOp::DEEP_COPY_STATEATTRIBUTES)
+            : osg::CopyOp(osg::CopyOp::DEEP_COPY_ALL);
+    for (unsigned int i = 0; i < mt->getNumChildren(); ++i) {
+        const osg::Node *content = mt->getChild(i);
+        if (content->getNumParents() < 2 || !Vis3d__IsContent(content)) {
+            continue;
+        }
+        osg::ref_ptr<osg::Node> copy =
+            static_cast<osg::Node *>(content->clone(copyop));
+        mt->setChild(i, copy.get());
+    }
+}
+
+/**
+ * Give a reserved object the content built by a worker, null if that failed,
+ * and replay the calls queued meanwhile.
+ */
+static void Vis3d__Materialize(const std::shared_ptr<Vis3d> vis3d, View &view,
+                               const Handle &h, osg::Node *content)
+{
+    auto it = vis3d->loading.find(h);
+    if (it == vis3d->loading.end()) return;
+    const std::vector<std::function<void(View &)>> ops = std::move(it->second);
+    vis3d->loading.erase(it);
+
+    osg::MatrixTransform *mt = Vis3d__GetNode(vis3d, h);
+    if (mt == nullptr) return; // deleted while loading
+    if (content == nullptr) {
+        view.Delete(h);
+        return;
+    }
+    Vis3d__PrepareContent(vis3d, h.type, content);
+    mt->setChild(0, content);
+    vis3d->octree.Update(mt);
+    for (auto &op : ops) {
+        op(view);
+    }
+    Vis3d__MarkDirty(vis3d);
+}
+
+View::View(RenderPolicy policy)
 {
     m_vis3d = std::make_shared<Vis3d>();
-    m_vis3d->node_switch = new osg::Switch;
+    m_vis3d->render_policy = policy;
+    m_vis3d->node_switch = new SceneSwitch;
+    m_vis3d->octree.SetRoot(m_vis3d->node_switch.get());
     m_vis3d->scene_root = new osg::Group;
     m_vis3d->osgviewer = new osgViewer::Viewer;
 
@@ -80,6 +495,7 @@ View::View()
 
     m_vis3d->osgviewer->setSceneData(m_vis3d->scene_root);
     m_vis3d->scene_root->addChild(m_vis3d->node_switch);
+    m_vis3d->osgviewer->addEventHandler(new PickHandler(m_vis3d.get()));
 
     osg::StateSet *stateSet = m_vis3d->scene_root->getOrCreateStateSet();
     osg::Material *material = new osg::Material;
@@ -128,6 +544,7 @@ bool View::SetCameraPose(const std::array<float, 3> &eye,
         {point_want_to_look[0], point_want_to_look[1], point_want_to_look[2]},
         {upvector[0], upvector[1], upvector[2]});
     m_vis3d->osgviewer->getCameraManipulator()->setByInverseMatrix(vm);
+    Vis3d__MarkMoved(m_vis3d);
     return true;
 }
 
@@ -161,26 +578,21 @@ bool View::Clear()
     m_vis3d->scene_root->removeChild(1,
                                      m_vis3d->scene_root->getNumChildren() - 1);
     m_vis3d->node_switch->removeChildren(0, num);
+    m_vis3d->octree.Clear();
     m_vis3d->outlinemap.clear();
-    m_vis3d->node_map.clear();
+    m_vis3d->node_map.Clear();
+    m_vis3d->articulations.clear();
+    m_vis3d->trajectories.Clear();
+    m_vis3d->loading.clear();
+    m_vis3d->batch.pending.clear();
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
 bool View::Delete(const Handle &nh)
 {
-    const Handle who = nh;
-    // LOG_DEBUG("Delete node: type: {0}, uid: {1}.", who.type, who.uid);
-    if (!Vis3d__HasNode(m_vis3d, who)) {
-        LOG_ERROR("Can not find node: type: {0}, uid: {1}.", who.type, who.uid);
-        return false;
-    }
-    if (Vis3d__HasOutline(m_vis3d, who)) {
-        RemoveOutline(m_vis3d, who);
-    }
-
-    m_vis3d->node_switch->removeChild(m_vis3d->node_map[who]);
-    m_vis3d->node_map.erase(who);
-    return true;
+    // the same as deleting a list of one, chained objects included
+    return Delete(std::vector<Handle>{nh});
 }
 
 bool View::IsAlive(const Handle &nh) const
@@ -190,40 +602,154 @@ bool View::IsAlive(const Handle &nh) const
 
 bool View::Delete(const std::vector<Handle> &handles)
 {
-    for (const auto h : handles) {
-        if (!Delete(h)) {
+    std::vector<bool> deleted;
+    return Delete(handles, deleted);
+}
+
+bool View::Delete(const std::vector<Handle> &handles,
+                  std::vector<bool> &deleted)
+{
+    deleted.assign(handles.size(), false);
+
+    // Keep the nodes alive until they are out of the scene graph.
+    std::vector<osg::ref_ptr<osg::MatrixTransform>> nodes;
+    nodes.reserve(handles.size());
+    std::unordered_set<const osg::Node *> targets;
+    targets.reserve(handles.size());
+
+    bool all_deleted = true;
+    for (size_t i = 0; i < handles.size(); ++i) {
+        const Handle h = handles[i];
+        const osg::ref_ptr<osg::MatrixTransform> mt =
+            Vis3d__GetNode(m_vis3d, h);
+        if (mt == nullptr) {
             LOG_ERROR("Delete handle : ({0}, {1}) failed!", h.type, h.uid);
-            return false;
+            all_deleted = false;
+            continue;
+        }
+        if (Vis3d__HasOutline(m_vis3d, h)) {
+            RemoveOutline(m_vis3d, h);
+        }
+
+        nodes.push_back(mt);
+        targets.insert(mt.get());
+        m_vis3d->node_map.Erase(h);
+        deleted[i] = true;
+
+        // Objects in the octree cells or chained below another object, the
+        // ones right under the switch are removed in a single pass below.
+        if (!Vis3d__IsTopLevel(m_vis3d, mt)) {
+            m_vis3d->octree.Remove(mt);
+        }
+        for (unsigned int j = mt->getNumParents(); j > 0; --j) {
+            osg::Group *parent = mt->getParent(j - 1);
+            if (parent != m_vis3d->node_switch.get()) {
+                parent->removeChild(mt);
+            }
+        }
+    }
+
+    // an articulation missing a link would still move it through its
+    // ref_ptr, so it goes away with any of them
+    auto &articulations = m_vis3d->articulations;
+    for (auto it = articulations.begin(); it != articulations.end();) {
+        const auto &links = it->second.Links();
+        if (std::any_of(links.begin(), links.end(), [&targets](const auto &l) {
+                return targets.find(l.get()) != targets.end();
+            })) {
+            it = articulations.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    static_cast<SceneSwitch *>(m_vis3d->node_switch.get())
+        ->RemoveChildren(targets);
+    if (m_vis3d->batch.active) {
+        auto &pending = m_vis3d->batch.pending;
+        pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                     [&targets](const auto &node) {
+                                         return targets.find(node.get())
+                                                != targets.end();
+                                     }),
+                      pending.end());
+    }
+    Vis3d__MarkDirty(m_vis3d);
+    return all_deleted;
+}
+
+bool View::BeginBatch(size_t expected)
+{
+    if (m_vis3d->batch.active) {
+        LOG_ERROR("A batch is already started!");
+        return false;
+    }
+    m_vis3d->batch.active = true;
+    m_vis3d->batch.pending.reserve(expected);
+    m_vis3d->node_map.Reserve(m_vis3d->node_map.Size() + expected);
+    return true;
+}
+
+bool View::EndBatch()
+{
+    if (!m_vis3d->batch.active) {
+        LOG_ERROR("No batch is started!");
+        return false;
+    }
+    auto &pending = m_vis3d->batch.pending;
+    std::vector<osg::Node *> nodes;
+    nodes.reserve(pending.size());
+    size_t num_in_root = 0;
+    for (const auto &mt : pending) {
+        // Objects chained inside the batch already have a parent.
+        if (mt->getNumParents() == 0) {
+            nodes.push_back(mt.get());
+            num_in_root += SceneOctree::InRoot(mt->getBound()) ? 1 : 0;
         }
     }
+    static_cast<SceneSwitch *>(m_vis3d->node_switch.get())
+        ->Reserve(m_vis3d->node_switch->getNumChildren() + num_in_root);
+    m_vis3d->octree.Insert(nodes);
+    pending.clear();
+    pending.shrink_to_fit();
+    m_vis3d->batch.active = false;
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
+void View::EnableDebugNames(bool enable) { m_vis3d->debug_names = enable; }
+
 bool View::Home()
 {
     m_vis3d->osgviewer->home();
+    Vis3d__MarkMoved(m_vis3d);
     return true;
 }
 
 bool View::Show(const Handle &nh)
 {
     const Handle who = nh;
-    if (!Vis3d__HasNode(m_vis3d, who)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, who);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", who.type, who.uid);
         return false;
     }
-    m_vis3d->node_switch->setChildValue(m_vis3d->node_map[who], true);
+    Vis3d__SetVisible(mt, true);
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
 bool View::Hide(const Handle &nh)
 {
     const Handle who = nh;
-    if (!Vis3d__HasNode(m_vis3d, who)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, who);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", who.type, who.uid);
         return false;
     }
-    m_vis3d->node_switch->setChildValue(m_vis3d->node_map[who], false);
+    Vis3d__SetVisible(mt, false);
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -254,15 +780,17 @@ bool View::Chain(const std::vector<Handle> &links)
     }
 
     for (int i = 1; i < (int)links.size(); ++i) {
-        const auto mt = m_vis3d->node_map[links[i]];
+        const osg::ref_ptr<osg::MatrixTransform> mt =
+            Vis3d__GetNode(m_vis3d, links[i]);
         // Unchain from its parents
-        const int np = mt->getNumParents();
-        for (int j = 0; j < np; ++j) {
-            mt->getParent(j)->asGroup()->removeChild(mt);
+        m_vis3d->octree.Remove(mt);
+        while (mt->getNumParents() > 0) {
+            mt->getParent(0)->removeChild(mt);
         }
         // Chain
-        m_vis3d->node_map[links[(size_t)i - 1]]->addChild(mt);
+        Vis3d__GetNode(m_vis3d, links[(size_t)i - 1])->addChild(mt);
     }
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -281,8 +809,9 @@ bool View::Unchain(const std::vector<Handle> &links)
     }
 
     for (int i = 1; i < (int)links.size(); ++i) {
-        auto &prev = m_vis3d->node_map[links[i - 1]];
-        auto &curr = m_vis3d->node_map[links[i]];
+        osg::MatrixTransform *prev = Vis3d__GetNode(m_vis3d, links[i - 1]);
+        osg::ref_ptr<osg::MatrixTransform> curr =
+            Vis3d__GetNode(m_vis3d, links[i]);
         if (!prev->removeChild(curr)) {
             LOG_ERROR("No link between links[{0}] and links[{1}].", i - 1, i);
         }
@@ -290,10 +819,11 @@ bool View::Unchain(const std::vector<Handle> &links)
             // Here we should not lose any nodes, so after unchain, if a node is
             // orphan, we need to give it a parent...
             if (curr->getNumParents() == 0) {
-                m_vis3d->node_switch->addChild(curr);
+                m_vis3d->octree.Insert(curr);
             }
         }
     }
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -312,37 +842,73 @@ bool View::SetTransforms(const std::vector<Handle> &hs,
         return false;
     }
 
-    std::vector<osg::Matrixf> transforms(trans_size);
-    for (int i = 0; i < trans_size; ++i) {
-        transforms[i].setRotate(
-            osg::Quat(quats[i][0], quats[i][1], quats[i][2], quats[i][3]));
-        transforms[i].setTrans(
-            osg::Vec3f(trans[i][0], trans[i][1], trans[i][2]));
-    }
-
-    if (hs_size != (int)transforms.size()) {
-        LOG_ERROR("handles.size() != transforms.size(). We should've checked "
-                  "before, shouldn't reach "
-                  "here!");
-        return false;
-    }
+    static_assert(sizeof(std::array<float, 3>) == 3 * sizeof(float)
+                      && sizeof(std::array<float, 4>) == 4 * sizeof(float),
+                  "std::array should not be padded");
+    return SetTransforms(hs.data(), trans[0].data(), quats[0].data(),
+                         hs.size());
+}
 
-    for (int i = 0; i < hs_size; ++i) {
-        const Handle h = hs[i];
-        if (!Vis3d__HasNode(m_vis3d, h)) {
+/// Set the matrices of n objects, 16 floats each, skipping missing ones.
+/// The objects set are added to moved, for SceneOctree::Update.
+static void Vis3d__SetMatrices(Vis3d &vis3d, const Handle *hs,
+                               const float *matrices, size_t n,
+                               std::vector<osg::Node *> &moved)
+{
+    for (size_t i = 0; i < n; ++i) {
+        const Handle &h = hs[i];
+        const float *m = matrices + 16 * i;
+        osg::ref_ptr<osg::MatrixTransform> *node = vis3d.node_map.Find(h);
+        if (node == nullptr) {
             LOG_WARN("Could not find object: type: {0}, uid: {1}", h.type,
                      h.uid);
+            continue;
         }
-        else {
-            m_vis3d->node_map[h]->setMatrix(transforms[i]);
-            if (h == m_vis3d->gizmo.refHandle) {
-                for (int i = 0; i < 16; ++i) {
-                    m_vis3d->gizmo.matrix[i] = *(transforms[0].ptr() + i);
-                }
-            }
+        (*node)->setMatrix(osg::Matrix(m));
+        moved.push_back(node->get());
+        if (h == vis3d.gizmo.refHandle) {
+            std::copy(m, m + 16, vis3d.gizmo.matrix);
         }
     }
+}
+
+bool View::SetTransforms(const Handle *hs, const float *positions,
+                         const float *quats, size_t n)
+{
+    if (hs == nullptr || positions == nullptr || quats == nullptr) {
+        LOG_ERROR("Invalid parameters: hs, positions and quats should not be "
+                  "null.");
+        return false;
+    }
+
+    // converted a block at a time, so the matrices stay in cache
+    const size_t block = 256;
+    float matrices[block * 16];
+    std::vector<osg::Node *> moved;
+    moved.reserve(n);
+    for (size_t i = 0; i < n; i += block) {
+        const size_t num = std::min(block, n - i);
+        PosesToMatrices(positions + 3 * i, quats + 4 * i, num, matrices);
+        Vis3d__SetMatrices(*m_vis3d, hs + i, matrices, num, moved);
+    }
+    m_vis3d->octree.Update(moved);
+
+    Vis3d__MarkMoved(m_vis3d);
+    return true;
+}
+
+bool View::SetTransforms(const Handle *hs, const float *matrices16, size_t n)
+{
+    if (hs == nullptr || matrices16 == nullptr) {
+        LOG_ERROR("Invalid parameters: hs and matrices16 should not be null.");
+        return false;
+    }
 
+    std::vector<osg::Node *> moved;
+    moved.reserve(n);
+    Vis3d__SetMatrices(*m_vis3d, hs, matrices16, n, moved);
+    m_vis3d->octree.Update(moved);
+    Vis3d__MarkMoved(m_vis3d);
     return true;
 }
 
@@ -370,13 +936,14 @@ bool View::SetTransforms(const Handle &h,
     // operations:
     // 1. base link has enough children and each parenth has only one kid
     // following the line.
-    if (!Vis3d__HasNode(m_vis3d, h)) {
+    osg::MatrixTransform *const root = Vis3d__GetNode(m_vis3d, h);
+    if (root == nullptr) {
         LOG_ERROR("Could not find object: type: {0}, uid: {1}", h.type, h.uid);
         return false;
     }
 
     // For the following, check:
-    auto mt = m_vis3d->node_map[h];
+    osg::MatrixTransform *mt = root;
     for (i = 1; i < trans_size; ++i) {
         // each MatrixTransform will at least have its own child.
         // It another object is attached to it. It will have a child with type
@@ -399,7 +966,7 @@ bool View::SetTransforms(const Handle &h,
     }
 
     // Set the transform
-    mt = m_vis3d->node_map[h];
+    mt = root;
     for (i = 0; i < trans_size - 1; ++i) {
         mt->setMatrix(transforms[i]);
         mt = dynamic_cast<osg::MatrixTransform *>(mt->getChild(1));
@@ -414,7 +981,285 @@ bool View::SetTransforms(const Handle &h,
             m_vis3d->gizmo.matrix[i] = *(transforms[0].ptr() + i);
         }
     }
+    m_vis3d->octree.Update(root);
+
+    Vis3d__MarkMoved(m_vis3d);
+    return true;
+}
+
+bool View::Articulate(const std::vector<Handle> &links,
+                      const std::vector<Joint> &joints)
+{
+    if (links.size() != joints.size()) {
+        LOG_ERROR("Invalid parameters: links.size: {0}, joints.size: {1}",
+                  links.size(), joints.size());
+        return false;
+    }
+    for (size_t i = 0; i < joints.size(); ++i) {
+        const Joint &joint = joints[i];
+        const auto &q = joint.quat;
+        if (q[0] == 0 && q[1] == 0 && q[2] == 0 && q[3] == 0) {
+            LOG_ERROR("joints[{0}]: quanternion (0, 0, 0, 0) is not valid!",
+                      i);
+            return false;
+        }
+        const auto &a = joint.axis;
+        if (joint.type != JointType_Fixed && a[0] == 0 && a[1] == 0
+            && a[2] == 0) {
+            LOG_ERROR("joints[{0}]: axis (0, 0, 0) is not valid!", i);
+            return false;
+        }
+    }
+    if (!Chain(links)) {
+        return false;
+    }
+
+    std::vector<osg::ref_ptr<osg::MatrixTransform>> mts(links.size());
+    for (size_t i = 0; i < links.size(); ++i) {
+        mts[i] = Vis3d__GetNode(m_vis3d, links[i]);
+    }
+    m_vis3d->articulations[links[0]] = Articulation(std::move(mts), joints);
+    Vis3d__MarkDirty(m_vis3d);
+    return true;
+}
+
+bool View::SetJointPositions(const Handle &base, const float *positions,
+                             size_t n)
+{
+    auto it = m_vis3d->articulations.find(base);
+    if (it == m_vis3d->articulations.end()) {
+        LOG_ERROR("Object is not an articulation: type: {0}, uid: {1}",
+                  base.type, base.uid);
+        return false;
+    }
+    Articulation &articulation = it->second;
+    if (n != articulation.NumDofs() || (n > 0 && positions == nullptr)) {
+        LOG_ERROR("Invalid parameters: n: {0}, articulation dofs: {1}", n,
+                  articulation.NumDofs());
+        return false;
+    }
+
+    articulation.SetJointPositions(positions);
+    m_vis3d->octree.Update(Vis3d__GetNode(m_vis3d, base));
+    if (base == m_vis3d->gizmo.refHandle) {
+        const osg::Matrixf m(articulation.BaseMatrix());
+        std::copy(m.ptr(), m.ptr() + 16, m_vis3d->gizmo.matrix);
+    }
+    Vis3d__MarkMoved(m_vis3d);
+    return true;
+}
+
+/**
+ * Moves the objects of the trajectories before each frame, on the render
+ * thread. It is only attached to scene_root while a trajectory moves, i.e.
+ * plays at a rate other than 0, since OSG keeps drawing frames for a scene
+ * with update callbacks.
+ */
+class TrajectoryCallback : public osg::NodeCallback
+{
+public:
+    explicit TrajectoryCallback(Vis3d &vis3d) : m_vis3d(vis3d) {}
+
+    void operator()(osg::Node *node, osg::NodeVisitor *nv) override
+    {
+        const osg::FrameStamp *fs = nv->getFrameStamp();
+        const double now = fs ? fs->getReferenceTime() : 0.0;
+        bool moving = false;
+        m_moved.clear();
+        m_vis3d.trajectories.ForEach([&](const Handle &, VisTrajectory &tr) {
+            Update(tr, now);
+            moving = moving || (tr.playing && tr.rate != 0.0);
+        });
+        m_vis3d.octree.Update(m_moved);
+        if (!m_moved.empty()) ++m_vis3d.move_revision;
+        traverse(node, nv);
+        if (!moving) {
+            // m_vis3d still holds this callback
+            node->setUpdateCallback(nullptr);
+        }
+    }
+
+private:
+    void Update(VisTrajectory &tr, double now)
+    {
+        if (tr.playing && tr.rate == 0.0) {
+            // held until SetTrajectoryRate, the time held does not count
+            tr.last_frame_time = -1.0;
+        }
+        else if (tr.playing) {
+            if (tr.last_frame_time >= 0.0) {
+                tr.time += (now - tr.last_frame_time) * tr.rate;
+            }
+            tr.last_frame_time = now;
+            const double start = tr.trajectory.StartTime();
+            const double end = tr.trajectory.EndTime();
+            if (tr.time < start || tr.time > end) {
+                if (tr.loop && end > start) {
+                    tr.time = std::fmod(tr.time - start, end - start);
+                    tr.time += tr.time < 0.0 ? end : start;
+                }
+                else {
+                    tr.time = std::max(start, std::min(end, tr.time));
+                    tr.playing = false;
+                }
+            }
+            tr.changed = true;
+        }
+        if (!tr.changed) return;
+        tr.changed = false;
+
+        m_matrices.resize(tr.handles.size());
+        tr.trajectory.Sample(tr.time, m_matrices.data());
+        for (size_t i = 0; i < tr.handles.size(); ++i) {
+            const Handle &h = tr.handles[i];
+            osg::ref_ptr<osg::MatrixTransform> *node =
+                m_vis3d.node_map.Find(h);
+            if (node == nullptr) continue;
+            (*node)->setMatrix(m_matrices[i]);
+            m_moved.push_back(node->get());
+            if (h == m_vis3d.gizmo.refHandle) {
+                const osg::Matrixf m(m_matrices[i]);
+                std::copy(m.ptr(), m.ptr() + 16, m_vis3d.gizmo.matrix);
+            }
+        }
+    }
+
+    Vis3d &m_vis3d;
+    std::vector<osg::Matrix> m_matrices;
+    std::vector<osg::Node *> m_moved; // objects set by Update
+};
+
+/// Let the trajectories move on the next frame.
+static void Vis3d__WakeTrajectories(Vis3d &vis3d)
+{
+    if (!vis3d.trajectory_callback) {
+        vis3d.trajectory_callback = new TrajectoryCallback(vis3d);
+    }
+    if (vis3d.scene_root->getUpdateCallback()
+        != vis3d.trajectory_callback.get()) {
+        vis3d.scene_root->setUpdateCallback(vis3d.trajectory_callback.get());
+    }
+    Vis3d__MarkMoved(vis3d);
+}
+
+Handle View::PlayTrajectory(const std::vector<Handle> &hs,
+                            const std::vector<float> &timestamps,
+                            const std::vector<float> &poses,
+                            Interpolation interpolation, bool loop)
+{
+    Handle th;
+    const size_t num_keys = timestamps.size();
+    if (hs.empty() || num_keys == 0
+        || poses.size() != num_keys * hs.size() * 7) {
+        LOG_ERROR("Invalid parameters: hs.size: {0}, timestamps.size: {1}, "
+                  "poses.size: {2}",
+                  hs.size(), num_keys, poses.size());
+        return th;
+    }
+    for (const auto &h : hs) {
+        if (!Vis3d__HasNode(m_vis3d, h)) {
+            LOG_ERROR("Can not find node: type: {0}, uid: {1}.", h.type, h.uid);
+            return th;
+        }
+    }
+    for (size_t k = 1; k < num_keys; ++k) {
+        if (!(timestamps[k] > timestamps[k - 1])) {
+            LOG_ERROR("timestamps should be strictly increasing: [{0}]: {1}, "
+                      "[{2}]: {3}",
+                      k - 1, timestamps[k - 1], k, timestamps[k]);
+            return th;
+        }
+    }
+    for (size_t i = 0; i < poses.size(); i += 7) {
+        const float *q = poses.data() + i + 3;
+        if (q[0] == 0 && q[1] == 0 && q[2] == 0 && q[3] == 0) {
+            LOG_ERROR("quanternion (0, 0, 0, 0) is not valid!");
+            return th;
+        }
+    }
+
+    VisTrajectory tr;
+    tr.handles = hs;
+    tr.trajectory =
+        Trajectory(hs.size(),
+                   std::vector<double>(timestamps.begin(), timestamps.end()),
+                   poses, interpolation);
+    tr.time = timestamps.front();
+    tr.loop = loop;
+    th = m_vis3d->trajectories.Insert(ViewObjectType_Trajectory,
+                                      std::move(tr));
+    Vis3d__WakeTrajectories(*m_vis3d);
+    return th;
+}
+
+bool View::PauseTrajectory(const Handle &th, bool pause)
+{
+    VisTrajectory *tr = m_vis3d->trajectories.Find(th);
+    if (tr == nullptr) {
+        LOG_ERROR("Can not find trajectory: type: {0}, uid: {1}.", th.type,
+                  th.uid);
+        return false;
+    }
+    if (!pause && !tr->playing && !tr->loop) {
+        // replay a trajectory that reached its end
+        if (tr->rate > 0.0 && tr->time >= tr->trajectory.EndTime()) {
+            tr->time = tr->trajectory.StartTime();
+        }
+        else if (tr->rate < 0.0 && tr->time <= tr->trajectory.StartTime()) {
+            tr->time = tr->trajectory.EndTime();
+        }
+    }
+    tr->playing = !pause;
+    // the paused time does not count
+    tr->last_frame_time = -1.0;
+    tr->changed = true;
+    Vis3d__WakeTrajectories(*m_vis3d);
+    return true;
+}
+
+bool View::SeekTrajectory(const Handle &th, float time)
+{
+    VisTrajectory *tr = m_vis3d->trajectories.Find(th);
+    if (tr == nullptr) {
+        LOG_ERROR("Can not find trajectory: type: {0}, uid: {1}.", th.type,
+                  th.uid);
+        return false;
+    }
+    tr->time = std::max(tr->trajectory.StartTime(),
+                        std::min(tr->trajectory.EndTime(), (double)time));
+    tr->changed = true;
+    Vis3d__WakeTrajectories(*m_vis3d);
+    return true;
+}
+
+bool View::SetTrajectoryRate(const Handle &th, float rate)
+{
+    VisTrajectory *tr = m_vis3d->trajectories.Find(th);
+    if (tr == nullptr) {
+        LOG_ERROR("Can not find trajectory: type: {0}, uid: {1}.", th.type,
+                  th.uid);
+        return false;
+    }
+    tr->rate = rate;
+    if (tr->playing) {
+        Vis3d__WakeTrajectories(*m_vis3d);
+    }
+    return true;
+}
+
+float View::GetTrajectoryTime(const Handle &th) const
+{
+    const VisTrajectory *tr = m_vis3d->trajectories.Find(th);
+    return tr ? tr->time : -1.f;
+}
 
+bool View::StopTrajectory(const Handle &th)
+{
+    if (!m_vis3d->trajectories.Erase(th)) {
+        LOG_ERROR("Can not find trajectory: type: {0}, uid: {1}.", th.type,
+                  th.uid);
+        return false;
+    }
     return true;
 }
 
@@ -427,9 +1272,9 @@ bool View::SetTransparency(const Handle &nh, float inv_alpha)
     if (nh.type != ViewObjectType_Model && nh.type != ViewObjectType_Box
         && nh.type != ViewObjectType_Sphere
         && nh.type != ViewObjectType_Cylinder
-        && nh.type != ViewObjectType_Cone) {
-        LOG_ERROR(
-            "Currently only Model, Box, Sphere, Cylinder type is supported.");
+        && nh.type != ViewObjectType_Cone && !IsInstancedType(nh.type)) {
+        LOG_ERROR("Currently only Model, Box, Sphere, Cylinder, Cone and "
+                  "their batched types are supported.");
         return false;
     }
 
@@ -440,14 +1285,34 @@ bool View::SetTransparency(const Handle &nh, float inv_alpha)
     }
 
     const Handle who = nh;
-    if (!Vis3d__HasNode(m_vis3d, who)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, who);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", who.type, who.uid);
         return false;
     }
 
-    auto mt = m_vis3d->node_map[who];
+    if (Vis3d__DeferWhileLoading(m_vis3d, who, [who, inv_alpha](View &v) {
+            v.SetTransparency(who, inv_alpha);
+        })) {
+        return true;
+    }
+    Vis3d__UnshareContent(m_vis3d, who);
+
     const float alpha = 1.f - inv_alpha;
-    if (who.type == ViewObjectType_Model) {
+    if (IsInstancedType(who.type)) {
+        osg::Geometry *geom = nullptr;
+        osg::Vec4Array *colors = Vis3d__GetInstanceColors(m_vis3d, who, &geom);
+        if (colors == nullptr) {
+            LOG_ERROR("No instance colors for the node! ({0}, {1})", who.type,
+                      who.uid);
+            return false;
+        }
+        for (auto &c : *colors) {
+            c.a() = alpha;
+        }
+        DirtyInstanceColors(geom);
+    }
+    else if (who.type == ViewObjectType_Model) {
         osg::Node *node = mt->getChild(0);
         if (node == nullptr) {
             LOG_ERROR(
@@ -504,6 +1369,7 @@ bool View::SetTransparency(const Handle &nh, float inv_alpha)
         LOG_DEBUG("SetTransparency: [{0},{1},{2},{3}]", color[0], color[1],
                   color[2], color[3]);
     }
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -511,7 +1377,8 @@ bool View::ShowOutline(const Handle &nh, bool show, float width,
                        const std::vector<float> &color)
 {
     const Handle who = nh;
-    if (!Vis3d__HasNode(m_vis3d, who)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, who);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", who.type, who.uid);
         return false;
     }
@@ -532,7 +1399,6 @@ bool View::ShowOutline(const Handle &nh, bool show, float width,
         color_ = {color[0], color[1], color[2], color[3]};
     }
 
-    auto node = m_vis3d->node_map[who];
     bool outline_shown = Vis3d__HasOutline(m_vis3d, who);
 
     if (outline_shown) {
@@ -543,9 +1409,10 @@ bool View::ShowOutline(const Handle &nh, bool show, float width,
         m_vis3d->outlinemap[who] = outline;
         outline->setWidth(width);
         outline->setColor(color_);
-        outline->addChild(node);
+        outline->addChild(mt);
         m_vis3d->scene_root->addChild(outline);
     }
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -583,7 +1450,7 @@ bool View::ShowOutline(const std::vector<Handle> &hs, bool show, float width,
         outline->setWidth(width);
 
         for (auto h : hs) {
-            auto node = m_vis3d->node_map[h];
+            osg::MatrixTransform *node = Vis3d__GetNode(m_vis3d, h);
             if (Vis3d__HasOutline(m_vis3d, h)) {
                 RemoveOutline(m_vis3d, h);
             }
@@ -598,6 +1465,7 @@ bool View::ShowOutline(const std::vector<Handle> &hs, bool show, float width,
         }
     }
 
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -605,7 +1473,8 @@ bool View::SetColor(const Handle &nh, const std::vector<float> &color,
                     int color_channels)
 {
     const Handle who = nh;
-    if (!Vis3d__HasNode(m_vis3d, who)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, who);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", who.type, who.uid);
         return false;
     }
@@ -625,8 +1494,15 @@ bool View::SetColor(const Handle &nh, const std::vector<float> &color,
         return false;
     }
 
+    if (Vis3d__DeferWhileLoading(
+            m_vis3d, who, [who, color, color_channels](View &v) {
+                v.SetColor(who, color, color_channels);
+            })) {
+        return true;
+    }
+    Vis3d__UnshareContent(m_vis3d, who);
+
     if (who.type == ViewObjectType_Model) {
-        const osg::ref_ptr<osg::MatrixTransform> mt = m_vis3d->node_map[who];
         osg::Node *node = mt->getChild(0);
         if (node == nullptr) return false;
 
@@ -664,6 +1540,28 @@ bool View::SetColor(const Handle &nh, const std::vector<float> &color,
                                                    | osg::StateAttribute::ON);
         }
     }
+    else if (IsInstancedType(who.type)) {
+        osg::Geometry *geom = nullptr;
+        osg::Vec4Array *colors = Vis3d__GetInstanceColors(m_vis3d, who, &geom);
+        if (colors == nullptr) {
+            LOG_ERROR("No instance colors for the node! ({0}, {1})", who.type,
+                      who.uid);
+            return false;
+        }
+        const size_t color_array_size = color_size / color_channels;
+        if (color_array_size != 1 && color_array_size != colors->size()) {
+            LOG_ERROR("color array size [{}] not match instance size [{}]",
+                      color_array_size, colors->size());
+            return false;
+        }
+        for (size_t i = 0; i < colors->size(); ++i) {
+            const float *c =
+                &color[(color_array_size == 1 ? 0 : i) * color_channels];
+            (*colors)[i].set(c[0], c[1], c[2],
+                             color_channels == 4 ? c[3] : 1.f);
+        }
+        DirtyInstanceColors(geom);
+    }
     else if (who.type > ViewObjectType_Cylinder
              || who.type < ViewObjectType_Point) {
         LOG_ERROR(u8"not support");
@@ -671,7 +1569,6 @@ bool View::SetColor(const Handle &nh, const std::vector<float> &color,
     }
     else {
         /// ShapeDrawables
-        const osg::ref_ptr<osg::MatrixTransform> mt = m_vis3d->node_map[who];
         osg::Geode *geode = static_cast<osg::Geode *>(mt->getChild(0));
         if (geode == nullptr) {
             LOG_ERROR("No child for the geode, which should be impossible! "
@@ -731,16 +1628,39 @@ bool View::SetColor(const Handle &nh, const std::vector<float> &color,
             sd->setColor(color_old);
         }
     }
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
 bool View::GetColor(const Handle &nh, std::vector<float> &color) const
 {
     const Handle who = nh;
-    if (!Vis3d__HasNode(m_vis3d, who)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, who);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", who.type, who.uid);
         return false;
     }
+    if (Vis3d__IsLoading(m_vis3d, who)) {
+        LOG_WARN("Node is still loading: type: {0}, uid: {1}.", who.type,
+                 who.uid);
+        return false;
+    }
+
+    if (IsInstancedType(who.type)) {
+        const osg::Vec4Array *colors = Vis3d__GetInstanceColors(m_vis3d, who);
+        if (colors == nullptr) {
+            LOG_ERROR("No instance colors for the node! ({0}, {1})", who.type,
+                      who.uid);
+            return false;
+        }
+        color.resize(colors->size() * 4);
+        for (size_t i = 0; i < colors->size(); ++i) {
+            for (int j = 0; j < 4; ++j) {
+                color[i * 4 + j] = (*colors)[i][j];
+            }
+        }
+        return true;
+    }
 
     if (who.type < ViewObjectType_Point || who.type > ViewObjectType_Cylinder) {
         LOG_ERROR(
@@ -749,7 +1669,6 @@ bool View::GetColor(const Handle &nh, std::vector<float> &color) const
         return false;
     }
 
-    const osg::ref_ptr<osg::MatrixTransform> mt = m_vis3d->node_map[who];
     osg::Geode *gnode = static_cast<osg::Geode *>(mt->getChild(0));
     if (gnode == nullptr) {
         LOG_ERROR(
@@ -766,31 +1685,25 @@ bool View::GetColor(const Handle &nh, std::vector<float> &color) const
     }
     // Geometry
     if (drawable->asGeometry()) {
-        osg::Geometry *geom = drawable->asGeometry();
-        auto color_array = geom->getColorArray();
-        auto color_array_size = color_array->getNumElements();
-        auto color_channel =
-            color_array->getDataType() == osg::Array::Vec3ArrayType ? 3 : 4;
-        color.resize(color_array_size * 4);
-        if (color_channel == 3) {
-            osg::Vec3Array *color3array =
-                dynamic_cast<osg::Vec3Array *>(color_array);
-            for (unsigned int i = 0; i < color_array_size; i++) {
-                color[i * 4 + 0] = (*color3array)[i].x();
-                color[i * 4 + 1] = (*color3array)[i].y();
-                color[i * 4 + 2] = (*color3array)[i].z();
-                color[i * 4 + 3] = 1.0f;
-            }
+        // Read through the raw pointer so that both osg::Vec3Array/Vec4Array
+        // and arrays adopted from caller memory are handled.
+        const osg::Array *color_array = drawable->asGeometry()->getColorArray();
+        if (color_array == nullptr) {
+            LOG_ERROR("No color array for the geometry! ({0}, {1})", who.type,
+                      who.uid);
+            return false;
         }
-        else {
-            osg::Vec4Array *color4array =
-                dynamic_cast<osg::Vec4Array *>(color_array);
-            for (unsigned int i = 0; i < color_array_size; i++) {
-                color[i * 4 + 0] = (*color4array)[i].x();
-                color[i * 4 + 1] = (*color4array)[i].y();
-                color[i * 4 + 2] = (*color4array)[i].z();
-                color[i * 4 + 3] = (*color4array)[i].a();
-            }
+        const unsigned int color_array_size = color_array->getNumElements();
+        const int color_channel = color_array->getDataSize();
+        const float *data =
+            static_cast<const float *>(color_array->getDataPointer());
+        color.resize(color_array_size * 4);
+        for (unsigned int i = 0; i < color_array_size; i++) {
+            color[i * 4 + 0] = data[i * color_channel + 0];
+            color[i * 4 + 1] = data[i * color_channel + 1];
+            color[i * 4 + 2] = data[i * color_channel + 2];
+            color[i * 4 + 3] =
+                color_channel == 4 ? data[i * color_channel + 3] : 1.0f;
         }
     }
     else {
@@ -808,58 +1721,68 @@ bool View::GetColor(const Handle &nh, std::vector<float> &color) const
 
 bool View::SetPosition(const Handle &nh, const std::array<float, 3> &trans)
 {
-    if (!Vis3d__HasNode(m_vis3d, nh)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, nh);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
         return false;
     }
 
-    osg::Matrixf m = m_vis3d->node_map[nh]->getMatrix();
+    osg::Matrixf m = mt->getMatrix();
     m.setTrans(osg::Vec3f(trans[0], trans[1], trans[2]));
-    m_vis3d->node_map[nh]->setMatrix(m);
+    mt->setMatrix(m);
+    m_vis3d->octree.Update(mt);
+    Vis3d__MarkMoved(m_vis3d);
     return true;
 }
 
 bool View::SetRotation(const Handle &nh, const std::array<float, 4> &quat)
 {
-    if (!Vis3d__HasNode(m_vis3d, nh)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, nh);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
         return false;
     }
 
-    osg::Matrixf m = m_vis3d->node_map[nh]->getMatrix();
+    osg::Matrixf m = mt->getMatrix();
     m.setRotate(osg::Quat(quat[0], quat[1], quat[2], quat[3]));
-    m_vis3d->node_map[nh]->setMatrix(m);
+    mt->setMatrix(m);
+    m_vis3d->octree.Update(mt);
+    Vis3d__MarkMoved(m_vis3d);
     return true;
 }
 
 bool View::SetTransform(const Handle &nh, const std::array<float, 3> &trans,
                         const std::array<float, 4> &quat)
 {
-    if (!Vis3d__HasNode(m_vis3d, nh)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, nh);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
         return false;
     }
     osg::Matrixf m;
     m.setRotate(osg::Quat(quat[0], quat[1], quat[2], quat[3]));
     m.setTrans(osg::Vec3f(trans[0], trans[1], trans[2]));
-    m_vis3d->node_map[nh]->setMatrix(m);
+    mt->setMatrix(m);
     if (nh == m_vis3d->gizmo.refHandle) {
         for (int i = 0; i < 16; ++i) {
             m_vis3d->gizmo.matrix[i] = *(m.ptr() + i);
         }
     }
+    m_vis3d->octree.Update(mt);
+    Vis3d__MarkMoved(m_vis3d);
     return true;
 }
 
 bool View::GetTransform(const Handle &nh, std::array<float, 3> &pos,
                         std::array<float, 4> &quat)
 {
-    if (!Vis3d__HasNode(m_vis3d, nh)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, nh);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
         return false;
     }
 
-    auto transform = m_vis3d->node_map[nh]->getMatrix();
+    auto transform = mt->getMatrix();
 
     const osg::Quat q = transform.getRotate();
     const osg::Vec3f trans = transform.getTrans();
@@ -875,12 +1798,13 @@ bool View::GetTransform(const Handle &nh, std::array<float, 3> &pos,
 
 bool View::GetPosition(const Handle &nh, std::array<float, 3> &pos)
 {
-    if (!Vis3d__HasNode(m_vis3d, nh)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, nh);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
         return false;
     }
 
-    auto transform = m_vis3d->node_map[nh]->getMatrix();
+    auto transform = mt->getMatrix();
     const osg::Vec3f trans = transform.getTrans();
     pos[0] = trans.x();
     pos[1] = trans.y();
@@ -890,12 +1814,13 @@ bool View::GetPosition(const Handle &nh, std::array<float, 3> &pos)
 
 bool View::GetRotation(const Handle &nh, std::array<float, 4> &quat)
 {
-    if (!Vis3d__HasNode(m_vis3d, nh)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, nh);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
         return false;
     }
 
-    auto transform = m_vis3d->node_map[nh]->getMatrix();
+    auto transform = mt->getMatrix();
 
     const osg::Quat q = transform.getRotate();
     quat[0] = q.x();
@@ -908,25 +1833,44 @@ bool View::GetRotation(const Handle &nh, std::array<float, 4> &quat)
 Handle View::Clone(const Handle &nh, const osg::Matrix &m)
 {
     Handle dst;
-    osg::ref_ptr<osg::MatrixTransform> mt =
-        dynamic_cast<osg::MatrixTransform *>(
-            m_vis3d->node_map[nh]->clone(osg::CopyOp::DEEP_COPY_ALL));
-    mt->setMatrix(m);
-    dst.type = nh.type;
-    dst.uid = NextHandleID();
-    mt->setName(std::string("mt") + std::to_string(NextObjectID()));
-    m_vis3d->node_switch->addChild(0, mt);
-    m_vis3d->node_map.insert({dst, mt});
+    osg::MatrixTransform *src = Vis3d__GetNode(m_vis3d, nh);
+    if (src == nullptr) {
+        LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
+        return dst;
+    }
+    if (Vis3d__IsLoading(m_vis3d, nh)) {
+        LOG_WARN("Node is still loading: type: {0}, uid: {1}.", nh.type,
+                 nh.uid);
+        return dst;
+    }
+    osg::ref_ptr<osg::MatrixTransform> mt;
+    if (m_vis3d->clone_mode == CloneMode_Shared) {
+        // copied by Vis3d__UnshareContent(...) once either one changes it
+        mt = new osg::MatrixTransform(m);
+        for (unsigned int i = 0; i < src->getNumChildren(); ++i) {
+            osg::Node *child = src->getChild(i);
+            if (Vis3d__IsContent(child)) mt->addChild(child);
+        }
+    }
+    else {
+        mt = dynamic_cast<osg::MatrixTransform *>(
+            src->clone(osg::CopyOp::DEEP_COPY_ALL));
+        mt->setMatrix(m);
+    }
+    dst = Vis3d__AddNode(m_vis3d, nh.type, mt);
     return dst;
 }
 
+void View::SetCloneMode(CloneMode mode) { m_vis3d->clone_mode = mode; }
+
 Handle View::Clone(const Handle nh)
 {
-    if (!Vis3d__HasNode(m_vis3d, nh)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, nh);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
         return Handle();
     }
-    osg::Matrix transform = m_vis3d->node_map[nh]->getMatrix();
+    osg::Matrix transform = mt->getMatrix();
 
     return Clone(nh, transform);
 }
@@ -975,16 +1919,132 @@ std::vector<Handle> View::Clone(const std::vector<Handle> &handles,
     for (int i = 0; i < hs_size; ++i) {
         transform.setRotate(
             osg::Quat(quats[i][0], quats[i][1], quats[i][2], quats[i][3]));
-        transform.setTrans(osg::Vec3f(poss[i][0], poss[i][1], poss[i][2]));
-        newhs[i] = Clone(handles[i], transform);
+        transform.setTrans(osg::Vec3f(poss[i][0], poss[i][1], poss[i][2]));
+        newhs[i] = Clone(handles[i], transform);
+    }
+
+    return newhs;
+}
+
+/// Collect the geometries of a subtree with their matrices from its root.
+class GeometryCollector : public osg::NodeVisitor
+{
+public:
+    GeometryCollector()
+        : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+    {
+    }
+
+    void apply(osg::Drawable &drawable) override
+    {
+        osg::Geometry *geom = drawable.asGeometry();
+        if (geom == nullptr || geom->getNumPrimitiveSets() == 0) return;
+        geometries.push_back(geom);
+        matrices.push_back(osg::computeLocalToWorld(getNodePath()));
+    }
+
+    std::vector<osg::Geometry *> geometries;
+    std::vector<osg::Matrix> matrices;
+};
+
+Handle View::Ghosts(const Handle &nh,
+                    const std::vector<std::array<float, 3>> &poss,
+                    const std::vector<std::array<float, 4>> &quats,
+                    const std::array<float, 2> &alpha_ramp,
+                    const std::vector<float> &color)
+{
+    Handle h;
+    osg::MatrixTransform *src = Vis3d__GetNode(m_vis3d, nh);
+    if (src == nullptr) {
+        LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
+        return h;
+    }
+    if (Vis3d__IsLoading(m_vis3d, nh)) {
+        LOG_WARN("Node is still loading: type: {0}, uid: {1}.", nh.type,
+                 nh.uid);
+        return h;
+    }
+    const size_t num = poss.size();
+    if (num < 1 || quats.size() != num) {
+        LOG_ERROR("Invalid parameters: poss.size: {0}, quats.size: {1}", num,
+                  quats.size());
+        return h;
+    }
+    if (!color.empty() && color.size() != 3 && color.size() != 4) {
+        LOG_WARN("color.size() should be 3 or 4!");
+        return h;
+    }
+
+    GeometryCollector collector;
+    for (unsigned int i = 0; i < src->getNumChildren(); ++i) {
+        osg::Node *child = src->getChild(i);
+        if (Vis3d__IsContent(child)) child->accept(collector);
+    }
+    if (collector.geometries.empty()) {
+        LOG_ERROR("No geometry for the node! ({0}, {1})", nh.type, nh.uid);
+        return h;
+    }
+
+    std::vector<osg::Matrix> poses(num);
+    std::vector<float> alphas(num);
+    for (size_t i = 0; i < num; ++i) {
+        poses[i].setRotate(
+            osg::Quat(quats[i][0], quats[i][1], quats[i][2], quats[i][3]));
+        poses[i].setTrans(osg::Vec3f(poss[i][0], poss[i][1], poss[i][2]));
+        const float t = num > 1 ? (float)i / (num - 1) : 1.f;
+        alphas[i] = alpha_ramp[0] + (alpha_ramp[1] - alpha_ramp[0]) * t;
+    }
+    bool transparent = *std::min_element(alphas.begin(), alphas.end()) < 1.f;
+    osg::ref_ptr<osg::Vec4Array> cs;
+    if (!color.empty()) {
+        cs = new osg::Vec4Array(1);
+        (*cs)[0].set(color[0], color[1], color[2],
+                     color.size() == 4 ? color[3] : 1.f);
+        transparent = transparent || (*cs)[0].a() < 1.0f;
     }
 
-    return newhs;
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    std::vector<osg::Matrix> matrices(num);
+    for (size_t g = 0; g < collector.geometries.size(); ++g) {
+        const osg::Matrix &local = collector.matrices[g];
+        for (size_t i = 0; i < num; ++i) {
+            matrices[i] = local * poses[i];
+        }
+        osg::ref_ptr<osg::Geometry> ghosts = CreateInstancedCopies(
+            *collector.geometries[g], matrices.data(), alphas.data(), num);
+        if (!ghosts) continue;
+        if (cs) {
+            ghosts->setColorArray(cs.get(), osg::Array::BIND_OVERALL);
+        }
+        else if (ghosts->getColorArray() == nullptr) {
+            // the current color would be whatever was drawn last
+            ghosts->setColorArray(
+                new osg::Vec4Array(1, osg::Vec4(0.8f, 0.8f, 0.8f, 1.f)),
+                osg::Array::BIND_OVERALL);
+        }
+        if (transparent) {
+            // on the copies, their state may set blending off
+            osg::StateSet *ss = ghosts->getOrCreateStateSet();
+            ss->setMode(GL_BLEND, osg::StateAttribute::ON);
+            ss->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+        }
+        geode->addDrawable(ghosts.get());
+    }
+    if (geode->getNumDrawables() == 0) {
+        LOG_ERROR("The node can not be drawn as ghosts! ({0}, {1})", nh.type,
+                  nh.uid);
+        return h;
+    }
+
+    osg::ref_ptr<osg::MatrixTransform> mt{new osg::MatrixTransform};
+    mt->addChild(geode);
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Ghosts, mt);
+    return h;
 }
 
 Handle View::Picked()
 {
-    // Not thread safe...
+    // Render thread only, other threads read it through Post(...)
     return m_vis3d->picked;
 }
 
@@ -992,41 +2052,181 @@ void View::UnPick() { m_vis3d->picked.Reset(); }
 
 std::array<float, 6> View::PickedPlane() { return m_vis3d->pointnorm; }
 
-Handle View::Load(const std::string &fname, const osg::Matrix &m)
+/// Whether fname names an STL file, whatever the case of its extension.
+static bool IsStlFile(const std::string &fname)
 {
-    Handle h;
+    return osgDB::getLowerCaseFileExtension(fname) == "stl";
+}
+
+static osg::ref_ptr<osg::Node> ReadModelFile(const std::string &fname)
+{
+    if (IsStlFile(fname)) {
+        osg::ref_ptr<osg::Node> model = ReadStlFile(fname);
+        if (model) {
+            // done by osgDB::readNodeFile(...) for the other files
+            osgDB::Registry *registry = osgDB::Registry::instance();
+            if (registry->getBuildKdTreesHint() == osgDB::Options::BUILD_KDTREES
+                && registry->getKdTreeBuilder()) {
+                osg::ref_ptr<osg::KdTreeBuilder> builder =
+                    registry->getKdTreeBuilder()->clone();
+                model->accept(*builder);
+            }
+            return model;
+        }
+        // e.g. colored files, which the plugin reads
+    }
     osg::ref_ptr<osg::Node> model = osgDB::readNodeFile(fname.c_str());
     if (!model) {
         LOG_ERROR("Read model {0} failed!", fname);
-        return h;
     }
+    return model;
+}
 
-    osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
+/**
+ * Read a model file through the view's model cache, thread safe. The model
+ * may be shared with other objects, so it is returned as the child of a
+ * group of this object only, which takes the per object state such as the
+ * colors set by SetColor(...).
+ */
+static osg::ref_ptr<osg::Node> Vis3d__ReadModel(Vis3d &vis3d,
+                                                const std::string &fname)
+{
+    osg::ref_ptr<osg::Node> model =
+        vis3d.model_cache.Get(fname, ReadModelFile);
+    if (!model) return model;
 
+    osg::ref_ptr<osg::Group> instance = new osg::Group;
+    instance->addChild(model);
     /// STL model doesn't have color information
-    if (fs::path(fname).extension() == ".stl") {
+    if (IsStlFile(fname)) {
         LOG_DEBUG("Adding a materal for STL file.");
         osg::ref_ptr<osg::Material> material = new osg::Material;
         material->setDiffuse(osg::Material::FRONT_AND_BACK,
                              osg::Vec4(0.5, 0.5, 0.5, 1.0));
-        model->getOrCreateStateSet()->setAttributeAndModes(
+        instance->getOrCreateStateSet()->setAttributeAndModes(
             material, osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE);
     }
+    return instance;
+}
 
-    mt->addChild(model);
+Handle View::Load(const std::string &fname, const osg::Matrix &m)
+{
+    Handle h;
+    osg::ref_ptr<osg::Node> model = Vis3d__ReadModel(*m_vis3d, fname);
+    if (!model) return h;
 
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
-    model->setName(std::to_string(NextObjectID()));
+    osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
+    mt->addChild(model);
 
     mt->setMatrix(m);
-
-    h.type = ViewObjectType_Model;
-    h.uid = NextHandleID();
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Model, mt);
     return h;
 }
 
+void View::SetModelCacheCapacity(size_t bytes)
+{
+    m_vis3d->model_cache.SetCapacity(bytes);
+}
+
+ModelCacheStats View::GetModelCacheStats() const
+{
+    return m_vis3d->model_cache.GetStats();
+}
+
+void View::ClearModelCache() { m_vis3d->model_cache.Clear(); }
+
+bool View::SaveScene(const std::string &fname)
+{
+    std::vector<SceneObject> objects;
+    objects.reserve(m_vis3d->node_map.Size());
+    m_vis3d->node_map.ForEach(
+        [&](const Handle &h, const osg::ref_ptr<osg::MatrixTransform> &mt) {
+            if (h.type == ViewObjectType_Gzimo) return;
+            if (Vis3d__IsLoading(m_vis3d, h)) {
+                LOG_WARN("Node: type: {0}, uid: {1} is still loading, it is "
+                         "not saved.",
+                         h.type, h.uid);
+                return;
+            }
+            SceneObject object;
+            object.type = h.type;
+            object.uid = h.uid;
+            object.matrix = mt->getMatrix();
+            for (unsigned int i = 0; i < mt->getNumChildren(); ++i) {
+                osg::Node *child = mt->getChild(i);
+                if (Vis3d__IsContent(child)) object.contents.push_back(child);
+            }
+            object.visible = mt->getNodeMask() != 0;
+            for (unsigned int i = 0; i < mt->getNumParents(); ++i) {
+                const osg::Group *parent = mt->getParent(i);
+                if (auto tag = dynamic_cast<const HandleTag *>(
+                        parent->getUserData())) {
+                    object.parent_uid = tag->handle.uid;
+                }
+            }
+            objects.push_back(object);
+        });
+    return WriteSceneFile(fname, objects);
+}
+
+bool View::LoadScene(const std::string &fname)
+{
+    if (m_vis3d->batch.active) {
+        LOG_ERROR("Can not load scene {0} during a batch.", fname);
+        return false;
+    }
+    std::vector<SceneObject> objects;
+    if (!ReadSceneFile(fname, objects)) {
+        return false;
+    }
+
+    Clear();
+    std::unordered_map<uint64_t, osg::MatrixTransform *> mts;
+    std::vector<std::pair<osg::MatrixTransform *, const SceneObject *>> links;
+    links.reserve(objects.size());
+    for (const auto &object : objects) {
+        const Handle h(object.type, object.uid);
+        osg::ref_ptr<osg::MatrixTransform> mt =
+            new osg::MatrixTransform(object.matrix);
+        for (const auto &content : object.contents) {
+            mt->addChild(content);
+        }
+        if (!m_vis3d->node_map.InsertAt(h, mt)) {
+            LOG_ERROR("Duplicated node: type: {0}, uid: {1} in {2}.", h.type,
+                      h.uid, fname);
+            continue;
+        }
+        for (const auto &content : object.contents) {
+            PointCloudLODNode *lod =
+                dynamic_cast<PointCloudLODNode *>(content.get());
+            if (lod) lod->SetPointBudget(m_vis3d->point_budget);
+            Vis3d__PrepareContent(m_vis3d, h.type, content.get());
+        }
+        mt->setUserData(new HandleTag(h));
+        mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
+        mts[h.uid] = mt.get();
+        links.emplace_back(mt.get(), &object);
+    }
+    // parents may come after their chained objects in the file, and the
+    // octree places objects by their bound, chained objects included
+    std::vector<osg::MatrixTransform *> top_level;
+    for (const auto &link : links) {
+        Vis3d__SetVisible(link.first, link.second->visible);
+        auto parent = mts.find(link.second->parent_uid);
+        if (link.second->parent_uid != 0 && parent != mts.end()) {
+            parent->second->addChild(link.first);
+        }
+        else {
+            top_level.push_back(link.first);
+        }
+    }
+    for (osg::MatrixTransform *mt : top_level) {
+        m_vis3d->octree.Insert(mt);
+    }
+    Vis3d__MarkDirty(m_vis3d);
+    return true;
+}
+
 Handle View::Load(const std::string &fname)
 {
     osg::Matrix transform;
@@ -1042,15 +2242,52 @@ Handle View::Load(const std::string &fname, const std::array<float, 3> &pos,
     return Load(fname, transform);
 }
 
+/**
+ * Read the model files on the worker pool, which also builds their k-d trees
+ * (see the hint set by the View constructor), and log the time spent on
+ * each. Return the models in the order of fnames, null where reading failed.
+ */
+static std::vector<osg::ref_ptr<osg::Node>>
+Vis3d__ReadModels(const std::shared_ptr<Vis3d> vis3d,
+                  const std::vector<std::string> &fnames)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    std::vector<std::future<osg::ref_ptr<osg::Node>>> futures;
+    futures.reserve(fnames.size());
+    for (const auto &fname : fnames) {
+        auto task =
+            std::make_shared<std::packaged_task<osg::ref_ptr<osg::Node>()>>(
+                [&vis3d, &fname]() {
+                    const auto t0 = Clock::now();
+                    osg::ref_ptr<osg::Node> model =
+                        Vis3d__ReadModel(*vis3d, fname);
+                    const std::chrono::duration<double, std::milli> ms =
+                        Clock::now() - t0;
+                    LOG_INFO("Read {0} in {1:.1f} ms", fname, ms.count());
+                    return model;
+                });
+        futures.push_back(task->get_future());
+        vis3d->workers.Submit([task]() { (*task)(); });
+    }
+
+    std::vector<osg::ref_ptr<osg::Node>> models(fnames.size());
+    for (size_t i = 0; i < futures.size(); ++i) {
+        models[i] = futures[i].get();
+    }
+    const std::chrono::duration<double, std::milli> ms = Clock::now() - start;
+    LOG_INFO("Read {0} models in {1:.1f} ms on {2} threads", fnames.size(),
+             ms.count(), vis3d->workers.Size());
+    return models;
+}
+
 std::vector<Handle> View::Load(const std::vector<std::string> &fnames)
 {
-    std::vector<Handle> hs(fnames.size());
-    int i = 0;
-    osg::Matrix transform;
-    for (auto &name : fnames) {
-        hs[i++] = Load(name, transform);
-    }
-    return hs;
+    const std::vector<std::array<float, 3>> poss(fnames.size(),
+                                                 {0.f, 0.f, 0.f});
+    const std::vector<std::array<float, 4>> quats(fnames.size(),
+                                                  {0.f, 0.f, 0.f, 1.f});
+    return Load(fnames, poss, quats);
 }
 
 std::vector<Handle> View::Load(const std::vector<std::string> &fnames,
@@ -1058,15 +2295,27 @@ std::vector<Handle> View::Load(const std::vector<std::string> &fnames,
                                const std::vector<std::array<float, 4>> &quats)
 {
     std::vector<Handle> hs(fnames.size());
-    int i = 0;
-    osg::Matrix transform;
-    for (auto &name : fnames) {
+    if (poss.size() != fnames.size() || quats.size() != fnames.size()) {
+        LOG_ERROR("Number of files [{0}], positions [{1}] and rotations [{2}] "
+                  "do not match.",
+                  fnames.size(), poss.size(), quats.size());
+        return hs;
+    }
+
+    // only the scene graph insertion is left for this thread
+    const std::vector<osg::ref_ptr<osg::Node>> models =
+        Vis3d__ReadModels(m_vis3d, fnames);
+    for (size_t i = 0; i < models.size(); ++i) {
+        if (!models[i]) continue;
+        osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
+        mt->addChild(models[i]);
+        osg::Matrix transform;
         transform.setRotate(
             osg::Quat(quats[i][0], quats[i][1], quats[i][2], quats[i][3]));
         transform.setTrans(osg::Vec3f(poss[i][0], poss[i][1], poss[i][2]));
-        hs[i++] = Load(name, transform);
+        mt->setMatrix(transform);
+        hs[i] = Vis3d__AddNode(m_vis3d, ViewObjectType_Model, mt);
     }
-
     return hs;
 }
 
@@ -1112,18 +2361,11 @@ Handle View::Axes(const osg::Matrix &m, float axis_len, float axis_size)
                                           osg::StateAttribute::OFF);
     geode->addDrawable(geo);
 
-    h.type = ViewObjectType_Axes;
-    h.uid = NextHandleID();
-
     osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
     mt->addChild(geode);
 
-    geode->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
-
     mt->setMatrix(m);
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Axes, mt);
     return h;
 }
 
@@ -1150,27 +2392,29 @@ Handle View::Axes(const std::array<float, 16> &transform, float axis_len,
     return Axes(m, axis_len, axis_size);
 }
 
-Handle View::Point(const std::vector<float> &xyzs, float size,
-                   const std::vector<float> &colors)
+/// Build the geode of a point cloud, thread safe. Return null if the
+/// arguments are wrong.
+static osg::ref_ptr<osg::Geode>
+CreatePointGeode(const std::vector<float> &xyzs, float size,
+                 const std::vector<float> &colors)
 {
-    Handle h;
     const size_t xyzs_size = xyzs.size();
     const size_t numpt = xyzs_size / 3;
     const size_t colors_size = colors.size();
 
     if (xyzs_size == 0 || xyzs_size % 3 != 0) {
         LOG_WARN("xyzs.size() is wrong! {0}", xyzs_size);
-        return h;
+        return nullptr;
     }
 
     if (size <= 0) {
         LOG_WARN("point size is wrong! {0}", size);
-        return h;
+        return nullptr;
     }
 
     if (colors_size == 0 || (colors_size % 3 != 0 && colors_size % 4 != 0)) {
         LOG_WARN("colors.size is wrong! {0}", colors_size);
-        return h;
+        return nullptr;
     }
 
     size_t color_channels = 0;
@@ -1184,7 +2428,7 @@ Handle View::Point(const std::vector<float> &xyzs, float size,
         else {
             LOG_WARN("colors.size [{}] not match point size [{}].", colors_size,
                      numpt);
-            return h;
+            return nullptr;
         }
     }
     else {
@@ -1195,7 +2439,7 @@ Handle View::Point(const std::vector<float> &xyzs, float size,
 
     if (numcl != 1 && numcl != numpt) {
         LOG_ERROR("color size [{}] not match point size [{}].", numcl, numpt);
-        return h;
+        return nullptr;
     }
 
     osg::ref_ptr<osg::Vec3Array> vs =
@@ -1215,6 +2459,97 @@ Handle View::Point(const std::vector<float> &xyzs, float size,
     geo->setColorBinding(numcl == numpt ? osg::Geometry::BIND_PER_VERTEX
                                         : osg::Geometry::BIND_OVERALL);
 
+    geo->addPrimitiveSet(
+        new osg::DrawArrays(osg::PrimitiveSet::POINTS, 0, numpt));
+    geo->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+    geo->getOrCreateStateSet()->setAttribute(new osg::Point(size),
+                                             osg::StateAttribute::ON);
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    geode->addDrawable(geo.get());
+    return geode;
+}
+
+Handle View::Point(const std::vector<float> &xyzs, float size,
+                   const std::vector<float> &colors)
+{
+    Handle h;
+    osg::ref_ptr<osg::Geode> geode = CreatePointGeode(xyzs, size, colors);
+    if (!geode) return h;
+
+    osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
+    mt->addChild(geode);
+
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Point, mt);
+    return h;
+}
+
+Handle View::Point(const PointBuffer &buffer, float size,
+                   const std::vector<float> &color)
+{
+    Handle h;
+    // Owns the caller's memory from here on: both arrays share it, and the
+    // release callback runs once the last of them is gone (or right away if
+    // we bail out below).
+    const auto release = buffer.release;
+    std::shared_ptr<const void> owner(buffer.xyzs, [release](const void *) {
+        if (release) release();
+    });
+
+    if (buffer.xyzs == nullptr || buffer.count == 0) {
+        LOG_WARN("point buffer is empty!");
+        return h;
+    }
+
+    if (buffer.count > std::numeric_limits<unsigned int>::max()) {
+        LOG_WARN("point buffer is too large! {0}", buffer.count);
+        return h;
+    }
+
+    if (size <= 0) {
+        LOG_WARN("point size is wrong! {0}", size);
+        return h;
+    }
+
+    if (buffer.colors != nullptr && buffer.color_channels != 3
+        && buffer.color_channels != 4) {
+        LOG_WARN("color channels [{}] must be 3 or 4.", buffer.color_channels);
+        return h;
+    }
+
+    if (buffer.colors == nullptr && color.size() != 3 && color.size() != 4) {
+        LOG_WARN("color.size() should be 3 or 4! {0}", color.size());
+        return h;
+    }
+
+    const unsigned int numpt = static_cast<unsigned int>(buffer.count);
+    osg::ref_ptr<osg::Array> vs = new ExternalVec3Array(
+        reinterpret_cast<const osg::Vec3 *>(buffer.xyzs), numpt, owner);
+
+    osg::ref_ptr<osg::Array> cs;
+    if (buffer.colors == nullptr) {
+        if (color.size() == 3) {
+            cs = new osg::Vec3Array(1, (const osg::Vec3 *)(color.data()));
+        }
+        else {
+            cs = new osg::Vec4Array(1, (const osg::Vec4 *)(color.data()));
+        }
+    }
+    else if (buffer.color_channels == 3) {
+        cs = new ExternalVec3Array(
+            reinterpret_cast<const osg::Vec3 *>(buffer.colors), numpt, owner);
+    }
+    else {
+        cs = new ExternalVec4Array(
+            reinterpret_cast<const osg::Vec4 *>(buffer.colors), numpt, owner);
+    }
+
+    osg::ref_ptr<osg::Geometry> geo = new osg::Geometry;
+    geo->setVertexArray(vs.get());
+    geo->setColorArray(cs.get());
+    geo->setColorBinding(buffer.colors != nullptr
+                             ? osg::Geometry::BIND_PER_VERTEX
+                             : osg::Geometry::BIND_OVERALL);
+
     geo->addPrimitiveSet(
         new osg::DrawArrays(osg::PrimitiveSet::POINTS, 0, numpt));
     geo->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
@@ -1224,17 +2559,123 @@ Handle View::Point(const std::vector<float> &xyzs, float size,
     osg::ref_ptr<osg::Geode> geode = new osg::Geode;
     geode->addDrawable(geo.get());
     mt->addChild(geode);
-    h.type = ViewObjectType_Point;
-    h.uid = NextHandleID();
 
-    geode->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Point, mt);
+    return h;
+}
+
+static Handle Vis3d__AddPointCloudLOD(const std::shared_ptr<Vis3d> vis3d,
+                                      const float *xyzs, const float *colors,
+                                      int color_channels, size_t numpt,
+                                      const osg::Vec4 &color, float size)
+{
+    osg::ref_ptr<PointCloudLODNode> lod =
+        CreatePointCloudLOD(xyzs, colors, color_channels, numpt, color);
+    lod->SetPointBudget(vis3d->point_budget);
+    lod->SetPixelError(size);
+    lod->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+    lod->getOrCreateStateSet()->setAttribute(new osg::Point(size),
+                                             osg::StateAttribute::ON);
+    LOG_DEBUG("PointCloudLOD: {0} points in {1} cells.", numpt,
+              lod->GetCells().size());
+
+    osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
+    mt->addChild(lod.get());
+    return Vis3d__AddNode(vis3d, ViewObjectType_PointCloudLOD, mt);
+}
+
+Handle View::PointCloudLOD(const std::vector<float> &xyzs, float size,
+                           const std::vector<float> &colors)
+{
+    Handle h;
+    const size_t xyzs_size = xyzs.size();
+    const size_t numpt = xyzs_size / 3;
+    if (xyzs_size == 0 || xyzs_size % 3 != 0) {
+        LOG_WARN("xyzs.size() is wrong! {0}", xyzs_size);
+        return h;
+    }
+    if (numpt > std::numeric_limits<uint32_t>::max()) {
+        LOG_WARN("too many points! {0}", numpt);
+        return h;
+    }
+    if (size <= 0) {
+        LOG_WARN("point size is wrong! {0}", size);
+        return h;
+    }
+
+    const size_t color_channels = ResolveColorChannels(colors.size(), numpt);
+    if (color_channels == 0) {
+        LOG_WARN("colors.size [{}] not match point size [{}].", colors.size(),
+                 numpt);
+        return h;
+    }
+    const size_t numcl = colors.size() / color_channels;
+    osg::Vec4 color(colors[0], colors[1], colors[2],
+                    color_channels == 4 ? colors[3] : 1.f);
+
+    h = Vis3d__AddPointCloudLOD(m_vis3d, xyzs.data(),
+                                numcl == 1 ? nullptr : colors.data(),
+                                static_cast<int>(color_channels), numpt,
+                                color, size);
+    return h;
+}
 
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+Handle View::PointCloudLOD(const PointBuffer &buffer, float size,
+                           const std::vector<float> &color)
+{
+    Handle h;
+    if (buffer.xyzs == nullptr || buffer.count == 0) {
+        LOG_WARN("point buffer is empty!");
+    }
+    else if (buffer.count > std::numeric_limits<uint32_t>::max()) {
+        LOG_WARN("too many points! {0}", buffer.count);
+    }
+    else if (size <= 0) {
+        LOG_WARN("point size is wrong! {0}", size);
+    }
+    else if (buffer.colors != nullptr && buffer.color_channels != 3
+             && buffer.color_channels != 4) {
+        LOG_WARN("color channels [{}] must be 3 or 4.", buffer.color_channels);
+    }
+    else if (buffer.colors == nullptr && color.size() != 3
+             && color.size() != 4) {
+        LOG_WARN("color.size() should be 3 or 4! {0}", color.size());
+    }
+    else {
+        const osg::Vec4 overall =
+            buffer.colors != nullptr
+                ? osg::Vec4(1.f, 1.f, 1.f, 1.f)
+                : osg::Vec4(color[0], color[1], color[2],
+                            color.size() == 4 ? color[3] : 1.f);
+        h = Vis3d__AddPointCloudLOD(m_vis3d, buffer.xyzs, buffer.colors,
+                                    buffer.color_channels, buffer.count,
+                                    overall, size);
+    }
+
+    // the octree holds its own copy
+    if (buffer.release) buffer.release();
     return h;
 }
 
+bool View::SetPointBudget(size_t budget)
+{
+    if (budget == 0) {
+        LOG_ERROR("Point budget should be positive!");
+        return false;
+    }
+    m_vis3d->point_budget = budget;
+    m_vis3d->node_map.ForEach(
+        [budget](const Handle &h,
+                 const osg::ref_ptr<osg::MatrixTransform> &mt) {
+            if (h.type != ViewObjectType_PointCloudLOD) return;
+            PointCloudLODNode *lod =
+                dynamic_cast<PointCloudLODNode *>(mt->getChild(0));
+            if (lod) lod->SetPointBudget(budget);
+        });
+    Vis3d__MarkDirty(m_vis3d);
+    return true;
+}
+
 Handle View::Line(const std::vector<float> &lines, float size,
                   const std::vector<float> &colors, int mode)
 {
@@ -1366,123 +2807,11 @@ Handle View::Line(const std::vector<float> &lines, float size,
     osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
     geode->addDrawable(geo.get());
     mt->addChild(geode);
-    h.type = ViewObjectType_Line;
-    h.uid = NextHandleID();
-
-    geode->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
 
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Line, mt);
     return h;
 }
 
-static bool GenerateGridMesh(float xlenth, float ylenth, int half_x_num_cells,
-                             int half_y_num_cells, std::vector<float> &vertices,
-                             std::vector<unsigned int> &indices)
-{
-    if (xlenth <= 0 || ylenth <= 0 || half_x_num_cells < 1
-        || half_y_num_cells < 1) {
-        LOG_ERROR("Invalid parameters! All parameters should be positive. {}, "
-                  "{}, {}, {}",
-                  xlenth, ylenth, half_x_num_cells, half_y_num_cells);
-        return false;
-    }
-
-    const int64_t max_cell_num = 40000000;
-    int64_t all_num_cells =
-        (int64_t)half_x_num_cells * (int64_t)half_y_num_cells * 4;
-
-    if (all_num_cells > max_cell_num) {
-        LOG_ERROR("To much cells! Can not handle {} cells.", all_num_cells);
-        return false;
-    }
-
-    vertices.clear();
-    indices.clear();
-
-    int x_vertices_num = half_x_num_cells * 2 + 1;
-    int y_vertices_num = half_y_num_cells * 2 + 1;
-    int vertices_num = x_vertices_num * y_vertices_num;
-    vertices.resize((size_t)vertices_num * 3);
-    indices.resize(2 * (size_t)half_x_num_cells * 2 * half_y_num_cells * 2 * 3);
-
-    size_t pi = 0;
-    float x_cell_size = xlenth / (half_x_num_cells * 2);
-    float y_cell_size = ylenth / (half_y_num_cells * 2);
-
-    // generate vertices
-    for (int y = -half_y_num_cells; y <= half_y_num_cells; ++y) {
-        for (int x = -half_x_num_cells; x <= half_x_num_cells; ++x) {
-            vertices[pi * 3 + 0] = x * x_cell_size;
-            vertices[pi * 3 + 1] = y * y_cell_size;
-            vertices[pi * 3 + 2] = 0;
-            ++pi;
-        }
-    }
-
-    // assign indices in anti-clockwise order
-    pi = 0;
-    for (int j = 0; j < y_vertices_num - 1; j++) {
-        for (int i = 0; i < x_vertices_num - 1; ++i) {
-            int row1 = j * x_vertices_num;
-            int row2 = (j + 1) * x_vertices_num;
-            indices[pi++] = row1 + i;
-            indices[pi++] = row2 + i + 1;
-            indices[pi++] = row2 + i;
-            indices[pi++] = row1 + i;
-            indices[pi++] = row1 + i + 1;
-            indices[pi++] = row2 + i + 1;
-        }
-    }
-    return true;
-}
-
-static void TransformVertices(const std::array<float, 3> &trans,
-                              const std::array<float, 9> &rotation,
-                              std::vector<float> &pts)
-{
-    size_t npts = pts.size() / 3;
-    for (size_t i = 0; i < npts; ++i) {
-        const float x = pts[i * 3 + 0];
-        const float y = pts[i * 3 + 1];
-        const float z = pts[i * 3 + 2];
-        pts[i * 3 + 0] =
-            rotation[0] * x + rotation[1] * y + rotation[2] * z + trans[0];
-        pts[i * 3 + 1] =
-            rotation[3] * x + rotation[4] * y + rotation[5] * z + trans[1];
-        pts[i * 3 + 2] =
-            rotation[6] * x + rotation[7] * y + rotation[8] * z + trans[2];
-    }
-}
-
-static void Quaternion2Matrix(const std::array<float, 4> &quat,
-                              std::array<float, 9> &R)
-{
-    float x = quat[0];
-    float y = quat[1];
-    float z = quat[2];
-    float w = quat[3];
-
-    float invNorm;
-    invNorm = 1.0f / (float)std::sqrt(w * w + x * x + y * y + z * z);
-
-    w *= invNorm;
-    x *= invNorm;
-    y *= invNorm;
-    z *= invNorm;
-
-    R[0] = 1 - 2 * y * y - 2 * z * z;
-    R[1] = 2 * x * y - 2 * w * z;
-    R[2] = 2 * x * z + 2 * w * y;
-    R[3] = 2 * x * y + 2 * w * z;
-    R[4] = 1 - 2 * x * x - 2 * z * z;
-    R[5] = 2 * y * z - 2 * w * x;
-    R[6] = 2 * x * z - 2 * w * y;
-    R[7] = 2 * y * z + 2 * w * x;
-    R[8] = 1 - 2 * x * x - 2 * y * y;
-}
-
 Handle View::Box(const std::array<float, 3> &pos,
                  const std::array<float, 3> &extents,
                  const std::vector<float> &color)
@@ -1523,17 +2852,10 @@ Handle View::Box(const std::array<float, 3> &pos,
     geode->addDrawable(sd);
     mt->addChild(geode);
 
-    h.type = ViewObjectType_Box;
-    h.uid = NextHandleID();
-
-    geode->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
-
     osg::Matrixf m;
     m.setTrans(pos[0], pos[1], pos[2]);
     mt->setMatrix(m);
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Box, mt);
     return h;
 }
 
@@ -1576,17 +2898,10 @@ Handle View::Cylinder(const std::array<float, 3> &center, float radius,
     geode->addDrawable(sd);
     mt->addChild(geode);
 
-    h.type = ViewObjectType_Cylinder;
-    h.uid = NextHandleID();
-
-    geode->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
-
     osg::Matrixf m;
     m.setTrans(center[0], center[1], center[2]);
     mt->setMatrix(m);
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Cylinder, mt);
     return h;
 }
 
@@ -1628,17 +2943,77 @@ Handle View::Sphere(const std::array<float, 3> &center, float radius,
     geode->addDrawable(sd);
     mt->addChild(geode);
 
-    h.type = ViewObjectType_Sphere;
-    h.uid = NextHandleID();
-
-    geode->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
-
     osg::Matrixf m;
     m.setTrans(center[0], center[1], center[2]);
     mt->setMatrix(m);
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Sphere, mt);
+    return h;
+}
+
+/// Expand values holding either 1 or count groups of n floats into count
+/// groups, checking that all of them are positive.
+static bool ExpandPerInstance(const std::vector<float> &values, size_t count,
+                              size_t n, std::vector<float> &expanded)
+{
+    if (values.size() != n && values.size() != count * n) return false;
+    for (const auto v : values) {
+        if (v <= 0) return false;
+    }
+    if (values.size() == count * n) {
+        expanded = values;
+        return true;
+    }
+    expanded.resize(count * n);
+    for (size_t i = 0; i < count; ++i) {
+        std::copy(values.begin(), values.end(), expanded.begin() + i * n);
+    }
+    return true;
+}
+
+/// Expand 1 or count RGB/RGBA colors into count RGBA colors.
+static bool ExpandInstanceColors(const std::vector<float> &colors,
+                                 size_t count, std::vector<float> &rgba)
+{
+    const size_t color_channels = ResolveColorChannels(colors.size(), count);
+    if (color_channels == 0) return false;
+    const size_t numcl = colors.size() / color_channels;
+    rgba.resize(count * 4);
+    for (size_t i = 0; i < count; ++i) {
+        const float *c = &colors[(numcl == 1 ? 0 : i) * color_channels];
+        rgba[i * 4 + 0] = c[0];
+        rgba[i * 4 + 1] = c[1];
+        rgba[i * 4 + 2] = c[2];
+        rgba[i * 4 + 3] = color_channels == 4 ? c[3] : 1.f;
+    }
+    return true;
+}
+
+/// Common part of Spheres/Boxes/Cylinders/Cones. scales holds 3 floats per
+/// instance.
+static Handle Vis3d__AddInstancedShapes(const std::shared_ptr<Vis3d> vis3d,
+                                        ViewObjectType type,
+                                        InstancedShape shape,
+                                        const std::vector<float> &centers,
+                                        const std::vector<float> &scales,
+                                        const std::vector<float> &colors)
+{
+    Handle h;
+    const size_t count = centers.size() / 3;
+    std::vector<float> rgba;
+    if (!ExpandInstanceColors(colors, count, rgba)) {
+        LOG_WARN("colors.size is wrong! {0}", colors.size());
+        return h;
+    }
+
+    osg::ref_ptr<osg::Geometry> geom = CreateInstancedShapes(
+        shape, centers.data(), scales.data(), rgba.data(), count);
+
+    osg::ref_ptr<osg::MatrixTransform> mt{new osg::MatrixTransform};
+    osg::ref_ptr<osg::Geode> geode{new osg::Geode()};
+    geode->addDrawable(geom.get());
+    mt->addChild(geode);
+
+    h = Vis3d__AddNode(vis3d, type, mt);
     return h;
 }
 
@@ -1646,68 +3021,106 @@ Handle View::Spheres(const std::vector<float> &centers,
                      std::vector<float> &radii,
                      const std::vector<float> &colors)
 {
-    Handle h;
-    const int centers_size = (int)centers.size();
-    const int radii_size = (int)radii.size();
-    const int colors_size = (int)colors.size();
-
+    const size_t centers_size = centers.size();
     if (centers_size == 0 || centers_size % 3 != 0) {
         LOG_WARN("centers.size() is wrong! {0}", centers_size);
-        return h;
+        return Handle();
     }
+    const size_t num_spheres = centers_size / 3;
 
-    const int num_spheres = centers_size / 3;
-
-    if (radii_size == 0 || (radii_size != 1 && radii_size != num_spheres)) {
-        LOG_WARN("radii.size() is wrong! {0}", radii_size);
-        return h;
+    std::vector<float> rs;
+    if (!ExpandPerInstance(radii, num_spheres, 1, rs)) {
+        LOG_WARN("radii is wrong! size: {0}", radii.size());
+        return Handle();
     }
 
-    for (auto &radius : radii) {
-        if (radius <= 0) {
-            LOG_WARN("radius is wrong! {0}", radius);
-            return h;
-        }
+    std::vector<float> scales(num_spheres * 3);
+    for (size_t i = 0; i < num_spheres; ++i) {
+        scales[i * 3 + 0] = scales[i * 3 + 1] = scales[i * 3 + 2] = rs[i];
     }
+    return Vis3d__AddInstancedShapes(m_vis3d, ViewObjectType_Spheres,
+                                     InstancedShape_Sphere, centers, scales,
+                                     colors);
+}
 
-    if (colors_size == 0 || colors_size % 4 != 0
-        || (colors_size / 4 != num_spheres && colors_size != 4)) {
-        LOG_WARN("colors.size is wrong! {0}", colors_size);
-        return h;
+Handle View::Boxes(const std::vector<float> &centers,
+                   const std::vector<float> &extents,
+                   const std::vector<float> &colors)
+{
+    const size_t centers_size = centers.size();
+    if (centers_size == 0 || centers_size % 3 != 0) {
+        LOG_WARN("centers.size() is wrong! {0}", centers_size);
+        return Handle();
     }
+    const size_t num_boxes = centers_size / 3;
 
-    osg::ref_ptr<osg::MatrixTransform> mt{new osg::MatrixTransform};
-    osg::ref_ptr<osg::Geode> geode{new osg::Geode()};
+    std::vector<float> scales;
+    if (!ExpandPerInstance(extents, num_boxes, 3, scales)) {
+        LOG_WARN("extents is wrong! size: {0}", extents.size());
+        return Handle();
+    }
+    return Vis3d__AddInstancedShapes(m_vis3d, ViewObjectType_Boxes,
+                                     InstancedShape_Box, centers, scales,
+                                     colors);
+}
 
-    for (int i = 0; i < num_spheres; ++i) {
-        osg::ref_ptr<osg::Sphere> sphere{new osg::Sphere()};
-        double radius = (radii_size == 1) ? radii[0] : radii[i];
-        sphere->setCenter(osg::Vec3f(centers[0 + 3 * i], centers[1 + 3 * i],
-                                     centers[2 + 3 * i]));
-        sphere->setRadius(radius);
-        osg::ref_ptr<osg::ShapeDrawable> sd{
-            new osg::ShapeDrawable(sphere.get())};
-        int offset_index = (colors_size == 1) ? 0 : i;
-        sd->setColor(osg::Vec4(
-            colors[0 + 4 * offset_index], colors[1 + 4 * offset_index],
-            colors[2 + 4 * offset_index], colors[3 + 4 * offset_index]));
+/// Common part of Cylinders/Cones, which are both scaled by (r, r, h).
+static bool RadiusHeightScales(const std::vector<float> &centers,
+                               const std::vector<float> &radii,
+                               const std::vector<float> &heights,
+                               std::vector<float> &scales)
+{
+    const size_t centers_size = centers.size();
+    if (centers_size == 0 || centers_size % 3 != 0) {
+        LOG_WARN("centers.size() is wrong! {0}", centers_size);
+        return false;
+    }
+    const size_t count = centers_size / 3;
 
-        sd->getOrCreateStateSet()->setMode(GL_BLEND, osg::StateAttribute::ON);
-        sd->getOrCreateStateSet()->setRenderingHint(
-            osg::StateSet::TRANSPARENT_BIN);
-        geode->addDrawable(sd);
-        mt->addChild(geode);
+    std::vector<float> rs, hs;
+    if (!ExpandPerInstance(radii, count, 1, rs)) {
+        LOG_WARN("radii is wrong! size: {0}", radii.size());
+        return false;
+    }
+    if (!ExpandPerInstance(heights, count, 1, hs)) {
+        LOG_WARN("heights is wrong! size: {0}", heights.size());
+        return false;
     }
 
-    h.type = ViewObjectType_Spheres;
-    h.uid = NextHandleID();
+    scales.resize(count * 3);
+    for (size_t i = 0; i < count; ++i) {
+        scales[i * 3 + 0] = scales[i * 3 + 1] = rs[i];
+        scales[i * 3 + 2] = hs[i];
+    }
+    return true;
+}
 
-    geode->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
+Handle View::Cylinders(const std::vector<float> &centers,
+                       const std::vector<float> &radii,
+                       const std::vector<float> &heights,
+                       const std::vector<float> &colors)
+{
+    std::vector<float> scales;
+    if (!RadiusHeightScales(centers, radii, heights, scales)) {
+        return Handle();
+    }
+    return Vis3d__AddInstancedShapes(m_vis3d, ViewObjectType_Cylinders,
+                                     InstancedShape_Cylinder, centers, scales,
+                                     colors);
+}
 
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
-    return h;
+Handle View::Cones(const std::vector<float> &centers,
+                   const std::vector<float> &radii,
+                   const std::vector<float> &heights,
+                   const std::vector<float> &colors)
+{
+    std::vector<float> scales;
+    if (!RadiusHeightScales(centers, radii, heights, scales)) {
+        return Handle();
+    }
+    return Vis3d__AddInstancedShapes(m_vis3d, ViewObjectType_Cones,
+                                     InstancedShape_Cone, centers, scales,
+                                     colors);
 }
 
 Handle View::Cone(const std::array<float, 3> &center, float radius,
@@ -1751,17 +3164,10 @@ Handle View::Cone(const std::array<float, 3> &center, float radius,
     geode->addDrawable(sd);
     mt->addChild(geode);
 
-    h.type = ViewObjectType_Cone;
-    h.uid = NextHandleID();
-
-    geode->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
-
     osg::Matrixf m;
     m.setTrans(center[0], center[1], center[2]);
     mt->setMatrix(m);
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Cone, mt);
 
     return h;
 }
@@ -1843,42 +3249,47 @@ Handle View::Arrow(const std::array<float, 3> &tail,
     mt->addChild(geode_cone);
     mt->addChild(geode_cylinder);
 
-    h.type = ViewObjectType_Arrow;
-    h.uid = NextHandleID();
-
-    geode_cone->setName(std::to_string(NextObjectID()));
-    geode_cylinder->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
-
     osg::Matrixf m;
     m.setTrans(tail[0], tail[1], tail[2]);
     m.setRotate(quat);
     mt->setMatrix(m);
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Arrow, mt);
     return h;
 }
 
-Handle View::Mesh(const std::vector<float> &vertices,
-                  const std::vector<unsigned int> &indices,
-                  const std::vector<float> &colors)
+/// Build the geode of a triangle mesh, thread safe. Return null if the
+/// arguments are wrong.
+static osg::ref_ptr<osg::Geode>
+CreateMeshGeode(const std::vector<float> &vertices,
+                const std::vector<unsigned int> &indices,
+                const std::vector<float> &colors, const MeshOptions &options)
 {
-    Handle h;
     const size_t vertices_size = vertices.size();
     const size_t indices_size = indices.size();
     const size_t colors_size = colors.size();
-    const size_t numverts = vertices_size / 3;
+    size_t numverts = vertices_size / 3;
     if (vertices_size == 0 || vertices_size % 3 != 0) {
         LOG_WARN("vertices.size() is wrong! {0}", vertices_size);
-        return h;
+        return nullptr;
     }
     if (indices_size == 0 || indices_size % 3 != 0) {
         LOG_WARN("indices.size() is wrong! {0}", indices_size);
-        return h;
+        return nullptr;
+    }
+    for (const auto i : indices) {
+        if (i >= numverts) {
+            LOG_WARN("index {0} out of range [0, {1}).", i, numverts);
+            return nullptr;
+        }
     }
     if (colors_size == 0 || (colors_size % 3 != 0 && colors_size % 4 != 0)) {
         LOG_WARN("colors.size is wrong! {0}", colors_size);
-        return h;
+        return nullptr;
+    }
+    if (!options.normals.empty() && options.normals.size() != vertices_size) {
+        LOG_WARN("normals.size() [{0}] should be vertices.size() [{1}].",
+                 options.normals.size(), vertices_size);
+        return nullptr;
     }
 
     size_t color_channels = 0;
@@ -1892,53 +3303,150 @@ Handle View::Mesh(const std::vector<float> &vertices,
         else {
             LOG_WARN("colors.size [{}] not match vertices size [{}].",
                      colors_size, numverts);
-            return h;
+            return nullptr;
         }
     }
     else {
         color_channels = colors_size % 3 == 0 ? 3 : 4;
     }
-    const size_t numcolors = colors_size / color_channels;
+    size_t numcolors = colors_size / color_channels;
 
     if (numcolors != 1 && numcolors != numverts) {
         LOG_WARN("Color number should be 1 or the same with points number! "
                  "[{}] != [{}]",
                  numcolors, numverts);
-        return h;
+        return nullptr;
+    }
+
+    // decided before welding, which may leave a single vertex
+    const bool per_vertex_colors = numcolors == numverts;
+    std::vector<VertexAttribute> attributes{{vertices.data(), 3}};
+    if (per_vertex_colors) {
+        attributes.push_back({colors.data(), color_channels});
+    }
+    if (!options.normals.empty()) {
+        attributes.push_back({options.normals.data(), 3});
+    }
+    std::vector<unsigned int> ids(indices);
+    std::vector<std::vector<float>> welded;
+    if (options.weld) {
+        std::vector<unsigned int> remap;
+        const size_t count = WeldVertices(attributes, numverts, remap);
+        for (auto &i : ids) {
+            i = remap[i];
+        }
+        for (auto &attribute : attributes) {
+            welded.push_back(RemapAttribute(attribute, remap, count));
+            attribute.data = welded.back().data();
+        }
+        if (per_vertex_colors) numcolors = count;
+        numverts = count;
+    }
+    if (options.optimize) {
+        OptimizeVertexCache(ids.data(), ids.size(), numverts);
     }
 
     osg::ref_ptr<osg::Array> cs;
+    const float *color_data =
+        per_vertex_colors ? attributes[1].data : colors.data();
     if (color_channels == 3) {
-        cs = new osg::Vec3Array(numcolors, (const osg::Vec3 *)(colors.data()));
+        cs = new osg::Vec3Array(numcolors, (const osg::Vec3 *)color_data);
     }
     else {
-        cs = new osg::Vec4Array(numcolors, (const osg::Vec4 *)(colors.data()));
+        cs = new osg::Vec4Array(numcolors, (const osg::Vec4 *)color_data);
     }
-    osg::ref_ptr<osg::Vec3Array> ref_vertices =
-        new osg::Vec3Array(vertices_size, (const osg::Vec3 *)(vertices.data()));
-    osg::ref_ptr<osg::DrawElementsUInt> ref_indices =
-        new osg::DrawElementsUInt(GL_TRIANGLES, indices_size, indices.data());
+    osg::ref_ptr<osg::Vec3Array> ref_vertices = new osg::Vec3Array(
+        numverts, (const osg::Vec3 *)(attributes[0].data));
     osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
     geom->setVertexArray(ref_vertices.get());
-    geom->addPrimitiveSet(ref_indices.get());
+    AssignTriangles(*geom, ids.data(), ids.size(), numverts);
     geom->setColorArray(cs.get());
     geom->setColorBinding(numcolors == 1 ? osg::Geometry::BIND_OVERALL
                                          : osg::Geometry::BIND_PER_VERTEX);
-    osgUtil::SmoothingVisitor::smooth(*geom);
+    if (!options.normals.empty()) {
+        osg::ref_ptr<osg::Vec3Array> ns = new osg::Vec3Array(
+            numverts, (const osg::Vec3 *)(attributes.back().data));
+        geom->setNormalArray(ns.get(), osg::Array::BIND_PER_VERTEX);
+    }
+    else {
+        ComputeNormals(*geom, options.normal_weighting);
+    }
 
-    osg::ref_ptr<osg::MatrixTransform> mt{new osg::MatrixTransform};
     osg::ref_ptr<osg::Geode> geode_mesh{new osg::Geode()};
     geode_mesh->addDrawable(geom.get());
+    return geode_mesh;
+}
+
+Handle View::Mesh(const std::vector<float> &vertices,
+                  const std::vector<unsigned int> &indices,
+                  const std::vector<float> &colors, const MeshOptions &options)
+{
+    Handle h;
+    osg::ref_ptr<osg::Geode> geode_mesh =
+        CreateMeshGeode(vertices, indices, colors, options);
+    if (!geode_mesh) return h;
+
+    osg::ref_ptr<osg::MatrixTransform> mt{new osg::MatrixTransform};
     mt->addChild(geode_mesh);
 
-    h.type = ViewObjectType_Mesh;
-    h.uid = NextHandleID();
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Mesh, mt);
+    return h;
+}
+
+Handle View::LoadAsync(const std::string &fname,
+                       const std::array<float, 3> &pos,
+                       const std::array<float, 4> &quat)
+{
+    osg::Matrix transform;
+    transform.setRotate(osg::Quat(quat[0], quat[1], quat[2], quat[3]));
+    transform.setTrans(osg::Vec3f(pos[0], pos[1], pos[2]));
+    const Handle h =
+        Vis3d__ReserveNode(m_vis3d, ViewObjectType_Model, transform);
+    Vis3d *vis3d = m_vis3d.get();
+    m_vis3d->workers.Submit([vis3d, h, fname]() {
+        osg::ref_ptr<osg::Node> model = Vis3d__ReadModel(*vis3d, fname);
+        Vis3d__PostCommand(*vis3d, [h, model](View &view) {
+            Vis3d__Materialize(view.m_vis3d, view, h, model.get());
+        });
+    });
+    return h;
+}
 
-    geode_mesh->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
+Handle View::PointAsync(std::vector<float> xyzs, float ptsize,
+                        std::vector<float> colors)
+{
+    const Handle h =
+        Vis3d__ReserveNode(m_vis3d, ViewObjectType_Point, osg::Matrix());
+    Vis3d *vis3d = m_vis3d.get();
+    // moved into the task, the caller's arrays are not copied
+    m_vis3d->workers.Submit([vis3d, h, xyzs = std::move(xyzs), ptsize,
+                             colors = std::move(colors)]() {
+        osg::ref_ptr<osg::Geode> geode =
+            CreatePointGeode(xyzs, ptsize, colors);
+        Vis3d__PostCommand(*vis3d, [h, geode](View &view) {
+            Vis3d__Materialize(view.m_vis3d, view, h, geode.get());
+        });
+    });
+    return h;
+}
 
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
+Handle View::MeshAsync(std::vector<float> vertices,
+                       std::vector<unsigned int> indices,
+                       std::vector<float> colors, MeshOptions options)
+{
+    const Handle h =
+        Vis3d__ReserveNode(m_vis3d, ViewObjectType_Mesh, osg::Matrix());
+    Vis3d *vis3d = m_vis3d.get();
+    m_vis3d->workers.Submit([vis3d, h, vertices = std::move(vertices),
+                             indices = std::move(indices),
+                             colors = std::move(colors),
+                             options = std::move(options)]() {
+        osg::ref_ptr<osg::Geode> geode =
+            CreateMeshGeode(vertices, indices, colors, options);
+        Vis3d__PostCommand(*vis3d, [h, geode](View &view) {
+            Vis3d__Materialize(view.m_vis3d, view, h, geode.get());
+        });
+    });
     return h;
 }
 
@@ -1956,10 +3464,6 @@ Handle View::Plane(float xlength, float ylength, int half_x_num_cells,
 {
     Handle h;
 
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
-    std::array<float, 9> rotation;
-
     if (color.size() != 3 && color.size() != 4) {
         LOG_WARN("color.size() should be 3 or 4!");
         return h;
@@ -1970,14 +3474,17 @@ Handle View::Plane(float xlength, float ylength, int half_x_num_cells,
         return h;
     }
 
-    Quaternion2Matrix(quat, rotation);
-
-    if (!GenerateGridMesh(xlength, ylength, half_x_num_cells, half_y_num_cells,
-                          vertices, indices)) {
+    if (xlength <= 0 || ylength <= 0 || half_x_num_cells < 1
+        || half_y_num_cells < 1) {
+        LOG_ERROR("Invalid parameters! All parameters should be positive. {}, "
+                  "{}, {}, {}",
+                  xlength, ylength, half_x_num_cells, half_y_num_cells);
         return h;
     }
 
-    TransformVertices(trans, rotation, vertices);
+    osg::Matrix pose;
+    pose.setRotate(osg::Quat(quat[0], quat[1], quat[2], quat[3]));
+    pose.setTrans(osg::Vec3(trans[0], trans[1], trans[2]));
 
     const int color_channels = color.size() % 3 == 0 ? 3 : 4;
     osg::ref_ptr<osg::Array> cs;
@@ -1991,13 +3498,8 @@ Handle View::Plane(float xlength, float ylength, int half_x_num_cells,
             transparent = true;
         }
     }
-    osg::ref_ptr<osg::Vec3Array> ref_vertices = new osg::Vec3Array(
-        vertices.size() / 3, (const osg::Vec3 *)(vertices.data()));
-    osg::ref_ptr<osg::DrawElementsUInt> ref_indices =
-        new osg::DrawElementsUInt(GL_TRIANGLES, indices.size(), indices.data());
-    osg::ref_ptr<osg::Geometry> geom = new osg::Geometry;
-    geom->setVertexArray(ref_vertices.get());
-    geom->addPrimitiveSet(ref_indices.get());
+    osg::ref_ptr<osg::Geometry> geom = CreateGridPlane(
+        xlength, ylength, half_x_num_cells, half_y_num_cells);
     geom->setColorArray(cs.get());
     geom->setColorBinding(osg::Geometry::BIND_OVERALL);
     if (transparent) {
@@ -2005,22 +3507,318 @@ Handle View::Plane(float xlength, float ylength, int half_x_num_cells,
         geom->getOrCreateStateSet()->setRenderingHint(
             osg::StateSet::TRANSPARENT_BIN);
     }
-    osgUtil::SmoothingVisitor::smooth(*geom);
 
+    // the quad is built at the origin, the pose is the matrix of its node
     osg::ref_ptr<osg::MatrixTransform> mt{new osg::MatrixTransform};
+    mt->setMatrix(pose);
     osg::ref_ptr<osg::Geode> geode_mesh{new osg::Geode()};
     geode_mesh->addDrawable(geom.get());
     mt->addChild(geode_mesh);
 
-    h.type = ViewObjectType_Plane;
-    h.uid = NextHandleID();
+    h = Vis3d__AddNode(m_vis3d, ViewObjectType_Plane, mt);
+    return h;
+}
 
-    geode_mesh->setName(std::to_string(NextObjectID()));
-    mt->setName(std::string{"mt"} + std::to_string(NextObjectID()));
+static osg::Geometry *Vis3d__GetGeometry(const std::shared_ptr<Vis3d> vis3d,
+                                         const Handle &nh)
+{
+    osg::MatrixTransform *mt = Vis3d__GetNode(vis3d, nh);
+    if (mt == nullptr) {
+        LOG_ERROR("Can not find node: type: {0}, uid: {1}.", nh.type, nh.uid);
+        return nullptr;
+    }
+    osg::Node *child = mt->getNumChildren() > 0 ? mt->getChild(0) : nullptr;
+    osg::Geode *geode = child ? child->asGeode() : nullptr;
+    osg::Drawable *drawable =
+        (geode && geode->getNumDrawables() > 0) ? geode->getDrawable(0)
+                                                : nullptr;
+    osg::Geometry *geom = drawable ? drawable->asGeometry() : nullptr;
+    if (geom == nullptr) {
+        LOG_ERROR("No geometry for the node! ({0}, {1})", nh.type, nh.uid);
+    }
+    return geom;
+}
 
-    m_vis3d->node_switch->addChild(mt);
-    m_vis3d->node_map.insert({h, mt});
-    return h;
+/**
+ * Copy num elements into the array currently bound at current, reusing it if
+ * it has the right type. The storage grows geometrically so that a stream of
+ * slowly growing updates does not reallocate (and re-create the GPU buffer)
+ * every frame. Arrays adopted from caller memory are replaced by owned ones.
+ */
+template <typename ArrayT>
+static osg::ref_ptr<ArrayT> AssignArray(osg::Array *current,
+                                        const void *data, size_t num)
+{
+    osg::ref_ptr<ArrayT> arr = dynamic_cast<ArrayT *>(current);
+    if (!arr) {
+        arr = new ArrayT;
+    }
+    if (num > arr->capacity()) {
+        arr->reserve(std::max(num, (size_t)arr->capacity() * 2));
+    }
+    arr->resize(num);
+    if (num > 0) {
+        std::memcpy(&(*arr)[0], data,
+                    num * sizeof(typename ArrayT::ElementDataType));
+    }
+    arr->dirty();
+    return arr;
+}
+
+/// Update the color array of geom for num vertices, colors may be empty to
+/// keep the current colors.
+static bool UpdateGeometryColors(osg::Geometry *geom,
+                                 const std::vector<float> &colors, size_t num)
+{
+    if (colors.empty()) {
+        const osg::Array *cs = geom->getColorArray();
+        if (cs && cs->getBinding() == osg::Array::BIND_PER_VERTEX
+            && cs->getNumElements() != num) {
+            LOG_WARN("colors are per vertex, new colors are needed for [{}] "
+                     "vertices.",
+                     num);
+            return false;
+        }
+        return true;
+    }
+
+    const size_t color_channels = ResolveColorChannels(colors.size(), num);
+    if (color_channels == 0) {
+        LOG_WARN("colors.size [{}] not match vertices size [{}].",
+                 colors.size(), num);
+        return false;
+    }
+    const size_t numcl = colors.size() / color_channels;
+
+    osg::ref_ptr<osg::Array> cs;
+    if (color_channels == 3) {
+        cs = AssignArray<osg::Vec3Array>(geom->getColorArray(), colors.data(),
+                                         numcl);
+    }
+    else {
+        cs = AssignArray<osg::Vec4Array>(geom->getColorArray(), colors.data(),
+                                         numcl);
+    }
+    if (cs.get() != geom->getColorArray()) {
+        geom->setColorArray(cs.get());
+    }
+    geom->setColorBinding(numcl == 1 ? osg::Geometry::BIND_OVERALL
+                                     : osg::Geometry::BIND_PER_VERTEX);
+    return true;
+}
+
+/// The DrawArrays drawing a point cloud or a line, nullptr if the geometry
+/// has none.
+static osg::DrawArrays *GetGeometryDrawArrays(osg::Geometry *geom)
+{
+    osg::DrawArrays *da =
+        geom->getNumPrimitiveSets() > 0
+            ? dynamic_cast<osg::DrawArrays *>(geom->getPrimitiveSet(0))
+            : nullptr;
+    if (da == nullptr) {
+        LOG_ERROR("Geometry is not drawn with DrawArrays!");
+    }
+    return da;
+}
+
+/// Replace the vertices of a geometry drawn with a single DrawArrays, da.
+static void UpdateGeometryVertices(osg::Geometry *geom, osg::DrawArrays *da,
+                                   const std::vector<float> &xyzs)
+{
+    const size_t numpt = xyzs.size() / 3;
+    osg::ref_ptr<osg::Vec3Array> vs = AssignArray<osg::Vec3Array>(
+        geom->getVertexArray(), xyzs.data(), numpt);
+    if (vs.get() != geom->getVertexArray()) {
+        geom->setVertexArray(vs.get());
+    }
+    da->setFirst(0);
+    da->setCount(numpt);
+    da->dirty();
+    geom->dirtyDisplayList();
+    geom->dirtyBound();
+}
+
+bool View::UpdatePoints(const Handle &h, const std::vector<float> &xyzs,
+                        const std::vector<float> &colors)
+{
+    if (h.type != ViewObjectType_Point) {
+        LOG_ERROR("Object is not a point cloud: type: {0}, uid: {1}.", h.type,
+                  h.uid);
+        return false;
+    }
+    if (Vis3d__DeferWhileLoading(m_vis3d, h, [h, xyzs, colors](View &v) {
+            v.UpdatePoints(h, xyzs, colors);
+        })) {
+        return true;
+    }
+    Vis3d__UnshareContent(m_vis3d, h);
+    osg::Geometry *geom = Vis3d__GetGeometry(m_vis3d, h);
+    if (geom == nullptr) return false;
+    osg::DrawArrays *da = GetGeometryDrawArrays(geom);
+    if (da == nullptr) return false;
+
+    const size_t xyzs_size = xyzs.size();
+    if (xyzs_size == 0 || xyzs_size % 3 != 0) {
+        LOG_WARN("xyzs.size() is wrong! {0}", xyzs_size);
+        return false;
+    }
+
+    if (!UpdateGeometryColors(geom, colors, xyzs_size / 3)) return false;
+    UpdateGeometryVertices(geom, da, xyzs);
+    ApplyRenderPolicy(m_vis3d->render_policy, *geom, true);
+    Vis3d__MarkDirty(m_vis3d);
+    return true;
+}
+
+bool View::UpdateLine(const Handle &h, const std::vector<float> &lines,
+                      const std::vector<float> &colors)
+{
+    if (h.type != ViewObjectType_Line) {
+        LOG_ERROR("Object is not a line: type: {0}, uid: {1}.", h.type, h.uid);
+        return false;
+    }
+    Vis3d__UnshareContent(m_vis3d, h);
+    osg::Geometry *geom = Vis3d__GetGeometry(m_vis3d, h);
+    if (geom == nullptr) return false;
+    osg::DrawArrays *da = GetGeometryDrawArrays(geom);
+    if (da == nullptr) return false;
+
+    const size_t lines_size = lines.size();
+    const GLenum primitive_set_mode = da->getMode();
+    size_t numlines = 0;
+    switch (primitive_set_mode) {
+    case osg::PrimitiveSet::LINES:
+        if (lines_size == 0 || lines_size % 6 != 0) {
+            LOG_WARN("lines.size() is wrong! {0}", lines_size);
+            return false;
+        }
+        numlines = lines_size / 6;
+        break;
+    case osg::PrimitiveSet::LINE_STRIP:
+        if (lines_size % 3 != 0 || lines_size / 3 < 2) {
+            LOG_WARN("lines.size() is wrong! {0}", lines_size);
+            return false;
+        }
+        numlines = lines_size / 3 - 1;
+        break;
+    case osg::PrimitiveSet::LINE_LOOP:
+        if (lines_size % 3 != 0 || lines_size / 3 < 3) {
+            LOG_WARN("lines.size() is wrong! {0}", lines_size);
+            return false;
+        }
+        numlines = lines_size / 3;
+        break;
+    default:
+        LOG_ERROR("line mode is wrong! {0}", primitive_set_mode);
+        return false;
+    }
+
+    // Same as Line(...): only LINES can be colored per line, which needs one
+    // color for each of the two vertices.
+    std::vector<float> vert_colors;
+    if (!colors.empty()) {
+        const size_t color_channels =
+            ResolveColorChannels(colors.size(), numlines);
+        if (color_channels == 0) {
+            LOG_WARN("colors.size [{}] not match line size [{}].",
+                     colors.size(), numlines);
+            return false;
+        }
+        const size_t numcolors = colors.size() / color_channels;
+        if (numcolors == 1 || primitive_set_mode != osg::PrimitiveSet::LINES) {
+            vert_colors.assign(colors.begin(),
+                               colors.begin() + color_channels);
+        }
+        else {
+            vert_colors.resize(colors.size() * 2);
+            for (size_t i = 0; i < numcolors; ++i) {
+                for (size_t j = 0; j < color_channels; ++j) {
+                    vert_colors[i * 2 * color_channels + j] =
+                        colors[i * color_channels + j];
+                    vert_colors[(i * 2 + 1) * color_channels + j] =
+                        colors[i * color_channels + j];
+                }
+            }
+        }
+    }
+
+    if (!UpdateGeometryColors(geom, vert_colors, lines_size / 3)) return false;
+    UpdateGeometryVertices(geom, da, lines);
+    ApplyRenderPolicy(m_vis3d->render_policy, *geom, true);
+    Vis3d__MarkDirty(m_vis3d);
+    return true;
+}
+
+bool View::UpdateMesh(const Handle &h, const std::vector<float> &vertices,
+                      const std::vector<unsigned int> &indices,
+                      const std::vector<float> &colors,
+                      const std::vector<float> &normals)
+{
+    if (h.type != ViewObjectType_Mesh) {
+        LOG_ERROR("Object is not a mesh: type: {0}, uid: {1}.", h.type, h.uid);
+        return false;
+    }
+    if (Vis3d__DeferWhileLoading(
+            m_vis3d, h, [h, vertices, indices, colors, normals](View &v) {
+                v.UpdateMesh(h, vertices, indices, colors, normals);
+            })) {
+        return true;
+    }
+    Vis3d__UnshareContent(m_vis3d, h);
+    osg::Geometry *geom = Vis3d__GetGeometry(m_vis3d, h);
+    if (geom == nullptr) return false;
+
+    const size_t vertices_size = vertices.size();
+    const size_t indices_size = indices.size();
+    const size_t numverts = vertices_size / 3;
+    if (vertices_size == 0 || vertices_size % 3 != 0) {
+        LOG_WARN("vertices.size() is wrong! {0}", vertices_size);
+        return false;
+    }
+    if (indices_size == 0 || indices_size % 3 != 0) {
+        LOG_WARN("indices.size() is wrong! {0}", indices_size);
+        return false;
+    }
+    if (!normals.empty() && normals.size() != vertices_size) {
+        LOG_WARN("normals.size() [{0}] should be vertices.size() [{1}].",
+                 normals.size(), vertices_size);
+        return false;
+    }
+    for (const auto i : indices) {
+        if (i >= numverts) {
+            LOG_WARN("index {0} out of range [0, {1}).", i, numverts);
+            return false;
+        }
+    }
+
+    if (!UpdateGeometryColors(geom, colors, numverts)) return false;
+
+    osg::ref_ptr<osg::Vec3Array> vs = AssignArray<osg::Vec3Array>(
+        geom->getVertexArray(), vertices.data(), numverts);
+    if (vs.get() != geom->getVertexArray()) {
+        geom->setVertexArray(vs.get());
+    }
+
+    AssignTriangles(*geom, indices.data(), indices_size, numverts);
+    // the k-d tree used for picking is rebuilt by the next pick
+    geom->setShape(nullptr);
+
+    if (!normals.empty()) {
+        osg::ref_ptr<osg::Vec3Array> ns = AssignArray<osg::Vec3Array>(
+            geom->getNormalArray(), normals.data(), numverts);
+        ns->setBinding(osg::Array::BIND_PER_VERTEX);
+        if (ns.get() != geom->getNormalArray()) {
+            geom->setNormalArray(ns.get(), osg::Array::BIND_PER_VERTEX);
+        }
+    }
+    else {
+        ComputeNormals(*geom);
+    }
+    geom->dirtyDisplayList();
+    geom->dirtyBound();
+    ApplyRenderPolicy(m_vis3d->render_policy, *geom, true);
+    Vis3d__MarkDirty(m_vis3d);
+    return true;
 }
 
 void View::SetIntersectMode(IntersectorMode mode, bool hover)
@@ -2031,7 +3829,8 @@ void View::SetIntersectMode(IntersectorMode mode, bool hover)
 
 bool View::EnableGizmo(const Handle &h, int gizmotype)
 {
-    if (!Vis3d__HasNode(m_vis3d, h)) {
+    osg::MatrixTransform *mt = Vis3d__GetNode(m_vis3d, h);
+    if (mt == nullptr) {
         LOG_ERROR("Can not find node: type: {0}, uid: {1}.", h.type, h.uid);
         return false;
     }
@@ -2043,7 +3842,6 @@ bool View::EnableGizmo(const Handle &h, int gizmotype)
     // Disable last Gizmo
     DisableGizmo();
 
-    auto mt = m_vis3d->node_map[h];
     const osg::Matrix &matrix = mt->getMatrix();
     for (int i = 0; i < 16; ++i) {
         m_vis3d->gizmo.matrix[i] = *(matrix.ptr() + i);
@@ -2060,14 +3858,14 @@ bool View::EnableGizmo(const Handle &h, int gizmotype)
     if (gizmotype == 4) {
         osg::ref_ptr<GizmoDrawable> gizmo = new GizmoDrawable;
         gizmo->setCaptureFlag(&m_vis3d->gizmo.capture);
-        gizmo->setTransform(mt.get(), m_vis3d->gizmo.matrix);
+        gizmo->setTransform(mt, m_vis3d->gizmo.matrix);
         gizmo->setGizmoMode(GizmoDrawable::MOVE_GIZMO);
         gizmo->setScreenSize(vp->width(), vp->height());
         geode->addDrawable(gizmo.get());
 
         gizmo = new GizmoDrawable;
         gizmo->setCaptureFlag(&m_vis3d->gizmo.capture);
-        gizmo->setTransform(mt.get(), m_vis3d->gizmo.matrix);
+        gizmo->setTransform(mt, m_vis3d->gizmo.matrix);
         gizmo->setGizmoMode(GizmoDrawable::ROTATE_GIZMO);
         gizmo->setScreenSize(vp->width(), vp->height());
         geode->addDrawable(gizmo.get());
@@ -2075,19 +3873,15 @@ bool View::EnableGizmo(const Handle &h, int gizmotype)
     else {
         osg::ref_ptr<GizmoDrawable> gizmo = new GizmoDrawable;
         gizmo->setCaptureFlag(&m_vis3d->gizmo.capture);
-        gizmo->setTransform(mt.get(), m_vis3d->gizmo.matrix);
+        gizmo->setTransform(mt, m_vis3d->gizmo.matrix);
         gizmo->setGizmoMode((GizmoDrawable::Mode)gizmotype);
         gizmo->setScreenSize(vp->width(), vp->height());
         geode->addDrawable(gizmo.get());
     }
 
     m_vis3d->gizmo.refHandle = h;
-    m_vis3d->gizmo.handle.uid = NextHandleID();
-    m_vis3d->gizmo.handle.type = ViewObjectType_Gzimo;
     m_vis3d->gizmo.capture = false;
-
-    m_vis3d->node_switch->addChild(root);
-    m_vis3d->node_map[m_vis3d->gizmo.handle] = root;
+    m_vis3d->gizmo.handle = Vis3d__AddNode(m_vis3d, ViewObjectType_Gzimo, root);
 
     return true;
 }
@@ -2104,7 +3898,7 @@ bool View::SetGizmoType(int gizmotype, int loctype)
         return false;
     }
     osg::Geode *geode =
-        m_vis3d->node_map[m_vis3d->gizmo.handle]->getChild(0)->asGeode();
+        Vis3d__GetNode(m_vis3d, m_vis3d->gizmo.handle)->getChild(0)->asGeode();
     if (geode->getNumDrawables() > 1) {
         LOG_WARN("No need change type in all mode.");
         return false;
@@ -2113,6 +3907,7 @@ bool View::SetGizmoType(int gizmotype, int loctype)
     GizmoDrawable::Mode m = (GizmoDrawable::Mode)gizmotype;
 
     gizmo->setGizmoMode(m);
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -2127,7 +3922,7 @@ bool View::SetGizmoDrawMask(int gizmotype, int mask)
         return false;
     }
     osg::Geode *geode =
-        m_vis3d->node_map[m_vis3d->gizmo.handle]->getChild(0)->asGeode();
+        Vis3d__GetNode(m_vis3d, m_vis3d->gizmo.handle)->getChild(0)->asGeode();
     for (unsigned int i = 0; i < geode->getNumDrawables(); i++) {
         GizmoDrawable *gizmo =
             dynamic_cast<GizmoDrawable *>(geode->getDrawable(i));
@@ -2136,6 +3931,7 @@ bool View::SetGizmoDrawMask(int gizmotype, int mask)
             break;
         }
     }
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -2150,12 +3946,13 @@ bool View::SetGizmoDisplayScale(float scale)
         return false;
     }
     osg::Geode *geode =
-        m_vis3d->node_map[m_vis3d->gizmo.handle]->getChild(0)->asGeode();
+        Vis3d__GetNode(m_vis3d, m_vis3d->gizmo.handle)->getChild(0)->asGeode();
     for (unsigned int i = 0; i < geode->getNumDrawables(); i++) {
         GizmoDrawable *gizmo =
             dynamic_cast<GizmoDrawable *>(geode->getDrawable(i));
         gizmo->setDisplayScale(scale);
     }
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -2170,12 +3967,13 @@ bool View::SetGizmoDetectionRange(float range)
         return false;
     }
     osg::Geode *geode =
-        m_vis3d->node_map[m_vis3d->gizmo.handle]->getChild(0)->asGeode();
+        Vis3d__GetNode(m_vis3d, m_vis3d->gizmo.handle)->getChild(0)->asGeode();
     for (unsigned int i = 0; i < geode->getNumDrawables(); i++) {
         GizmoDrawable *gizmo =
             dynamic_cast<GizmoDrawable *>(geode->getDrawable(i));
         gizmo->setDetectionRange(range);
     }
+    Vis3d__MarkDirty(m_vis3d);
     return true;
 }
 
@@ -2227,4 +4025,77 @@ bool View::EnableTrackballManipulation(bool enable)
     return m_vis3d->gizmo.view_manipulation = !enable;
 }
 
+void View::SetRenderOnDemand(bool on_demand)
+{
+    m_vis3d->render_on_demand = on_demand;
+    Vis3d__MarkDirty(m_vis3d);
+}
+
+uint64_t View::GetFrameCount() const { return m_vis3d->frame_count; }
+
+double View::GetCullTime()
+{
+    osg::Camera *camera = m_vis3d->osgviewer->getCamera();
+    if (camera->getStats() == nullptr) {
+        camera->setStats(new osg::Stats("Camera"));
+    }
+    osg::Stats *stats = camera->getStats();
+    if (!stats->collectStats("rendering")) {
+        stats->collectStats("rendering", true);
+        return -1.0;
+    }
+    double seconds = 0.0;
+    if (!stats->getAveragedAttribute("Cull traversal time taken", seconds)) {
+        return -1.0;
+    }
+    return 1000.0 * seconds;
+}
+
+void View::PostCommand(std::function<void(View &)> command)
+{
+    Vis3d__PostCommand(*m_vis3d, std::move(command));
+}
+
+size_t View::ProcessCommands()
+{
+    size_t num = 0;
+    std::function<void(View &)> command;
+    while (m_vis3d->commands.Pop(command)) {
+        command(*this);
+        ++num;
+    }
+    return num;
+}
+
+bool View::Frame()
+{
+    m_vis3d->commands_pending = false;
+    // the frame below draws what the commands change, they need not request
+    // another one
+    m_vis3d->dirty = true;
+    ProcessCommands();
+    m_vis3d->dirty = false;
+    m_vis3d->osgviewer->frame();
+    ++m_vis3d->frame_count;
+    // the manipulators request a redraw on motion and continuous updates
+    // while animating, pending events and update callbacks need frames too
+    return !m_vis3d->render_on_demand || m_vis3d->dirty
+           || m_vis3d->commands_pending
+           || m_vis3d->osgviewer->checkNeedToDoFrame();
+}
+
+void View::SetRedrawRequest(std::function<void()> request)
+{
+    std::lock_guard<std::mutex> lock(m_vis3d->redraw_mutex);
+    m_vis3d->request_redraw = std::move(request);
+}
+
+bool View::NeedsHoverEvents() const
+{
+    return !m_vis3d->render_on_demand
+           || (m_vis3d->insector_hover
+               && m_vis3d->insector_mode != IntersectorMode_Disable)
+           || m_vis3d->gizmo.handle.uid != 0;
+}
+
 osgViewer::Viewer *View::GetOsgViewer() { return m_vis3d->osgviewer; }
\ No newline at end of file
@@ -5,15 +5,30 @@
 #include <osgViewer/Viewer>
 #include <osgFX/Outline>
 
+#include "Articulation.h"
+#include "ModelCache.h"
+#include "MpscQueue.h"
+#include "Normals.h"
+#include "SceneOctree.h"
+#include "SlotMap.h"
+#include "ThreadPool.h"
+#include "Trajectory.h"
+
 #include <stdint.h>
 #include <array>
+#include <atomic>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 namespace Vis
 {
 
 class QViewerWidget;
+struct View;
 
 
 enum ViewObjectType
@@ -33,6 +48,18 @@ enum ViewObjectType
     ViewObjectType_Cone,
     ViewObjectType_Cylinder,
     ViewObjectType_Gzimo,
+    ViewObjectType_Boxes,
+    ViewObjectType_Cylinders,
+    ViewObjectType_Cones,
+    ViewObjectType_PointCloudLOD,
+    ViewObjectType_Trajectory,
+    ViewObjectType_Ghosts,
+};
+
+enum CloneMode
+{
+    CloneMode_Deep = 0, // copy the whole object
+    CloneMode_Shared,   // share the geometry, copy it on the first change
 };
 
 // clang-format off
@@ -45,6 +72,13 @@ enum IntersectorMode {
 };
 // clang-format on
 
+// clang-format off
+enum RenderPolicy {
+    RenderPolicy_DisplayList = 0,     // OSG defaults, geometries are compiled into display lists
+    RenderPolicy_VertexBufferObject,  // geometries are drawn from vertex buffer objects, no display lists
+};
+// clang-format on
+
 struct Handle
 {
     Handle() : type(0), uid(0) {}
@@ -55,7 +89,7 @@ struct Handle
         uid = 0;
     }
     uint64_t type;
-    uint64_t uid;
+    uint64_t uid; // slot index and generation in the View, see SlotMap
 };
 
 inline bool operator==(const Handle a, const Handle b)
@@ -72,6 +106,45 @@ struct HandleHasher
     }
 };
 
+/**
+ * A point cloud living in caller-owned memory, adopted by View::Point without
+ * copying.
+ *
+ * xyzs holds count tightly packed (x, y, z) floats. colors is optional; when
+ * given it holds count tightly packed colors of color_channels (3 or 4)
+ * floats each. The viewer renders straight from this memory, so it must stay
+ * valid and unchanged until release is called. release is called exactly
+ * once, from the thread that drops the last reference to the geometry
+ * (Delete, Clear or destroying the View), and may be empty.
+ */
+struct PointBuffer
+{
+    const float *xyzs{nullptr};
+    const float *colors{nullptr};
+    size_t count{0};
+    int color_channels{3};
+    std::function<void()> release;
+};
+
+/**
+ * How View::Mesh prepares a mesh.
+ *
+ * weld merges the vertices with equal position, color and normal, which
+ * shrinks meshes given as triangle soups. optimize reorders the triangles
+ * for the vertex cache of the GPU, the vertices keep their order. normals,
+ * if given, hold numverts * 3 floats used instead of averaging the normals
+ * of the triangles around each vertex, by their area or by their angle at
+ * the vertex as set by normal_weighting. The average only joins triangles
+ * sharing vertex indices, weld triangle soups to shade them smooth.
+ */
+struct MeshOptions
+{
+    bool weld{false};
+    bool optimize{true};
+    std::vector<float> normals;
+    NormalWeighting normal_weighting{NormalWeighting_Area};
+};
+
 struct VisGizmo
 {
     int capture{0};
@@ -81,6 +154,29 @@ struct VisGizmo
     float matrix[16];
 };
 
+/**
+ * A trajectory played by View::PlayTrajectory(...). time is in the
+ * trajectory and advances by rate times the frame time on the render thread.
+ */
+struct VisTrajectory
+{
+    std::vector<Handle> handles;
+    Trajectory trajectory;
+    double time{0.0};
+    double rate{1.0};
+    bool playing{true};
+    bool loop{false};
+    bool changed{true};          // poses to write on the next frame
+    double last_frame_time{-1.0}; // reference time of the last update
+};
+
+struct VisBatch
+{
+    bool active{false};
+    // Objects created in the batch, put in the scene octree by EndBatch()
+    std::vector<osg::ref_ptr<osg::MatrixTransform>> pending;
+};
+
 struct Vis3d
 {
     bool is_inited{false};
@@ -89,24 +185,71 @@ struct Vis3d
     bool done;
     Handle picked;
     std::array<float, 6> pointnorm{0};
-    std::unordered_map<Handle, osg::ref_ptr<osg::MatrixTransform>, HandleHasher>
-        node_map;
+    SlotMap<osg::ref_ptr<osg::MatrixTransform>, Handle> node_map;
+    // by the handle of their first link, see View::Articulate(...)
+    std::unordered_map<Handle, Articulation, HandleHasher> articulations;
     std::unordered_map<Handle, osg::ref_ptr<osgFX::Outline>, HandleHasher>
         outlinemap;
 
     osg::ref_ptr<osg::Group> scene_root;
     osg::ref_ptr<osg::Switch> node_switch;
+    // groups the objects under node_switch by place, see SceneOctree
+    SceneOctree octree;
     osg::ref_ptr<osgViewer::Viewer> osgviewer;
 
-    IntersectorMode insector_mode;
+    IntersectorMode insector_mode{IntersectorMode_Disable};
     bool insector_hover{false};
+
+    RenderPolicy render_policy{RenderPolicy_VertexBufferObject};
+    CloneMode clone_mode{CloneMode_Deep};
+
+    VisBatch batch;
+    SlotMap<VisTrajectory, Handle> trajectories;
+    // attached to scene_root only while a trajectory moves, see
+    // View::PlayTrajectory(...)
+    osg::ref_ptr<osg::NodeCallback> trajectory_callback;
+    bool debug_names{false};
+
+    size_t point_budget{2000000}; // per PointCloudLOD object
+
+    bool render_on_demand{true};
+    std::atomic<bool> dirty{true}; // the scene changed since the last frame
+    // bumped by changes other than moves, see PickHandler
+    std::atomic<uint64_t> scene_revision{0};
+    // bumped by moves of objects or of the camera, see PickHandler
+    std::atomic<uint64_t> move_revision{0};
+    std::atomic<uint64_t> frame_count{0};
+    std::function<void()> request_redraw; // schedules a frame, may be empty
+    // request_redraw is called by the threads posting commands too, it is
+    // only read, written and called with this locked
+    std::mutex redraw_mutex;
+
+    // posted by any thread, run on the render thread before each frame
+    MpscQueue<std::function<void(View &)>> commands;
+    std::atomic<bool> commands_pending{false};
+
+    // Objects created by the *Async creators whose content is not built yet,
+    // with the calls to replay on them once it is.
+    std::unordered_map<Handle, std::vector<std::function<void(View &)>>,
+                       HandleHasher>
+        loading;
+    ModelCache model_cache;
+    // Last member, so its tasks are done before the ones they use go away.
+    ThreadPool workers;
 };
 
 struct View
 {
     friend class QViewerWidget;
 
-    View();
+    /**
+     * @param policy how geometries are sent to the GPU, applied to every
+     * object created by this view. With RenderPolicy_VertexBufferObject,
+     * geometries updated through Update*(...) are also flagged as dynamic.
+     * Shapes drawn by OSG in immediate mode (ShapeDrawable before OSG 3.6)
+     * keep using display lists.
+     */
+    explicit View(RenderPolicy policy = RenderPolicy_VertexBufferObject);
 
     /**
      * Close the window.
@@ -162,18 +305,47 @@ struct View
     bool IsAlive(const Handle &nh) const;
 
     /**
-     * Delete nodes from the scene
-     * Return true if all deleted else false and top at the break point.
-     * NOTE: This function simply calls Delet(handle), so it will be slow since
-     * it's not operating in batch mode.
+     * Delete nodes from the scene in batch mode: all of them are taken out of
+     * the scene graph with a single pass over its children.
+     * Return true if all deleted else false. Invalid handles are skipped, the
+     * others are deleted anyway, deleted[i] tells whether handles[i] was.
      */
     bool Delete(const std::vector<Handle> &handles); // delete list of handles
+    bool Delete(const std::vector<Handle> &handles, std::vector<bool> &deleted);
 
     /**
      * Clear all nodes in the scene.
      */
     bool Clear(); // Delete all nodes
 
+    /**
+     * Start/finish creating many objects at once.
+     *
+     * Between BeginBatch() and EndBatch() the creators (Box, Point, Load...)
+     * skip naming the scene graph nodes unless EnableDebugNames(true) was
+     * called, and their objects only join the scene at EndBatch(), in a
+     * single commit. Handles are valid right away and can be passed to
+     * Delete, Chain, SetTransform, SetColor, Show/Hide...
+     *
+     * @code
+     * v.BeginBatch(10000);
+     * for (...) v.Box(...);
+     * v.EndBatch();
+     * @endcode
+     * @param expected number of objects about to be created, used to reserve
+     * memory up front
+     * @return false if a batch is already started (BeginBatch) or there is
+     * no batch to finish (EndBatch)
+     */
+    bool BeginBatch(size_t expected = 0);
+    bool EndBatch();
+
+    /**
+     * Name the scene graph nodes of objects created in a batch as well, which
+     * makes them easier to identify when debugging the scene graph.
+     */
+    void EnableDebugNames(bool enable);
+
     /**
      * Go to home position
      */
@@ -185,7 +357,9 @@ struct View
     bool Show(const Handle &nh);
 
     /**
-     * Switch off the node to make it invisible.
+     * Switch off the node to make it invisible, along with the objects chained
+     * to it. Hidden objects keep their place in the scene, they are only
+     * skipped by culling and picking.
      */
     bool Hide(const Handle &nh);
 
@@ -220,6 +394,122 @@ struct View
                        const std::vector<std::array<float, 3>> &trans,
                        const std::vector<std::array<float, 4>> &quats);
 
+    /**
+     * SetTransforms
+     *
+     * Set the transforms of n objects from flat arrays, e.g. the poses a
+     * simulation pushes every frame. The poses are converted to matrices
+     * four at a time with SIMD instructions and written straight into the
+     * objects. Missing objects are skipped with a warning.
+     *
+     * @code
+     * v.SetTransforms(hs.data(), positions.data(), quats.data(), hs.size());
+     * @endcode
+     * @param hs handles of the objects
+     * @param positions 3 * n floats, (x, y, z) for each object
+     * @param quats 4 * n floats, quaternion (x, y, z, w) for each object
+     * @param n number of objects
+     * @return false if hs, positions or quats is null
+     */
+    bool SetTransforms(const Handle *hs, const float *positions,
+                       const float *quats, size_t n);
+
+    /**
+     * Set the transforms of n objects from matrices the caller already has,
+     * 16 floats for each object in the layout of osg::Matrixf, row major with
+     * the translation in the last row.
+     */
+    bool SetTransforms(const Handle *hs, const float *matrices16, size_t n);
+
+    /**
+     * Articulate
+     *
+     * Chain links as Chain(...) does and compile them into an articulation
+     * moved by joint positions, e.g. a robot arm. joints[i] places links[i]
+     * in the frame of links[i - 1], joints[0] places the first link in the
+     * world. The articulation is known by the handle of its first link and
+     * goes away when any of its links is deleted; unchaining its links
+     * breaks it.
+     *
+     * @code
+     * Joint j;
+     * j.trans = {0.f, 0.f, 0.3f};
+     * v.Articulate({base, shoulder, elbow}, {Joint{JointType_Fixed}, j, j});
+     * @endcode
+     * @param links the links, from the base to the tip
+     * @param joints one joint for each link, moving axes must not be null
+     * @return true if succeed else false
+     */
+    bool Articulate(const std::vector<Handle> &links,
+                    const std::vector<Joint> &joints);
+
+    /**
+     * SetJointPositions
+     *
+     * Move an articulation, the matrices of its links are computed in a
+     * single pass over the compiled joints.
+     *
+     * @code
+     * const float q[2] = {0.5f, -1.f};
+     * v.SetJointPositions(base, q, 2);
+     * @endcode
+     * @param base handle of the first link of the articulation
+     * @param positions n positions, one for each joint that is not fixed,
+     * radians for revolute joints
+     * @param n number of positions
+     * @return false if base is no articulation or n does not match it
+     */
+    bool SetJointPositions(const Handle &base, const float *positions,
+                           size_t n);
+
+    /**
+     * PlayTrajectory
+     *
+     * Animate objects along keyframed poses. The keyframes are uploaded once
+     * and interpolated on the render thread before each frame, by the frame
+     * time, so playback needs no call per frame and its speed does not
+     * depend on the frame rate. Frames are drawn continuously while it plays.
+     * Objects deleted meanwhile are skipped.
+     *
+     * @code
+     * th = v.PlayTrajectory({h}, {0.f, 2.f},
+     *                       {0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 1});
+     * v.SetTrajectoryRate(th, 0.5f);
+     * @endcode
+     * @param hs the objects moved
+     * @param timestamps strictly increasing times of the keyframes, seconds
+     * @param poses for each keyframe, a pose (x, y, z, qx, qy, qz, qw) for
+     * each object
+     * @param interpolation of the positions between keyframes, rotations are
+     * always slerped
+     * @param loop restart from the first keyframe after the last one
+     * @return Handle to control the playback, empty if failed
+     */
+    Handle PlayTrajectory(const std::vector<Handle> &hs,
+                          const std::vector<float> &timestamps,
+                          const std::vector<float> &poses,
+                          Interpolation interpolation = Interpolation_Linear,
+                          bool loop = false);
+
+    /**
+     * Pause or resume a trajectory. A trajectory that reached its end, or
+     * its start when played backward, is paused.
+     */
+    bool PauseTrajectory(const Handle &th, bool pause = true);
+
+    /// Move a trajectory to time, within its timestamps, playing or not.
+    bool SeekTrajectory(const Handle &th, float time);
+
+    /// Set the playback speed, 1 by default, negative to play backward. At 0
+    /// the trajectory holds its pose and draws no frames until it changes.
+    bool SetTrajectoryRate(const Handle &th, float rate);
+
+    /// Return the time of a trajectory, -1 if th is not alive.
+    float GetTrajectoryTime(const Handle &th) const;
+
+    /// Stop and remove a trajectory, its objects stay where they are.
+    bool StopTrajectory(const Handle &th);
+
     /**
      * Set the transparency level of an object.
      * @param inv_alpha is 1 - alpha.
@@ -253,6 +543,25 @@ struct View
      */
     Handle Clone(const Handle h);
 
+    /**
+     * SetCloneMode
+     *
+     * With CloneMode_Deep, the default, a clone copies all arrays and state
+     * of its source, and objects chained to it. With CloneMode_Shared only
+     * the transform is new, the clone draws the geometry of its source, so
+     * hundreds of clones of a large part cost about as much memory as one.
+     * SetColor, SetTransparency and Update* on a clone or its source first
+     * give that object its own copy: loaded models only copy their state,
+     * other objects copy their geometry.
+     *
+     * @code
+     * v.SetCloneMode(CloneMode_Shared);
+     * std::vector<Handle> boxes = v.Clone(parts, poss, quats);
+     * @endcode
+     * @param mode used by the following Clone(...) calls
+     */
+    void SetCloneMode(CloneMode mode);
+
     Handle Clone(const Handle h, const std::array<float, 3> &pos,
                  const std::array<float, 4> &quat);
 
@@ -263,6 +572,35 @@ struct View
                               const std::vector<std::array<float, 3>> &poss,
                               const std::vector<std::array<float, 4>> &quats);
 
+    /**
+     * Ghosts
+     *
+     * Draw an object at many poses at once, e.g. the swept path of a robot
+     * link, fading from the first pose to the last. Each drawable of the
+     * object is drawn once for all poses by an instanced draw sharing its
+     * geometry, so the memory used does not grow with the number of poses
+     * beyond the poses themselves. Objects chained to nh are not drawn, and
+     * the ghosts can not be picked or recolored. Drawables with a shader of
+     * their own, such as instanced shapes and grid planes, are left out.
+     *
+     * @code
+     * h = v.Ghosts(link, poss, quats, {0.1f, 0.6f});
+     * @endcode
+     * @param nh the object to draw, its own transform is not used
+     * @param poss position of each ghost
+     * @param quats rotation (x, y, z, w) of each ghost
+     * @param alpha_ramp alpha of the first and of the last ghost, the others
+     * are interpolated
+     * @param color color of the ghosts, 3 or 4 floats, empty to keep the
+     * colors of the object
+     * @return Handle of the ghosts, empty if failed
+     */
+    Handle Ghosts(const Handle &nh,
+                  const std::vector<std::array<float, 3>> &poss,
+                  const std::vector<std::array<float, 4>> &quats,
+                  const std::array<float, 2> &alpha_ramp = {0.2f, 0.8f},
+                  const std::vector<float> &color = {});
+
     // bool ShowAxes(bool show = true);
     Handle Axes(const std::array<float, 3> &trans = {0.f, 0.f, 0.f},
                 const std::array<float, 4> &quat = {0.f, 0.f, 0.f, 1.f},
@@ -287,6 +625,14 @@ struct View
 
     /**
      * Load model
+     *
+     * The overloads taking several files read them (and build their k-d
+     * trees) in parallel on the view's worker threads and log the time spent
+     * on each file. A file that fails to load gets an empty Handle.
+     *
+     * STL files are read by the viewer itself rather than the osgDB plugin:
+     * the file is mapped and decoded on all cores, and duplicate vertices are
+     * welded into an indexed mesh, which takes a fraction of the memory.
      */
     Handle Load(const std::string &fname);
     std::vector<Handle> Load(const std::vector<std::string> &fnames);
@@ -297,9 +643,115 @@ struct View
                              const std::vector<std::array<float, 3>> &trans,
                              const std::vector<std::array<float, 4>> &quats);
 
+    /**
+     * SetModelCacheCapacity
+     *
+     * Loaded model files are cached, loading a file again shares the
+     * subgraph (arrays and k-d trees) built the first time as long as the
+     * file did not change, so memory and load time scale with the number of
+     * distinct files. The least recently loaded files are dropped from the
+     * cache while its estimated size exceeds the capacity, 512 MiB by
+     * default. The objects keep their models either way.
+     *
+     * @code
+     * v.SetModelCacheCapacity(size_t(2) << 30); // 2 GiB
+     * ModelCacheStats stats = v.GetModelCacheStats();
+     * @endcode
+     * @param bytes capacity of the cache, 0 disables it
+     */
+    void SetModelCacheCapacity(size_t bytes);
+    ModelCacheStats GetModelCacheStats() const;
+    /// Forget the cached models, e.g. to reload files changed in place
+    /// without changing their size or time.
+    void ClearModelCache();
+
+    /**
+     * SaveScene
+     *
+     * Save the objects of the view, their transforms, visibility, chains and
+     * content, to a binary scene file. Gizmos, objects still loading and
+     * outlines are not saved.
+     *
+     * @code
+     * v.SaveScene("cell.scene");
+     * // later, in another process
+     * v.LoadScene("cell.scene");
+     * @endcode
+     * @param fname path of the scene file, replaced if it exists
+     * @return true if success
+     */
+    bool SaveScene(const std::string &fname);
+
+    /**
+     * LoadScene
+     *
+     * Replace the objects of the view with the ones of a scene file written
+     * by SaveScene(...). The file is mapped, not parsed, for most of its
+     * size, so large point clouds and meshes show up about as fast as the
+     * pages can be read. The objects get back the handles they had when
+     * saved, handles obtained before LoadScene(...) must not be used
+     * anymore. Scene files are only read by the version of the viewer
+     * which wrote them, on a machine of the same byte order.
+     *
+     * @param fname path of the scene file
+     * @return true if success, the view is unchanged on failure
+     */
+    bool LoadScene(const std::string &fname);
+
     Handle Point(const std::vector<float> &xyzs, float ptsize = 1.0f,
                  const std::vector<float> &colors = {1.f, 0.f, 0.f});
 
+    /**
+     * Plot a point cloud without copying it.
+     *
+     * The vertex (and color) arrays wrap the caller's memory directly, see
+     * PointBuffer for the lifetime contract. If buffer.release is set it is
+     * also called when this function fails.
+     *
+     * @param buffer caller-owned points and optional per-point colors
+     * @param ptsize size of the points
+     * @param color overall color used when buffer.colors is null
+     * @return Handle
+     */
+    Handle Point(const PointBuffer &buffer, float ptsize = 1.0f,
+                 const std::vector<float> &color = {1.f, 0.f, 0.f});
+
+    /**
+     * Plot a large point cloud with level of detail.
+     *
+     * The points are sorted into an octree whose cells hold ever denser
+     * subsamples of the cloud. Each frame only the cells in view are drawn,
+     * coarse to fine, until the points look dense enough on screen or the
+     * point budget (see SetPointBudget) is used up, so orbiting stays
+     * interactive whatever the size of the cloud. The points are copied into
+     * the octree, building it takes about as long as sorting the points.
+     *
+     * @code
+     * h = v.PointCloudLOD(xyzs, 1.f, colors);
+     * @endcode
+     * @param xyzs points, at most 2^32 - 1 of them
+     * @param ptsize size of the points
+     * @param colors one color or one color per point, 3 or 4 channels
+     * @return Handle
+     */
+    Handle PointCloudLOD(const std::vector<float> &xyzs, float ptsize = 1.0f,
+                         const std::vector<float> &colors = {1.f, 0.f, 0.f});
+
+    /**
+     * Same as above, reading the points from caller memory. The buffer is
+     * only read while the octree is built, buffer.release is called before
+     * returning.
+     */
+    Handle PointCloudLOD(const PointBuffer &buffer, float ptsize = 1.0f,
+                         const std::vector<float> &color = {1.f, 0.f, 0.f});
+
+    /**
+     * Set the maximum number of points drawn per frame for each
+     * PointCloudLOD object, existing and future ones.
+     * Return true if succeed else false.
+     */
+    bool SetPointBudget(size_t budget);
+
     /**
      * Plot line or lines
      *
@@ -324,8 +776,37 @@ struct View
                const std::vector<float> &color = {1.f, 0, 0});
     Handle Sphere(const std::array<float, 3> &center, float raidus,
                   const std::vector<float> &color = {1.f, 0, 0});
+
+    /**
+     * Plot many primitives of the same kind as a single object.
+     *
+     * All instances are drawn from one tessellated unit shape with a single
+     * instanced draw call, so this scales to hundreds of thousands of shapes.
+     * Instances can not be moved or deleted separately.
+     *
+     * @code
+     * h = v.Spheres({0, 0, 0, 1, 0, 0}, {0.1}, {1, 0, 0, 1, 0, 1, 0, 0.5});
+     * @endcode
+     * @param centers 3 floats for each instance
+     * @param radii/extents/heights 1 value (3 for extents) shared by all
+     * instances or 1 value (3 for extents) for each instance
+     * @param colors RGB or RGBA, 1 color shared by all instances or 1 color
+     * for each instance
+     * @return Handle
+     */
     Handle Spheres(const std::vector<float> &centers, std::vector<float> &radii,
                    const std::vector<float> &colors = {1.f, 0, 0, 1.f});
+    Handle Boxes(const std::vector<float> &centers,
+                 const std::vector<float> &extents,
+                 const std::vector<float> &colors = {1.f, 0, 0, 1.f});
+    Handle Cylinders(const std::vector<float> &centers,
+                     const std::vector<float> &radii,
+                     const std::vector<float> &heights,
+                     const std::vector<float> &colors = {1.f, 0, 0, 1.f});
+    Handle Cones(const std::vector<float> &centers,
+                 const std::vector<float> &radii,
+                 const std::vector<float> &heights,
+                 const std::vector<float> &colors = {1.f, 0, 0, 1.f});
     Handle Cone(const std::array<float, 3> &center, float radius, float height,
                 const std::vector<float> &color = {1.f, 0, 0});
     Handle Cylinder(const std::array<float, 3> &center, float radius,
@@ -334,9 +815,84 @@ struct View
     Handle Arrow(const std::array<float, 3> &tail,
                  const std::array<float, 3> &head, float radius,
                  const std::vector<float> &color = {1.0f, 0, 0});
+
+    /**
+     * Mesh
+     *
+     * Plot a triangle mesh. Its indices are stored in 16 bit when it has at
+     * most 65536 vertices, and by default its triangles are reordered so that
+     * the GPU transforms each vertex about once, see MeshOptions.
+     *
+     * @code
+     * MeshOptions options;
+     * options.weld = true; // e.g. for triangle soups
+     * options.normals = normals;
+     * Handle h = v.Mesh(vertices, indices, {0.5f, 0.5f, 0.5f}, options);
+     * @endcode
+     * @param vertices numverts * 3 floats
+     * @param indices 3 vertex indices for each triangle
+     * @param colors RGB or RGBA, 1 color for the mesh or 1 for each vertex
+     * @return Handle
+     */
     Handle Mesh(const std::vector<float> &vertices,
                 const std::vector<unsigned int> &indices,
-                const std::vector<float> &colors = {1.f, 0, 0});
+                const std::vector<float> &colors = {1.f, 0, 0},
+                const MeshOptions &options = MeshOptions());
+
+    /**
+     * LoadAsync, PointAsync, MeshAsync
+     *
+     * Like Load, Point and Mesh, but return right away: the handle is
+     * reserved at once, file parsing or array conversion and normal
+     * generation run on a worker thread, and the object shows up in a later
+     * frame. Until then the handle can already be transformed, shown, hidden,
+     * chained, outlined or deleted. SetColor, SetTransparency and Update*
+     * calls are queued and applied when the object is built, GetColor and
+     * Clone fail. If the object can not be built, the error is logged and the
+     * handle is deleted.
+     *
+     * @code
+     * Handle robot = v.LoadAsync("robot.stl");
+     * v.SetTransform(robot, {0.f, 0.f, 1.f}, {0.f, 0.f, 0.f, 1.f});
+     * v.SetColor(robot, {0.f, 1.f, 0.f, 1.f}); // applied once loaded
+     * @endcode
+     * @return Handle of the object to be
+     */
+    Handle LoadAsync(const std::string &fname,
+                     const std::array<float, 3> &pos = {0.f, 0.f, 0.f},
+                     const std::array<float, 4> &quat = {0.f, 0.f, 0.f, 1.f});
+    Handle PointAsync(std::vector<float> xyzs, float ptsize = 1.0f,
+                      std::vector<float> colors = {1.f, 0.f, 0.f});
+    Handle MeshAsync(std::vector<float> vertices,
+                     std::vector<unsigned int> indices,
+                     std::vector<float> colors = {1.f, 0, 0},
+                     MeshOptions options = MeshOptions());
+
+    /**
+     * Update the geometry of an existing Point/Line/Mesh object in place.
+     *
+     * The arguments follow Point(...), Line(...) and Mesh(...); a line keeps
+     * the mode it was created with. When the new data has the same size as
+     * the old one the arrays are overwritten in place, when it grows they are
+     * reallocated geometrically, so streaming data of a roughly constant size
+     * neither reallocates nor re-creates GPU buffers. The handle stays valid.
+     * UpdateMesh(...) takes per vertex normals as MeshOptions::normals, and
+     * only computes them when normals is empty.
+     *
+     * @code
+     * h = v.Point(xyzs);
+     * v.UpdatePoints(h, new_xyzs);
+     * @endcode
+     * @return true if succeed else false, in which case the object is unchanged
+     */
+    bool UpdatePoints(const Handle &h, const std::vector<float> &xyzs,
+                      const std::vector<float> &colors = {});
+    bool UpdateLine(const Handle &h, const std::vector<float> &lines,
+                    const std::vector<float> &colors = {});
+    bool UpdateMesh(const Handle &h, const std::vector<float> &vertices,
+                    const std::vector<unsigned int> &indices,
+                    const std::vector<float> &colors = {},
+                    const std::vector<float> &normals = {});
 
     /**
      * Plot a plane
@@ -364,6 +920,10 @@ struct View
      *
      * We plot the plane with the center at the world origin and the quaternion.
      *
+     * The plane is a single quad and its grid lines are drawn by a shader, so
+     * its memory and build time do not depend on the number of cells. trans
+     * and quat are its transform, as set by SetTransform.
+     *
      * @code
      * h = v.Plane(2, 2, 1, 1, (1, 1, 1), (0, 0, 0, 1))
      * @endcode
@@ -385,13 +945,18 @@ struct View
      * SetInterSectorMode
      *
      * Set Instersect Mode.
-     * Use PickedPlane() to get picked position and norm .
+     * Objects are picked by a left click, or with hover on every mouse move
+     * and on frames where the objects moved under the mouse.
+     * Use Picked() to get the picked object and PickedPlane() to get picked
+     * position and norm, the norm is zero when the mode can not compute it.
+     * Point clouds and meshes are indexed on the first pick and reindexed
+     * after an update, so that hover stays cheap.
      *
      * @code
-     * v.SetInterSectMode(ViewObjectType_Point, true);
+     * v.SetIntersectMode(IntersectorMode_Point, true);
      * @endcode
-     * @param mode ViewObjectType, ViewObjectType_None for intersect all.
-     * @param hover when hover is true intersect every frame.
+     * @param mode IntersectorMode, IntersectorMode_Disable to stop picking.
+     * @param hover when hover is true intersect every mouse move.
      */
     void SetIntersectMode(IntersectorMode mode, bool hover = false);
 
@@ -510,7 +1075,85 @@ struct View
     bool GetTransform(const Handle &nh, std::array<float, 3> &pos,
                       std::array<float, 4> &quat);
 
+    /**
+     * SetRenderOnDemand
+     *
+     * With on-demand rendering, the default, a frame is only drawn when
+     * something changed: a mutation through this View, camera manipulation,
+     * gizmo interaction or a running animation. Otherwise frames are drawn
+     * continuously.
+     *
+     * @code
+     * v.SetRenderOnDemand(false);
+     * @endcode
+     * @param on_demand true to draw frames only when needed
+     */
+    void SetRenderOnDemand(bool on_demand);
+
+    /**
+     * Return the number of frames drawn so far, e.g. to check that an idle
+     * view draws none.
+     */
+    uint64_t GetFrameCount() const;
+
+    /**
+     * Return the time the cull traversal took in milliseconds, averaged over
+     * the last frames, e.g. to see how the scene octree culls. It is measured
+     * from the first call on, which returns -1, as does a view that drew no
+     * frame since.
+     */
+    double GetCullTime();
+
+    /**
+     * Post
+     *
+     * Queue a command to run on the render thread at the start of the next
+     * frame. This is the only View method that may be called from other
+     * threads, the command itself may call any View method. Commands run in
+     * the order they were posted by each thread.
+     *
+     * @code
+     * // on a worker thread
+     * auto f = v.Post([&xyzs](View &v) { return v.Point(xyzs); });
+     * Handle h = f.get(); // waits until the next frame ran the command
+     * @endcode
+     * @param f callable taking View&
+     * @return future of the result of f, an exception thrown by f is stored
+     * in it. If the View is destroyed before the command ran, the future
+     * holds a broken_promise error.
+     */
+    template <typename F>
+    auto Post(F &&f) -> std::future<decltype(f(std::declval<View &>()))>
+    {
+        using R = decltype(f(std::declval<View &>()));
+        auto task = std::make_shared<std::packaged_task<R(View &)>>(
+            std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        PostCommand([task](View &view) { (*task)(view); });
+        return result;
+    }
+
+    /**
+     * Run the commands posted so far on the calling thread, which must be the
+     * render thread. Frames do this on their own, call it only when driving
+     * the View without QViewerWidget.
+     * @return the number of commands run
+     */
+    size_t ProcessCommands();
+
 private:
+    void PostCommand(std::function<void(View &)> command);
+    // Used by QViewerWidget: draw a frame and return true if another one is
+    // needed right away.
+    bool Frame();
+    // Called when the scene changed while no frame was pending, also by the
+    // threads calling Post(...). Calls and this setter are serialized by
+    // Vis3d::redraw_mutex: once it returns, the previous request is neither
+    // running nor called again, e.g. by a widget being destroyed.
+    void SetRedrawRequest(std::function<void()> request);
+    // Whether mouse moves without a pressed button need a frame.
+    bool NeedsHoverEvents() const;
+
     Handle Clone(const Handle &nh, const osg::Matrix &m);
     Handle Load(const std::string &fname, const osg::Matrix &m);
     Handle Axes(const osg::Matrix &m, float axis_len, float axis_size);